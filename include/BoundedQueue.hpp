@@ -0,0 +1,175 @@
+#ifndef INCLUDE_BOUNDEDQUEUE_HPP_
+#define INCLUDE_BOUNDEDQUEUE_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+
+/**
+ * @brief
+ * Lock free queue of a fixed capacity, any amount of threads can push and pop.
+ * Every cell holds a sequence number telling whether it's ready to be written or read
+ * for the current turn, so a push and a pop only contend on their own index.
+ * TryPush and TryPop never block, they fail instead when the queue is full or empty.
+ * Push and Pop sleep on a counter bumped by every push, pop and Close until they can go on.
+ *
+ * @tparam T Type of the items, must be default constructible and movable
+ */
+template<class T>
+class BoundedQueue
+{
+private:
+    struct Cell
+    {
+        std::atomic<std::size_t> sequence;
+        T value;
+    };
+private:
+    std::unique_ptr<Cell[]> m_cells;
+    std::size_t m_mask; // The capacity is a power of two, the index of a cell is position & mask
+
+    // Kept on their own cache line, the producers and the consumers don't slow each other down
+    alignas(64) std::atomic<std::size_t> m_push_position{ 0 };
+    alignas(64) std::atomic<std::size_t> m_pop_position{ 0 };
+    alignas(64) std::atomic<bool> m_closed{ false };
+    alignas(64) std::atomic<std::uint32_t> m_version{ 0 }; // Changes after every push, pop and Close, the blocking calls wait on it
+private:
+    // Wakes the blocking calls, they check the queue again
+    void Bump()
+    {
+        m_version.fetch_add(1, std::memory_order_release);
+        m_version.notify_all();
+    }
+
+    [[nodiscard]] bool TryPushFrom(T& value)
+    {
+        auto position = m_push_position.load(std::memory_order_relaxed);
+        while(true)
+        {
+            auto& cell = m_cells[position & m_mask];
+            const auto sequence = cell.sequence.load(std::memory_order_acquire);
+            const auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+
+            if(difference == 0)
+            {
+                if(m_push_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    cell.value = std::move(value);
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    Bump();
+                    return true;
+                }
+            }
+            else if(difference < 0) {
+                return false; // Full, the cell still holds an item of the previous turn
+            }
+            else {
+                position = m_push_position.load(std::memory_order_relaxed);
+            }
+        }
+    }
+public:
+    /**
+     * @param capacity Rounded up to the next power of two
+     */
+    explicit BoundedQueue(const std::size_t capacity)
+    {
+        std::size_t rounded_capacity{ 1 };
+        while(rounded_capacity < capacity) {
+            rounded_capacity <<= 1;
+        }
+
+        m_cells = std::make_unique<Cell[]>(rounded_capacity);
+        m_mask = rounded_capacity - 1;
+        for(std::size_t i = 0; i < rounded_capacity; ++i) {
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+public:
+    [[nodiscard]] std::size_t Capacity() const { return m_mask + 1; }
+
+    // No item is pushed after this, the consumers stop once the queue is drained
+    void Close()
+    {
+        m_closed.store(true, std::memory_order_release);
+        Bump();
+    }
+    [[nodiscard]] bool Closed() const { return m_closed.load(std::memory_order_acquire); }
+public:
+    [[nodiscard]] bool TryPush(T value) { return TryPushFrom(value); }
+
+    [[nodiscard]] bool TryPop(T& value)
+    {
+        auto position = m_pop_position.load(std::memory_order_relaxed);
+        while(true)
+        {
+            auto& cell = m_cells[position & m_mask];
+            const auto sequence = cell.sequence.load(std::memory_order_acquire);
+            const auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position + 1);
+
+            if(difference == 0)
+            {
+                if(m_pop_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    value = std::move(cell.value);
+                    cell.sequence.store(position + m_mask + 1, std::memory_order_release);
+                    Bump();
+                    return true;
+                }
+            }
+            else if(difference < 0) {
+                return false; // Empty, the cell wasn't written for this turn yet
+            }
+            else {
+                position = m_pop_position.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Sleeps while the queue is full
+    void Push(T value)
+    {
+        while(true)
+        {
+            // Read before trying, a pop between the try and the wait changes it and the wait returns right away
+            const auto version = m_version.load(std::memory_order_acquire);
+            if(TryPushFrom(value)) {
+                return;
+            }
+
+            m_version.wait(version, std::memory_order_acquire);
+        }
+    }
+
+    /**
+     * @brief
+     * Sleeps while the queue is empty and still open
+     * @return false The queue is closed and drained, no item will come anymore
+     */
+    [[nodiscard]] bool Pop(T& value)
+    {
+        while(true)
+        {
+            const auto version = m_version.load(std::memory_order_acquire);
+            const auto closed = Closed();
+            if(TryPop(value)) {
+                return true;
+            }
+
+            // Closed before the try, nothing can be pushed after it
+            if(closed) {
+                return false;
+            }
+
+            m_version.wait(version, std::memory_order_acquire);
+        }
+    }
+};
+
+#endif // INCLUDE_BOUNDEDQUEUE_HPP_
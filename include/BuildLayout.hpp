@@ -0,0 +1,50 @@
+#ifndef INCLUDE_BUILDLAYOUT_HPP_
+#define INCLUDE_BUILDLAYOUT_HPP_
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+#include <result.h>
+
+/**
+ * @brief
+ * Where everything was placed in a protected build. It's written next to the protected file
+ * so the next build of the same program can keep every unchanged region where it was,
+ * with the same keys, and only translate the regions whose native code changed.
+ */
+class BuildLayout
+{
+public:
+    // A translated region of the build
+    struct Region
+    {
+        std::uint32_t rva; // Rva of the native region
+        std::uint32_t size; // Size of the native region
+        std::uint64_t source_hash; // Hash of the native code before it was patched
+        std::uint32_t vcode_offset; // Offset of the translated code inside of the virtual code section
+        std::uint32_t vcode_size; // Size of the translated code
+    };
+public:
+    std::uint64_t key_seed{ 0 };
+    std::uint32_t vm_rva{ 0 }; // The '.Ign1' section
+    std::uint32_t vm_size{ 0 };
+    std::uint32_t vcode_rva{ 0 }; // The '.Ign2' section
+    std::uint32_t vcode_size{ 0 };
+    std::uint64_t vm_hash{ 0 }; // Hash of the virtual machine the regions were translated for
+    std::uint32_t translator_version{ 0 }; // Translation::TRANSLATOR_VERSION of the build
+private:
+    std::vector<Region> m_regions; // Sorted by rva
+public:
+    BuildLayout() = default;
+public:
+    [[nodiscard]] const std::vector<Region>& Regions() const { return m_regions; }
+    void AddRegion(const Region& region);
+    [[nodiscard]] std::optional<Region> Find(const std::uint32_t rva) const;
+public:
+    [[nodiscard]] Result<bool, const char*> Save(const std::filesystem::path& path) const;
+    static Result<BuildLayout, const char*> Load(const std::filesystem::path& path);
+};
+
+#endif // INCLUDE_BUILDLAYOUT_HPP_
@@ -0,0 +1,79 @@
+#ifndef INCLUDE_BYTECODEWRITER_HPP_
+#define INCLUDE_BYTECODEWRITER_HPP_
+
+#include <cassert>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#include <TranslationArena.hpp>
+
+/**
+ * @brief
+ * Emits the bytecode of one native instruction into a BytecodeBuffer.
+ * Begin reserves the worst case size of the whole sequence, which is the only place
+ * running out of memory is checked. Every Emit after it is a plain store, the items
+ * are only committed to the buffer by End.
+ *
+ *     BytecodeWriter writer(buffer);
+ *     if(!writer.Begin(max_size)) {
+ *         // Out of memory
+ *     }
+ *     writer.Emit<std::uint32_t>(...);
+ *     writer.End();
+ */
+class BytecodeWriter
+{
+private:
+    BytecodeBuffer& m_buffer;
+    std::uint8_t* m_start{ nullptr };
+    std::uint8_t* m_cursor{ nullptr };
+#ifndef NDEBUG
+    std::uint8_t* m_limit{ nullptr };
+#endif
+public:
+    explicit BytecodeWriter(BytecodeBuffer& buffer) : m_buffer(buffer) {}
+
+    BytecodeWriter(const BytecodeWriter&) = delete;
+    BytecodeWriter& operator=(const BytecodeWriter&) = delete;
+public:
+    // Bytes emitted since Begin
+    [[nodiscard]] std::size_t Written() const { return static_cast<std::size_t>(m_cursor - m_start); }
+public:
+    [[nodiscard]] bool Begin(const std::size_t max_size)
+    {
+        if(!m_buffer.Reserve(max_size)) {
+            return false;
+        }
+
+        m_start = m_buffer.End();
+        m_cursor = m_start;
+#ifndef NDEBUG
+        m_limit = m_start + max_size;
+#endif
+        return true;
+    }
+
+    void End()
+    {
+        m_buffer.Commit(Written());
+        m_start = m_cursor;
+    }
+
+    template<class T>
+    void Emit(const T value)
+    {
+        assert(static_cast<std::size_t>(m_limit - m_cursor) >= sizeof(value) && "The reserved size of the sequence is too small");
+        std::memcpy(m_cursor, &value, sizeof(value));
+        m_cursor += sizeof(value);
+    }
+
+    void Emit(const std::uint8_t* source, const std::size_t size)
+    {
+        assert(static_cast<std::size_t>(m_limit - m_cursor) >= size && "The reserved size of the sequence is too small");
+        std::memcpy(m_cursor, source, size);
+        m_cursor += size;
+    }
+};
+
+#endif // INCLUDE_BYTECODEWRITER_HPP_
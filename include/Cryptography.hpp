@@ -9,19 +9,60 @@ namespace cryptography
 {
     /**
      * @brief
-     * Like it's name indicates, the function generates a pseudo random 16 bit number
-     * using the std engine.
+     * Draws a seed for a build that wasn't given one, using the std random device.
      *
-     * @return std::uint16_t The value generated.
+     * @return std::uint64_t The value generated.
      */
-    static inline std::uint16_t Generate16BitKey()
+    static inline std::uint64_t GenerateSeed()
     {
-        static std::random_device rd;
-        static std::independent_bits_engine<std::mt19937, 16, std::uint16_t> key_engine(rd());
+        std::random_device rd;
+        return (static_cast<std::uint64_t>(rd()) << 32) | rd();
+    }
 
-        return key_engine();
+    /**
+     * @brief
+     * Finalizer of the splitmix64 generator. Spreads every bit of the input over the whole output.
+     */
+    static inline constexpr std::uint64_t Mix64(std::uint64_t value)
+    {
+        value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9;
+        value = (value ^ (value >> 27)) * 0x94d049bb133111eb;
+        return value ^ (value >> 31);
     }
 
+    /**
+     * @brief
+     * Derives the n-th key of a region. The key only depends on its inputs, which makes
+     * every build with the same seed give the same keys, whatever the order the regions are processed in.
+     *
+     * @param seed The seed of the build
+     * @param region_rva Rva of the region the key is used in
+     * @param counter Index of the key inside of the region
+     * @return std::uint16_t The derived key.
+     */
+    static inline constexpr std::uint16_t Derive16BitKey(std::uint64_t seed, std::uint32_t region_rva, std::uint32_t counter)
+    {
+        const auto region_state = Mix64(seed ^ (static_cast<std::uint64_t>(region_rva) * 0x9e3779b97f4a7c15));
+        return static_cast<std::uint16_t>(Mix64(region_state + counter) >> 48);
+    }
+
+    /**
+     * @brief
+     * The keys of a single region, drawn one after the other.
+     * The stream holds no shared state, every worker can have its own without any lock.
+     */
+    class KeyStream
+    {
+    private:
+        std::uint64_t m_seed;
+        std::uint32_t m_region_rva;
+        std::uint32_t m_counter{ 0 };
+    public:
+        KeyStream(std::uint64_t seed, std::uint32_t region_rva) : m_seed(seed), m_region_rva(region_rva) {}
+    public:
+        [[nodiscard]] std::uint16_t Next16BitKey() { return Derive16BitKey(m_seed, m_region_rva, m_counter++); }
+    };
+
     /**
      * @brief
      * This function is used as a really basic way of obfuscating the entry point
@@ -0,0 +1,70 @@
+#ifndef INCLUDE_DECODEDREGION_HPP_
+#define INCLUDE_DECODEDREGION_HPP_
+
+#include <cstdint>
+#include <cstddef>
+#include <span>
+#include <vector>
+
+#include <Zydis/Zydis.h>
+
+/**
+ * @brief
+ * What the translation needs from an operand, instead of the whole ZydisDecodedOperand.
+ * A memory operand keeps its base in 'reg' and its displacement in 'value'.
+ */
+struct OperandSummary
+{
+    std::int64_t value; // The immediate, or the displacement of a memory operand
+    std::uint16_t reg; // The register, or the base of a memory operand
+    std::uint16_t index; // The index of a memory operand
+    std::uint8_t type; // A ZydisOperandType, ZYDIS_OPERAND_TYPE_UNUSED when the instruction has less operands
+    std::uint8_t scale;
+    bool has_displacement;
+
+    [[nodiscard]] constexpr ZydisOperandType Type() const { return static_cast<ZydisOperandType>(type); }
+    [[nodiscard]] constexpr ZydisRegister Register() const { return static_cast<ZydisRegister>(reg); }
+    [[nodiscard]] constexpr ZydisRegister Index() const { return static_cast<ZydisRegister>(index); }
+};
+
+static_assert(sizeof(OperandSummary) == 16);
+
+/**
+ * @brief
+ * The instructions of a region, decoded once and stored as one contiguous array per field.
+ * The translation and any pass analysing the region walk these arrays instead of decoding
+ * the code again. Decoding a new region reuses the arrays, a store kept by a thread stops
+ * allocating once it held its biggest region.
+ *
+ * The instructions are decoded up to the end of the region or up to the first bytes that
+ * aren't an instruction.
+ */
+class DecodedRegion
+{
+public:
+    // Operands summarized per instruction, the following ones are dropped. No handler uses more
+    static constexpr std::size_t OPERANDS_PER_INSTRUCTION = 2;
+private:
+    std::vector<std::uint16_t> m_mnemonics; // ZydisMnemonic
+    std::vector<std::uint8_t> m_lengths;
+    std::vector<std::uint32_t> m_offsets; // From the start of the region
+    std::vector<std::uint8_t> m_operand_counts; // Visible operands, can be more than the summarized ones
+    std::vector<OperandSummary> m_operands; // OPERANDS_PER_INSTRUCTION per instruction
+public:
+    [[nodiscard]] std::size_t Count() const { return m_mnemonics.size(); }
+
+    [[nodiscard]] std::span<const std::uint16_t> Mnemonics() const { return m_mnemonics; }
+    [[nodiscard]] std::span<const std::uint8_t> Lengths() const { return m_lengths; }
+    [[nodiscard]] std::span<const std::uint32_t> Offsets() const { return m_offsets; }
+    [[nodiscard]] std::span<const std::uint8_t> OperandCounts() const { return m_operand_counts; }
+
+    [[nodiscard]] ZydisMnemonic Mnemonic(const std::size_t i) const { return static_cast<ZydisMnemonic>(m_mnemonics[i]); }
+    [[nodiscard]] const OperandSummary* Operands(const std::size_t i) const { return m_operands.data() + i * OPERANDS_PER_INSTRUCTION; }
+
+    // Bytes covered by the decoded instructions
+    [[nodiscard]] std::size_t DecodedSize() const { return m_offsets.empty() ? 0 : m_offsets.back() + m_lengths.back(); }
+public:
+    void Decode(std::span<const std::uint8_t> code);
+};
+
+#endif // INCLUDE_DECODEDREGION_HPP_
@@ -0,0 +1,24 @@
+#ifndef INCLUDE_FILECLONE_HPP_
+#define INCLUDE_FILECLONE_HPP_
+
+#include <filesystem>
+
+#include <result.h>
+
+namespace FileClone
+{
+    /**
+     * @brief
+     * Makes a copy of the source file at the destination while moving as few bytes as possible.
+     * The file is first cloned (reflink), which shares the extents of the source until they are
+     * modified. When the filesystem can't clone, the copy is done in the kernel with copy_file_range.
+     * A regular copy is only done as a last resort.
+     *
+     * @param source The file to be copied
+     * @param destination Where the copy is created. An existing file is replaced
+     * @return Result<bool, const char*> Ok or an error message
+     */
+    Result<bool, const char*> Clone(const std::filesystem::path& source, const std::filesystem::path& destination);
+}
+
+#endif // INCLUDE_FILECLONE_HPP_
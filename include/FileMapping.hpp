@@ -0,0 +1,40 @@
+#ifndef INCLUDE_FILEMAPPING_HPP_
+#define INCLUDE_FILEMAPPING_HPP_
+
+#include <cstdint>
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <span>
+
+#include <result.h>
+
+/**
+ * @brief
+ * Read only view of a whole file mapped in the address space of the process.
+ * The pages are mapped copy-on-write, which means that a caller can patch a buffer
+ * handed out from the mapping without the modification ever reaching the file on disk.
+ * An image which doesn't come from a file is held the same way, as a private copy of its buffer.
+ */
+class FileMapping
+{
+private:
+    std::uint8_t* m_base{ nullptr };
+    std::size_t m_size{ 0 };
+    std::unique_ptr<std::uint8_t[]> m_copy; // Only set for a mapping made from a buffer, nothing is unmapped then
+public:
+    FileMapping() = default;
+    FileMapping(const FileMapping&) = delete;
+    FileMapping& operator=(const FileMapping&) = delete;
+    ~FileMapping();
+public:
+    [[nodiscard]] std::uint8_t* Data() const { return m_base; }
+    [[nodiscard]] std::size_t Size() const { return m_size; }
+    [[nodiscard]] std::span<const std::uint8_t> Span() const { return { m_base, m_size }; }
+    void Discard(std::span<const std::uint8_t> range) const;
+public:
+    static Result<std::shared_ptr<FileMapping>, const char*> Open(const std::filesystem::path& path);
+    static Result<std::shared_ptr<FileMapping>, const char*> FromBuffer(std::span<const std::uint8_t> buffer);
+};
+
+#endif // INCLUDE_FILEMAPPING_HPP_
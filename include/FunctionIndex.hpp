@@ -0,0 +1,54 @@
+#ifndef INCLUDE_FUNCTIONINDEX_HPP_
+#define INCLUDE_FUNCTIONINDEX_HPP_
+
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <Win32.hpp>
+
+/**
+ * @brief
+ * Boundaries of every function described by the exception directory of an image,
+ * sorted by their start address. Used to pick the regions to be translated
+ * without having to disassemble the image.
+ */
+class FunctionIndex
+{
+public:
+    // A function covers the rvas in [begin, end)
+    struct Function
+    {
+        std::uint32_t begin;
+        std::uint32_t end;
+
+        [[nodiscard]] std::uint32_t Size() const { return end - begin; }
+    };
+
+    // Every condition must hold for a function to be selected
+    struct Selector
+    {
+        std::uint32_t range_begin{ 0 }; // Only the functions fully inside of [range_begin, range_end)
+        std::uint32_t range_end{ std::numeric_limits<std::uint32_t>::max() };
+        std::uint32_t min_size{ 0 }; // Only the functions bigger than this
+        std::size_t max_count{ std::numeric_limits<std::size_t>::max() }; // At most this many, by ascending rva
+    };
+private:
+    std::vector<Function> m_functions; // Sorted by begin, never overlapping
+public:
+    FunctionIndex() = default;
+    explicit FunctionIndex(std::vector<Function> functions);
+    explicit FunctionIndex(std::span<const Win32::IMAGE_RUNTIME_FUNCTION_ENTRY> entries);
+public:
+    [[nodiscard]] std::size_t Size() const { return m_functions.size(); }
+    [[nodiscard]] bool Empty() const { return m_functions.empty(); }
+    [[nodiscard]] const std::vector<Function>& Functions() const { return m_functions; }
+public:
+    [[nodiscard]] std::optional<Function> Find(const std::uint32_t rva) const;
+    [[nodiscard]] std::vector<Function> Select(const Selector& selector) const;
+};
+
+#endif // INCLUDE_FUNCTIONINDEX_HPP_
@@ -0,0 +1,91 @@
+#ifndef INCLUDE_IGNOTUM_H_
+#define INCLUDE_IGNOTUM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * C interface of the library build (LibMode).
+ *
+ * A session protects one image held in memory:
+ *
+ *     IgnotumOpenSession  -> copies the image and the virtual machine
+ *     IgnotumAddRegions   -> any amount of times, with any amount of regions
+ *     IgnotumProtect      -> translates every region and gives the size of the protected image
+ *     IgnotumCopyImage    -> the protected image into a buffer of the caller
+ *     IgnotumWriteImage   -> or the protected image handed to a callback in chunks
+ *     IgnotumCloseSession
+ *
+ * Nothing touches the filesystem unless a memory budget is set. The protected image is then built in
+ * a work file named ignotum-<random>.ign-work, created by IgnotumProtect in the work directory of the
+ * options, or the temporary directory of the system when it's NULL. The file is removed by
+ * IgnotumCloseSession, once the image was written or not.
+ * A session must only be used by one thread at a time, different sessions can be used concurrently.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct IgnotumSession IgnotumSession;
+
+typedef enum IgnotumResult
+{
+    IGNOTUM_SUCCESS = 0,
+    IGNOTUM_INVALID_ARGUMENT,
+    IGNOTUM_INVALID_IMAGE,
+    IGNOTUM_INVALID_REGION,
+    IGNOTUM_INVALID_STATE, /* The call doesn't fit the step the session is at */
+    IGNOTUM_PROTECTION_FAILED,
+    IGNOTUM_BUFFER_TOO_SMALL,
+    IGNOTUM_WRITE_FAILED, /* The callback stopped the write */
+    IGNOTUM_INTERNAL_ERROR
+} IgnotumResult;
+
+typedef struct IgnotumRegion
+{
+    uint32_t rva;
+    uint32_t size;
+} IgnotumRegion;
+
+typedef struct IgnotumOptions
+{
+    uint64_t key_seed; /* Only used when use_key_seed is not 0, a random seed is drawn otherwise */
+    uint32_t use_key_seed;
+    uint32_t threads; /* Threads translating the regions, 0 uses every core */
+    uint64_t memory_budget; /* Bytes the translation can use at once, 0 for no limit */
+    const char* work_directory; /* Where the work file of a memory budget is created, NULL for the temporary directory. Copied */
+} IgnotumOptions;
+
+/* Receives the protected image in order. Returns 0 to stop the write */
+typedef int (*IgnotumWriteCallback)(void* user_data, const uint8_t* data, size_t size);
+
+/* The image and the virtual machine are copied, the caller can release them once this returns. options can be NULL */
+IgnotumResult IgnotumOpenSession(
+    const uint8_t* image, size_t image_size,
+    const uint8_t* virtual_machine, size_t virtual_machine_size,
+    const IgnotumOptions* options,
+    IgnotumSession** session
+);
+
+IgnotumResult IgnotumAddRegions(IgnotumSession* session, const IgnotumRegion* regions, size_t region_count);
+
+/* image_size can be NULL. Once the protection failed the session can only be closed */
+IgnotumResult IgnotumProtect(IgnotumSession* session, size_t* image_size);
+
+IgnotumResult IgnotumCopyImage(IgnotumSession* session, uint8_t* buffer, size_t buffer_size);
+IgnotumResult IgnotumWriteImage(IgnotumSession* session, IgnotumWriteCallback callback, void* user_data);
+
+/* The seed the keys of the session were derived from */
+uint64_t IgnotumKeySeed(const IgnotumSession* session);
+
+/* Message of the last error of the session, an empty string if there was none */
+const char* IgnotumLastError(const IgnotumSession* session);
+
+void IgnotumCloseSession(IgnotumSession* session);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCLUDE_IGNOTUM_H_ */
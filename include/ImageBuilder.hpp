@@ -0,0 +1,96 @@
+#ifndef INCLUDE_IMAGEBUILDER_HPP_
+#define INCLUDE_IMAGEBUILDER_HPP_
+
+#include <cstdint>
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include <result.h>
+
+/**
+ * @brief
+ * Collects every modification made to an image in memory so they can be validated
+ * and written back to the file in a single ordered pass.
+ * Nothing reaches the disk before Commit is called, which means that an aborted
+ * protection never leaves a half written file behind.
+ *
+ * With StreamTo, every extent is written to a work image as soon as it's staged and
+ * only its place is kept in memory. The work image is a copy of the base which takes
+ * the place of the output on Commit, and it's removed if the builder is dropped before.
+ */
+class ImageBuilder
+{
+public:
+    // A run of bytes replacing the content of the file at the given offset
+    struct Extent { std::uintmax_t offset; std::vector<std::uint8_t> bytes; };
+    // A run of bytes already written to the work image, only its place is kept
+    struct WrittenExtent { std::uintmax_t offset; std::uintmax_t size; };
+    // Receives the bytes of an image in order, a piece at a time. Returning false stops the writing
+    using Sink = std::function<bool(std::span<const std::uint8_t>)>;
+private:
+    // Gaps smaller than this between two extents are filled with the original bytes
+    // so both extents can be written with the same call
+    static constexpr std::uintmax_t kMaxBridgedGap = 0x1000;
+    // The written extents are read back from the work image by pieces of this size at most
+    static constexpr std::uintmax_t kReadBackChunkSize = 0x10000;
+
+    // An extent held in memory or written to the work image, in the order of the file. extent is null for a written one
+    struct Range { std::uintmax_t offset; std::uintmax_t size; const Extent* extent; };
+    struct WorkImage;
+
+    std::uintmax_t m_base_size{ 0 }; // Size of the file the extents are applied on
+    std::uintmax_t m_image_size{ 0 }; // Size of the file once everything is committed
+    std::vector<Extent> m_extents;
+    bool m_sorted{ true };
+    std::vector<WrittenExtent> m_written; // Only filled once StreamTo was called
+    std::shared_ptr<WorkImage> m_work_image; // Shared by the copies of the builder, see StreamTo
+
+    // Only known for a builder loaded from a delta. Fingerprint of the base bytes replaced by the extents
+    std::uint64_t m_base_fingerprint{ 0 };
+private:
+    [[nodiscard]] std::uint64_t BaseFingerprint(std::span<const std::uint8_t> base_image) const;
+    [[nodiscard]] std::vector<Range> Ranges() const;
+    [[nodiscard]] Result<bool, const char*> WriteToWorkImage(const std::uintmax_t offset, const std::uint8_t* data, const std::size_t size);
+    [[nodiscard]] Result<bool, const char*> ReadWorkImage(std::uintmax_t offset, std::uintmax_t size, const Sink& sink);
+    [[nodiscard]] Result<bool, const char*> FinishWorkImage(const std::filesystem::path& destination);
+public:
+    explicit ImageBuilder(std::uintmax_t base_size = 0) : m_base_size(base_size), m_image_size(base_size) {}
+public:
+    [[nodiscard]] std::uintmax_t BaseSize() const { return m_base_size; }
+    [[nodiscard]] std::uintmax_t ImageSize() const { return m_image_size; }
+    [[nodiscard]] const std::vector<Extent>& Extents() const { return m_extents; }
+    [[nodiscard]] bool Streaming() const { return m_work_image != nullptr; }
+public:
+    [[nodiscard]] Result<bool, const char*> StreamTo(const std::filesystem::path& work_path);
+    [[nodiscard]] Result<bool, const char*> Stage(const std::uintmax_t offset, const std::uint8_t* data, const std::size_t size);
+    void Grow(const std::uintmax_t image_size);
+    void Clear();
+    [[nodiscard]] Result<bool, const char*> Validate();
+    [[nodiscard]] Result<bool, const char*> Commit(
+        const std::filesystem::path& path,
+        std::span<const std::uint8_t> base_image = {}
+    );
+    [[nodiscard]] Result<bool, const char*> CommitCopy(
+        const std::filesystem::path& base_path,
+        const std::filesystem::path& output_path,
+        std::span<const std::uint8_t> base_image = {}
+    );
+    [[nodiscard]] Result<bool, const char*> ExportDelta(
+        const std::filesystem::path& delta_path,
+        std::span<const std::uint8_t> base_image
+    );
+    [[nodiscard]] Result<bool, const char*> WriteTo(std::span<const std::uint8_t> base_image, const Sink& sink);
+public:
+    static Result<ImageBuilder, const char*> LoadDelta(const std::filesystem::path& delta_path);
+    static Result<bool, const char*> ApplyDelta(
+        const std::filesystem::path& delta_path,
+        const std::filesystem::path& base_path,
+        const std::filesystem::path& output_path
+    );
+};
+
+#endif // INCLUDE_IMAGEBUILDER_HPP_
@@ -0,0 +1,41 @@
+#ifndef INCLUDE_IMPORTINDEX_HPP_
+#define INCLUDE_IMPORTINDEX_HPP_
+
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+
+/**
+ * @brief
+ * Flat lookup table of every imported function of an image.
+ * Each (library, function) pair maps to the rva of its slot in the import address table.
+ * The names are interned once, the keys of the table are views over the interned names.
+ * Library names are compared without case, like the windows loader does.
+ */
+class ImportIndex
+{
+private:
+    struct Key { std::string_view dll; std::string_view function; };
+    struct KeyHash { std::size_t operator()(const Key& key) const; };
+    struct KeyEqual { bool operator()(const Key& a, const Key& b) const; };
+private:
+    std::deque<std::string> m_names; // A deque never moves its elements, the views stay valid
+    std::unordered_set<std::string_view> m_interned; // Views over m_names, to find a name stored already
+    std::unordered_map<Key, std::uint32_t, KeyHash, KeyEqual> m_iat_rvas;
+public:
+    [[nodiscard]] std::size_t Size() const { return m_iat_rvas.size(); }
+    [[nodiscard]] static std::string OrdinalName(const std::uint16_t ordinal);
+public:
+    void Reserve(const std::size_t count) { m_iat_rvas.reserve(count); }
+    [[nodiscard]] std::string_view Intern(std::string_view value);
+    void Insert(const std::string_view interned_dll, const std::string_view interned_function, const std::uint32_t iat_rva);
+    [[nodiscard]] std::optional<std::uint32_t> Find(const std::string_view dll, const std::string_view function) const;
+    [[nodiscard]] std::optional<std::uint32_t> Find(const std::string_view dll, const std::uint16_t ordinal) const;
+};
+
+#endif // INCLUDE_IMPORTINDEX_HPP_
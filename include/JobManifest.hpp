@@ -0,0 +1,59 @@
+#ifndef INCLUDE_JOBMANIFEST_HPP_
+#define INCLUDE_JOBMANIFEST_HPP_
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <result.h>
+
+namespace JobManifest
+{
+    // A file to protect, as described by one line of the manifest
+    struct Entry
+    {
+        std::filesystem::path input;
+        std::filesystem::path output;
+        // (rva, size) pairs, the functions are discovered when there's none
+        std::vector<std::pair<std::size_t, std::size_t>> region_pairs;
+    };
+
+    /**
+     * @brief
+     * Loads a batch manifest. Every line describes a file to protect:
+     *
+     *     input output [rva size]...
+     *
+     * The rvas and sizes are in hexadecimal, like with --block. Paths holding spaces are quoted,
+     * relative paths are relative to the directory of the manifest.
+     * Empty lines and lines starting with '#' are skipped.
+     *
+     * @param manifest_path Path of the manifest
+     * @return Result<std::vector<Entry>, const char*> The entries in the order of the file or an error message
+     */
+    Result<std::vector<Entry>, const char*> Load(const std::filesystem::path& manifest_path);
+
+    /**
+     * @brief
+     * Parses one line of a manifest, the line must not be empty or a comment
+     *
+     * @param line The line, without its line break
+     * @param base_directory Relative paths are relative to it
+     * @return Result<Entry, const char*> The entry or an error message
+     */
+    Result<Entry, const char*> ParseLine(std::string_view line, const std::filesystem::path& base_directory);
+
+    /**
+     * @brief
+     * Writes an entry as a line of a manifest, ParseLine gives the entry back
+     *
+     * @param entry The entry to be written
+     * @return std::string The line, without its line break
+     */
+    std::string FormatLine(const Entry& entry);
+}
+
+#endif // INCLUDE_JOBMANIFEST_HPP_
@@ -2,11 +2,74 @@
 #define __MAIN_H__
 
 #include <memory>
+#include <vector>
+#include <optional>
+#include <filesystem>
+#include <span>
+#include <atomic>
 
 #include <PeFile.hpp>
+#include <MappedMemory.hpp>
+#include <FunctionIndex.hpp>
+#include <RegionManifest.hpp>
+#include <ThreadPool.hpp>
+#include <TranslationCache.hpp>
+#include <BuildLayout.hpp>
 
 namespace mainspace
 {
+    // Size of the instructions entering the virtual machine. [push imm32] [call rel32]
+    constexpr std::uint32_t MIN_REGION_SIZE = 10;
+
+    // A translated region once it's placed. Its code and the patched native region are already staged in the file
+    struct TranslatedRegion
+    {
+        std::uint32_t rva; // Rva of where the native region starts
+        std::uint32_t size; // Size of the native region
+        std::uint32_t vcode_offset; // Offset of the translated code inside of the virtual code section
+        std::uint32_t vcode_size; // Size of the translated code
+        std::uint64_t source_hash; // Hash of the native code before it was patched, kept in the layout
+    };
+
+    // Time a stage of the translation pipeline spent working and waiting on the other stages
+    struct StageStats
+    {
+        std::atomic<std::uint64_t> busy_ns{ 0 };
+        std::atomic<std::uint64_t> wait_ns{ 0 };
+    };
+
+    // A previous protected build of the same program, the unchanged regions are taken from it
+    struct PreviousBuild
+    {
+        BuildLayout layout;
+        std::shared_ptr<PeFile> image; // The previous protected file, keeps the view below alive
+        std::span<const std::uint8_t> vcode; // Content of its virtual code section
+    };
+
+    // How the functions are picked when they are discovered instead of given as regions
+    struct FunctionSelection
+    {
+        bool enabled{ false };
+        bool scan_prologues{ false }; // Scan for prologues instead of using the exception directory
+        FunctionIndex::Selector selector;
+    };
+
+    // Everything needed to protect one file, from the command line or from a line of a batch manifest
+    struct ProtectJob
+    {
+        std::filesystem::path input;
+        std::optional<std::filesystem::path> output; // The input is modified in place without it
+        std::optional<std::filesystem::path> delta; // Only the modifications are written when it's set
+        std::vector<RegionManifest::Entry> regions; // Given explicitly, in any order
+        FunctionSelection functions;
+        std::uint64_t key_seed{ 0 }; // Every key of the file is derived from it
+        const TranslationCache* cache{ nullptr }; // Translated blocks from the previous runs, can be null
+        std::optional<std::filesystem::path> layout; // Where the layout of the build is written
+        std::optional<std::filesystem::path> previous_output; // A previous protected build to update incrementally
+        std::optional<std::filesystem::path> previous_layout; // The layout written with the previous build
+        std::uint64_t memory_budget{ 0 }; // Bytes the translation can use at once, unbounded when it's 0
+    };
+
     struct BeginProcessContext
     {
         std::shared_ptr<PeFile> pe_file; // File which is currently being worked on
@@ -16,15 +79,26 @@ namespace mainspace
         // The first item is the rva of where the region is starting
         // The second item is the size of the region to be virtualized
         std::vector<std::pair<std::size_t, std::size_t>> region_pairs;
+        ThreadPool& pool; // Pool translating the regions, shared with the other files of a batch
+        std::uint64_t key_seed; // Seed the keys of every region are derived from
+        const TranslationCache* cache; // Looked up before translating a region, can be null
+        const PreviousBuild* previous; // The unchanged regions keep their code and offset from it, can be null
+        std::uint64_t memory_budget; // The regions are held back while the translation would go over it, unbounded when it's 0
 
         explicit BeginProcessContext(
             std::shared_ptr<PeFile> _pe_file,
             Win32::IMAGE_SECTION_HEADER _vm_section,
             Win32::IMAGE_SECTION_HEADER _vcode_section,
-            std::vector<std::pair<std::size_t, std::size_t>> _region_pairs
+            std::vector<std::pair<std::size_t, std::size_t>> _region_pairs,
+            ThreadPool& _pool,
+            std::uint64_t _key_seed,
+            const TranslationCache* _cache = nullptr,
+            const PreviousBuild* _previous = nullptr,
+            std::uint64_t _memory_budget = 0
         ) : 
         pe_file(_pe_file), vm_section(_vm_section), vcode_section(_vcode_section),
-        region_pairs(_region_pairs) 
+        region_pairs(_region_pairs), pool(_pool), key_seed(_key_seed), cache(_cache), previous(_previous),
+        memory_budget(_memory_budget) 
         {
 
         }
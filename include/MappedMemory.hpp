@@ -22,6 +22,13 @@ private:
 public:
     MappedMemory(std::shared_ptr<std::uint8_t[]>& buffer, std::uintmax_t size) : m_buffer(std::move(buffer)), m_size(size) {}
     static std::optional<MappedMemory> Allocate(std::uintmax_t buffer_size);
+
+    // Non owning view over memory owned by something else, nothing is reference counted
+    static MappedMemory View(std::uint8_t* data, std::uintmax_t size)
+    {
+        std::shared_ptr<std::uint8_t[]> view(std::shared_ptr<std::uint8_t[]>(), data);
+        return MappedMemory(view, size);
+    }
 public:
     // Gives access to the internal buffer
     [[nodiscard]] std::shared_ptr<std::uint8_t[]> InnerPtr() const { return m_buffer; }
@@ -9,44 +9,96 @@
 #include <vector>
 #include <memory>
 #include <string_view>
+#include <span>
+#include <atomic>
 
 #include <Win32.hpp>
 #include <result.h>
 #include <MappedMemory.hpp>
+#include <FileMapping.hpp>
+#include <ImageBuilder.hpp>
+#include <ImportIndex.hpp>
+#include <FunctionIndex.hpp>
 
 class PeFile
 {
 public:
     struct ImportedFunction { std::string name; std::uint32_t rva; };
+    struct SectionSpec { std::string name; std::uint32_t size; std::uint32_t characteristics{ 0x60000020 }; };
     enum class LoadOption{ LAZY_LOAD, FULL_LOAD };
+    enum class AccessMode{ STREAM, MEMORY_MAPPED };
+private:
+    // Range of virtual addresses covered by a section, used to translate rvas to raw addresses
+    struct SectionInterval { std::uint32_t virtual_address; std::uint32_t virtual_end; std::uint32_t raw_address; };
 private:
     std::uintmax_t m_file_size{ 0 };
+    std::filesystem::path m_path;
     std::fstream m_file_handle;
+    std::shared_ptr<FileMapping> m_mapping; // Only set when the file was loaded with AccessMode::MEMORY_MAPPED
     LoadOption m_load_option{ LoadOption::LAZY_LOAD };
+    AccessMode m_access_mode{ AccessMode::STREAM };
     Win32::Architecture m_arch{ Win32::Architecture::NOT_SUPPORTED };
     Win32::IMAGE_DOS_HEADER m_dos_header{ 0 };
     Win32::IMAGE_NT_HEADERS32 m_nt_headers32{ 0 };
     Win32::IMAGE_NT_HEADERS64 m_nt_headers64{ 0 };
     Win32::IMAGE_NT_HEADERS_HYBRID* nt_headers_hybrid{ nullptr };
+    std::vector<Win32::IMAGE_SECTION_HEADER> m_section_headers; // The section table, in the order of the file
     std::unordered_map<std::string, Win32::IMAGE_SECTION_HEADER> m_sections_map;
+    std::vector<SectionInterval> m_section_intervals; // Sorted by virtual address
+    mutable std::atomic<std::size_t> m_last_interval_hit{ 0 }; // Index of the interval that matched the last lookup
     std::unordered_map<std::string, std::vector<ImportedFunction>> m_imported_functions_map;
+    ImportIndex m_import_index; // (library, function) -> rva of the slot in the import address table
+    std::optional<FunctionIndex> m_function_index; // Boundaries from the exception directory, set once it's parsed
+    ImageBuilder m_image_builder; // Every modification is staged here until Commit is called, or written to its work image
 private:
     [[nodiscard]] Win32::Architecture GetArchitecture();
+    [[nodiscard]] std::uintmax_t NtHeadersSize() const;
+    [[nodiscard]] Result<bool, const char*> StageHeaders();
+    static Result<std::shared_ptr<PeFile>, const char*> Parse(std::shared_ptr<PeFile> pe);
 private:
+    [[nodiscard]] bool ReadAt(const std::uintmax_t offset, void* destination, const std::size_t size);
+    void IndexSection(const Win32::IMAGE_SECTION_HEADER& section);
     [[nodiscard]] std::uint32_t RvaToRaw(const std::uint32_t rva) const;
-    [[nodiscard]] bool MapImports(const std::string& dll_name, const std::uint32_t first_thunk_rva);
+    [[nodiscard]] std::optional<Win32::IMAGE_DATA_DIRECTORY> GetDataDirectory(const std::uint32_t index) const;
     [[nodiscard]] std::optional<Win32::IMAGE_DATA_DIRECTORY> GetImportDirectory() const;
     [[nodiscard]] bool LoadImports();
+    [[nodiscard]] bool LoadFunctions();
     [[nodiscard]] bool LoadSections();
     [[nodiscard]] bool ParseAndVerifyDosHeader();
     [[nodiscard]] bool ParseAndVerifyNtHeaders();
 public:
     [[nodiscard]] std::uint32_t GetEntryPoint() const;
+    [[nodiscard]] Win32::Architecture Architecture() const { return m_arch; }
+    [[nodiscard]] const std::vector<Win32::IMAGE_SECTION_HEADER>& GetSections() const { return m_section_headers; }
+    [[nodiscard]] std::uintmax_t ImageSize() const { return m_image_builder.ImageSize(); } // Size of the image once committed
+    [[nodiscard]] bool Streaming() const { return m_image_builder.Streaming(); } // Whether the modifications go to a work image
+    [[nodiscard]] Result<const FunctionIndex*, const char*> GetFunctions();
+    [[nodiscard]] Result<FunctionIndex, const char*> ScanFunctions() const;
+    [[nodiscard]] std::optional<std::uint32_t> FindImport(const std::string_view dll, const std::string_view function) const;
     Result<bool, const char*> WriteToRegionPos(const std::uint32_t rva, const MappedMemory& mapped_memory);
     [[nodiscard]] Result<bool, const char*> WriteToRegion(const std::uint32_t rva, const MappedMemory& mapped_memory);
+    [[nodiscard]] Result<bool, const char*> WriteToSection(
+        const Win32::IMAGE_SECTION_HEADER& section,
+        const std::uint32_t offset,
+        std::span<const std::uint8_t> data
+    );
     [[nodiscard]] Result<MappedMemory, const char*> LoadRegion(const std::uint32_t rva, const std::size_t region_size);
+    [[nodiscard]] Result<std::span<const std::uint8_t>, const char*> RegionView(const std::uint32_t rva, const std::size_t region_size) const;
     [[nodiscard]] std::optional<Win32::IMAGE_SECTION_HEADER> AddSection(const std::string_view& section_name, const std::uint32_t section_size);
-    static Result<std::shared_ptr<PeFile>, const char*> Load(const std::filesystem::path& p, const LoadOption& load_option);
+    [[nodiscard]] Result<std::vector<Win32::IMAGE_SECTION_HEADER>, const char*> PlanSections(const std::vector<SectionSpec>& specs) const;
+    [[nodiscard]] Result<std::vector<Win32::IMAGE_SECTION_HEADER>, const char*> AddSections(const std::vector<SectionSpec>& specs);
+    [[nodiscard]] Result<bool, const char*> StreamTo(const std::filesystem::path& work_path);
+    void DiscardRegion(const std::uint32_t rva, const std::size_t region_size);
+    [[nodiscard]] Result<bool, const char*> Commit();
+    [[nodiscard]] Result<bool, const char*> Commit(const std::filesystem::path& output_path);
+    [[nodiscard]] Result<bool, const char*> ExportDelta(const std::filesystem::path& delta_path);
+    [[nodiscard]] Result<bool, const char*> CommitTo(const ImageBuilder::Sink& sink);
+    static Result<std::shared_ptr<PeFile>, const char*> Load(
+        const std::filesystem::path& p,
+        const LoadOption& load_option,
+        const AccessMode& access_mode = AccessMode::STREAM
+    );
+    static Result<std::shared_ptr<PeFile>, const char*> Load(std::span<const std::uint8_t> image, const LoadOption& load_option);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,28 @@
+#ifndef INCLUDE_PROLOGUESCANNER_HPP_
+#define INCLUDE_PROLOGUESCANNER_HPP_
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <Win32.hpp>
+#include <FunctionIndex.hpp>
+
+/**
+ * @brief
+ * Finds the functions of an x64 image that has no usable exception directory.
+ * The code is first filtered 16 bytes at a time for the boundaries left by the compiler
+ * between two functions (a ret or alignment padding followed by code). Only the boundaries
+ * starting with a known prologue are decoded, up to their first ret or padding, to find
+ * where they end.
+ */
+namespace PrologueScanner
+{
+    [[nodiscard]] std::vector<FunctionIndex::Function> Scan(
+        std::span<const std::uint8_t> code,
+        const std::uint32_t code_rva,
+        const Win32::Architecture arch
+    );
+}
+
+#endif // INCLUDE_PROLOGUESCANNER_HPP_
@@ -0,0 +1,47 @@
+#ifndef INCLUDE_PROTECTIONSERVER_HPP_
+#define INCLUDE_PROTECTIONSERVER_HPP_
+
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include <JobManifest.hpp>
+#include <result.h>
+
+/**
+ * @brief
+ * Protects the files submitted over a local Unix domain socket, so the virtual machine,
+ * the thread pool and the cache are loaded once for all of the jobs instead of once per run.
+ *
+ * A connection submits one job, as a line of a batch manifest with absolute paths:
+ *
+ *     input output [rva size]...
+ *
+ * The server answers with a single line, "ok" once the file is protected or "error [message]".
+ * Every connection is handled on its own thread, the jobs run concurrently on the shared pool.
+ * The socket is only accessible to the user running the server.
+ */
+class ProtectionServer
+{
+public:
+    // Protects the file of a job, called concurrently from the threads of the connections
+    using Handler = std::function<Result<bool, const char*>(const JobManifest::Entry&)>;
+private:
+    int m_socket{ -1 };
+    std::filesystem::path m_path;
+private:
+    ProtectionServer(const int socket, std::filesystem::path path) : m_socket(socket), m_path(std::move(path)) {}
+public:
+    ProtectionServer(const ProtectionServer&) = delete;
+    ProtectionServer& operator=(const ProtectionServer&) = delete;
+    ~ProtectionServer();
+public:
+    [[nodiscard]] const std::filesystem::path& Path() const { return m_path; }
+    [[nodiscard]] Result<bool, const char*> Serve(const Handler& handler);
+public:
+    static Result<std::shared_ptr<ProtectionServer>, const char*> Listen(const std::filesystem::path& socket_path);
+    static Result<std::string, const char*> Submit(const std::filesystem::path& socket_path, const JobManifest::Entry& entry);
+};
+
+#endif // INCLUDE_PROTECTIONSERVER_HPP_
@@ -0,0 +1,80 @@
+#ifndef INCLUDE_PROTECTOR_HPP_
+#define INCLUDE_PROTECTOR_HPP_
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <Main.hpp>
+#include <MappedMemory.hpp>
+#include <PeFile.hpp>
+#include <RegionIndex.hpp>
+#include <RegionManifest.hpp>
+#include <ThreadPool.hpp>
+#include <TranslationCache.hpp>
+#include <Win32.hpp>
+#include <result.h>
+
+/**
+ * @brief
+ * Protection of an image already loaded in memory, whatever it was loaded from.
+ * The command line, the server and the shared library only differ by how they load
+ * the image and where they commit it.
+ */
+namespace Protector
+{
+    // The sections added to a protected image and where every region ended up
+    struct ProtectedImage
+    {
+        Win32::IMAGE_SECTION_HEADER vm_section; // The '.Ign1' section
+        Win32::IMAGE_SECTION_HEADER vcode_section; // The '.Ign2' section
+        std::uint32_t vm_size;
+        std::uint32_t vcode_size;
+        std::uint64_t vm_hash; // Hash of the virtual machine written to '.Ign1'
+        std::uint64_t key_seed; // The seed of the keys, the one of the previous build when its regions were kept
+        std::vector<mainspace::TranslatedRegion> regions; // In the order they were given
+    };
+
+    /**
+     * @brief
+     * Sorts the regions, checks them against the sections of the image and merges the adjacent ones that allow it
+     *
+     * @param entries The regions, in any order
+     * @param pe_file The image the regions are in
+     * @return Result<RegionIndex, const char*> The index or an error message
+     */
+    Result<RegionIndex, const char*> IndexRegions(const std::vector<RegionManifest::Entry>& entries, const PeFile& pe_file);
+
+    Result<std::vector<mainspace::TranslatedRegion>, const char*>
+    BeginTranslationProcess(const mainspace::BeginProcessContext& proc_context);
+
+    /**
+     * @brief
+     * Translates the regions and adds the sections of the virtual machine and of the translated code.
+     * Everything is staged in the image, nothing is written before the caller commits it.
+     *
+     * @param pe_file The image to protect
+     * @param region_pairs The (rva, size) of every region, already checked
+     * @param virtual_machine The virtual machine blob
+     * @param pool Pool translating the regions
+     * @param key_seed Seed the keys are derived from
+     * @param cache Cache of translated blocks, can be null
+     * @param previous A previous build to take the unchanged regions from, can be null.
+     * It's ignored when the sections don't end up at the same place
+     * @param memory_budget Bytes the translation can use at once, unbounded when it's 0. The file must be streamed with PeFile::StreamTo then
+     * @return Result<ProtectedImage, const char*> Where everything was placed or an error message
+     */
+    Result<ProtectedImage, const char*> ProtectRegions(
+        const std::shared_ptr<PeFile>& pe_file,
+        const std::vector<std::pair<std::size_t, std::size_t>>& region_pairs,
+        const MappedMemory& virtual_machine,
+        ThreadPool& pool,
+        std::uint64_t key_seed,
+        const TranslationCache* cache = nullptr,
+        const mainspace::PreviousBuild* previous = nullptr,
+        std::uint64_t memory_budget = 0
+    );
+}
+
+#endif // INCLUDE_PROTECTOR_HPP_
@@ -0,0 +1,53 @@
+#ifndef INCLUDE_REGIONINDEX_HPP_
+#define INCLUDE_REGIONINDEX_HPP_
+
+#include <cstdint>
+#include <cstddef>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <Win32.hpp>
+#include <RegionManifest.hpp>
+#include <result.h>
+
+/**
+ * @brief
+ * The regions to translate, sorted by their start address and validated against the sections of the image.
+ * Regions next to each other that both allow it are merged so they share a single entry in the
+ * virtual machine, the others keep their own entry. Overlapping regions are rejected instead of being
+ * translated twice.
+ */
+class RegionIndex
+{
+public:
+    // A region covers the rvas in [begin, end)
+    struct Region
+    {
+        std::uint32_t begin;
+        std::uint32_t end;
+        std::string name; // Name of the first region that was merged in it
+        bool merge; // Whether the next regions can be merged in it
+
+        [[nodiscard]] std::uint32_t Size() const { return end - begin; }
+    };
+private:
+    std::vector<Region> m_regions; // Sorted by begin, never overlapping
+public:
+    RegionIndex() = default;
+public:
+    [[nodiscard]] std::size_t Size() const { return m_regions.size(); }
+    [[nodiscard]] bool Empty() const { return m_regions.empty(); }
+    [[nodiscard]] const std::vector<Region>& Regions() const { return m_regions; }
+public:
+    [[nodiscard]] bool Overlaps(const std::uint32_t begin, const std::uint32_t end) const;
+    [[nodiscard]] std::vector<std::pair<std::size_t, std::size_t>> Pairs() const;
+public:
+    static Result<RegionIndex, const char*> Build(
+        std::vector<RegionManifest::Entry> entries,
+        std::span<const Win32::IMAGE_SECTION_HEADER> sections
+    );
+};
+
+#endif // INCLUDE_REGIONINDEX_HPP_
@@ -0,0 +1,40 @@
+#ifndef INCLUDE_REGIONMANIFEST_HPP_
+#define INCLUDE_REGIONMANIFEST_HPP_
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <result.h>
+
+namespace RegionManifest
+{
+    // A region to translate, as described by one line of the manifest
+    struct Entry
+    {
+        std::uint32_t rva;
+        std::uint32_t size;
+        std::string name; // Only used to report the region, can be empty
+        bool merge{ false }; // Whether the region can be merged with the regions next to it
+    };
+
+    /**
+     * @brief
+     * Loads a region manifest. Every line describes a region to translate:
+     *
+     *     rva size [key=value]...
+     *
+     * The rva and the size are in hexadecimal, like with --block. The options are
+     * 'name=<text>' to name the region and 'merge=yes' to let it share one entry with the
+     * adjacent regions that allow it too. A merged region is only entered at its start, so
+     * it's only meant for the pieces of a single function. Empty lines and lines starting with '#' are skipped.
+     * The whole file is read in one go, which keeps the loading fast with hundreds of thousands of lines.
+     *
+     * @param manifest_path Path of the manifest
+     * @return Result<std::vector<Entry>, const char*> The entries in the order of the file or an error message
+     */
+    Result<std::vector<Entry>, const char*> Load(const std::filesystem::path& manifest_path);
+}
+
+#endif // INCLUDE_REGIONMANIFEST_HPP_
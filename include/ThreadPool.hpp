@@ -0,0 +1,59 @@
+#ifndef INCLUDE_THREADPOOL_HPP_
+#define INCLUDE_THREADPOOL_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief
+ * Work stealing pool running every task of the process, whether it's a whole file or a single region.
+ * Each worker has its own queue. A task submitted from a worker goes to the queue of that worker,
+ * and a worker running out of tasks steals from the other queues. A file split in many regions
+ * is therefore spread over every idle worker instead of staying on the one that picked it.
+ *
+ * The threads waiting on tasks keep running the queued ones, which lets a task wait
+ * on the tasks it submitted without taking a worker away from the pool.
+ */
+class ThreadPool
+{
+public:
+    using Task = std::function<void()>;
+private:
+    // Owner pops from the back, thieves from the front
+    struct Queue { std::mutex mutex; std::deque<Task> tasks; };
+private:
+    // The queue at index 0 is shared by the threads not belonging to the pool
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<std::jthread> m_workers;
+    std::atomic<std::size_t> m_queued{ 0 }; // Tasks waiting in any of the queues
+    std::mutex m_wake_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_progress; // Notified when a task is queued or done, for the threads in RunUntil
+    bool m_stopping{ false };
+private:
+    [[nodiscard]] std::size_t QueueIndex() const;
+    [[nodiscard]] bool TryRunOne();
+    void WorkerLoop(const std::size_t queue_index);
+public:
+    explicit ThreadPool(const unsigned thread_count);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+public:
+    // Amount of threads running tasks, including the one waiting on them
+    [[nodiscard]] std::size_t Concurrency() const { return m_workers.size() + 1; }
+public:
+    void Submit(Task task);
+    void RunUntil(const std::function<bool()>& done);
+    void ParallelFor(const std::size_t count, const std::function<void(std::size_t)>& task);
+};
+
+#endif // INCLUDE_THREADPOOL_HPP_
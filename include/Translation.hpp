@@ -3,6 +3,8 @@
 
 // Std libraries
 #include <iostream>
+#include <algorithm>
+#include <cassert>
 #include <functional>
 #include <bit>
 #include <variant>
@@ -10,19 +12,24 @@
 #include <optional>
 #include <array>
 #include <memory>
+#include <vector>
 
 // Project libraries
 #include <Virtual.hpp>
 #include <Parameter.hpp>
 #include <MappedMemory.hpp>
+#include <TranslationArena.hpp>
+#include <BytecodeWriter.hpp>
+#include <DecodedRegion.hpp>
 #include <utl/Utl.hpp>
 #include <NativeEmitter/NativeEmitter.hpp>
 #include <TranslationContext.hpp>
+#include <Cryptography.hpp>
+#include <TranslationLog.hpp>
 
 // 3rd party Library
 #include <Zydis/Zydis.h>
 #include <result.h>
-#include <spdlog/spdlog.h>
 
 namespace Translation
 {
@@ -31,7 +38,52 @@ namespace Translation
     {
         OK, // Everything went perfectly fine
         INSTRUCTION_NOT_SUPPORTED, // The equivalent virtual instruction doesn't exist. A switch is needed
-        OUT_OF_MEMORY          // The mapped memory object ran out of space with it's internal buffer
+        OUT_OF_MEMORY          // The bytecode buffer could not grow
+    };
+
+    // Native instructions emitted after a switch to bring the execution back to the virtual machine
+    // [push encoded_vip] [push ret_relative] [jmp vm]
+    static constexpr std::uintmax_t REENTRY_STUB_SIZE = 15;
+
+    // Upper bound of the bytecode of a block relative to its native size. The buffer holding it can be
+    // bigger, see ArenaFootprint for the memory of a translation
+    static constexpr std::uintmax_t BUFFER_SIZE_FACTOR = 334;
+
+    // The bytecode buffer of a block starts this many times bigger than the native block and grows from there
+    static constexpr std::uintmax_t INITIAL_BUFFER_FACTOR = 16;
+
+    /**
+     * @brief
+     * Most memory the arena of a translation holds for a block, used to estimate it before the translation runs.
+     * The buffer doubles from INITIAL_BUFFER_FACTOR times the block until it holds BUFFER_SIZE_FACTOR times
+     * the block. It's alone in the arena, so only the buffer it grows out of is held with it, and the arena
+     * never hands out less than a chunk.
+     *
+     * @param native_size Size of the native block
+     */
+    constexpr std::uint64_t ArenaFootprint(const std::uint64_t native_size)
+    {
+        auto capacity = std::max<std::uint64_t>(native_size * INITIAL_BUFFER_FACTOR, 64);
+        while(capacity < native_size * BUFFER_SIZE_FACTOR) {
+            capacity *= 2;
+        }
+
+        return 2 * std::max<std::uint64_t>(capacity, TranslationArena::DEFAULT_CHUNK_SIZE);
+    }
+
+    // Must be bumped whenever the same native code gives a different translation, it invalidates the cached blocks
+    static constexpr std::uint32_t TRANSLATOR_VERSION = 1;
+
+    /**
+     * @brief
+     * The translated code of a block, before it's placed in the virtual code section.
+     * Every field depending on where the code ends up is left empty and recorded,
+     * which lets the blocks be translated independently and placed afterwards with RelocateBlock.
+     */
+    struct TranslatedBlock
+    {
+        BytecodeBuffer bytecode; // Lives in the arena of the translation, valid until the arena is reset
+        std::vector<std::uintmax_t> reentry_stubs; // Offsets of the re-entry stubs in the bytecode
     };
 
     static constexpr std::array<std::uint16_t, 16> register_map = 
@@ -67,42 +119,52 @@ namespace Translation
         return register_map[reg_index - 53];
     }
 
-    HOT_PATH FORCE_INLINE bool Ldr(const ZydisRegister &reg, MappedMemory &mapped_memory)
+    // Worst case sizes of the emitted sequences, a native instruction reserves its whole translation at once
+    static constexpr std::size_t LDR_SIZE = sizeof(Virtual::InstructionLength);
+    static constexpr std::size_t LDI_SIZE = sizeof(Virtual::InstructionLength) + sizeof(std::uint64_t);
+    static constexpr std::size_t UNROLL_MEMORY_SIZE = 4 * LDI_SIZE + 3 * sizeof(Virtual::InstructionLength);
+    static constexpr std::size_t LDM_SIZE = UNROLL_MEMORY_SIZE + sizeof(Virtual::InstructionLength);
+    static constexpr std::size_t SVM_SIZE = UNROLL_MEMORY_SIZE + sizeof(Virtual::InstructionLength);
+    static constexpr std::size_t LOAD_OPERAND_SIZE = std::max({ LDR_SIZE, LDI_SIZE, LDM_SIZE });
+    static constexpr std::size_t SAVE_OPERAND_SIZE = std::max(LDR_SIZE, SVM_SIZE);
+
+    // Two loaded operands, the operation and the save of the result
+    static constexpr std::size_t BINARY_OPERATION_SIZE = 2 * LOAD_OPERAND_SIZE + sizeof(Virtual::InstructionLength) + SAVE_OPERAND_SIZE;
+    static constexpr std::size_t MOV_SIZE = LOAD_OPERAND_SIZE + SAVE_OPERAND_SIZE;
+
+    HOT_PATH FORCE_INLINE void Ldr(const ZydisRegister &reg, BytecodeWriter &writer)
     {
-        spdlog::info("Emitting -> LDR");
+        IGNOTUM_TRANSLATION_TRACE("Emitting -> LDR");
         const auto vm_reg_index = GetRegisterIndex(reg);
         const auto inst = Virtual::Instruction(Virtual::Parameter(vm_reg_index), Virtual::Command::kLdr);
 
-        return mapped_memory.Write<Virtual::InstructionLength>(inst.AssembleInstruction());
+        writer.Emit<Virtual::InstructionLength>(inst.AssembleInstruction());
     }
 
-    HOT_PATH FORCE_INLINE bool Ldi(const ZydisDecodedOperandImm &imm, MappedMemory &mapped_memory)
+    HOT_PATH FORCE_INLINE void Ldi(const OperandSummary &imm, BytecodeWriter &writer)
     {
-        spdlog::info("Emitting -> LDI");
+        IGNOTUM_TRANSLATION_TRACE("Emitting -> LDI");
         // Construct the instruction and write it to the memory
         const auto inst = Virtual::Instruction(Parameter(Parameter::kNone), Virtual::Command::kLdImm);
-
-        if(!mapped_memory.Write<Virtual::InstructionLength>(inst.AssembleInstruction()))
-            return false;
+        writer.Emit<Virtual::InstructionLength>(inst.AssembleInstruction());
 
         // assert(!imm.is_signed && "Signed value not supported in Ldm");
 
-        auto unsigned_imm = imm.value.u;
+        auto unsigned_imm = static_cast<std::uint64_t>(imm.value);
         // Write the immediate in the mapped memory
-        return mapped_memory.Write<decltype(unsigned_imm)>(unsigned_imm);
+        writer.Emit<decltype(unsigned_imm)>(unsigned_imm);
     }
 
-    HOT_PATH FORCE_INLINE bool Ldi(const std::uint64_t &imm, MappedMemory &mapped_memory)
+    HOT_PATH FORCE_INLINE void Ldi(const std::uint64_t &imm, BytecodeWriter &writer)
     {
-        spdlog::info("Emitting -> LDI");
+        IGNOTUM_TRANSLATION_TRACE("Emitting -> LDI");
         // Construct the instruction and write it to the memory
         const auto inst = Virtual::Instruction(Parameter(Parameter::kNone), Virtual::Command::kLdImm);
-        if(!mapped_memory.Write<Virtual::InstructionLength>(inst.AssembleInstruction()))
-            return false;
+        writer.Emit<Virtual::InstructionLength>(inst.AssembleInstruction());
 
         auto unsigned_imm = imm;
         // Write the immediate in the mapped memory
-        return mapped_memory.Write<decltype(unsigned_imm)>(unsigned_imm);
+        writer.Emit<decltype(unsigned_imm)>(unsigned_imm);
     }
 
     /**
@@ -114,133 +176,109 @@ namespace Translation
      * This function would push the value of eax and 1000 on the virtual stack and add them together.
      * It would then push ecx and 4 on the stack and multiply them together.
      * It would then add those two results together before executing the instruction that would access that memory region.
+     * Emits at most UNROLL_MEMORY_SIZE bytes.
      *
      * @param operand The operand to be handled by the function
-     * @param mapped_memory
-     * Mapped memory which will receive the virtual instructions
+     * @param writer
+     * Writer which will receive the virtual instructions
      * @return HOT_PATH
      */
-    HOT_PATH FORCE_INLINE bool UnrollMemoryAddressing(const ZydisDecodedOperandMem &mem, MappedMemory &mapped_memory)
+    HOT_PATH FORCE_INLINE void UnrollMemoryAddressing(const OperandSummary &mem, BytecodeWriter &writer)
     {
-        spdlog::info("Starting memory unrolling sequence.");
+        IGNOTUM_TRANSLATION_TRACE("Starting memory unrolling sequence.");
         // Load the content of the base register on the stack
         // If the operation doesn't use a base, just load 0
-        if (mem.base != ZYDIS_REGISTER_NONE)
-        {
-            if(!Ldr(mem.base, mapped_memory))
-                return false;
+        if (mem.Register() != ZYDIS_REGISTER_NONE) {
+            Ldr(mem.Register(), writer);
         }
-        else
-        {
-            if(!Ldi(0, mapped_memory))
-                return false;
+        else {
+            Ldi(0, writer);
         }
 
         // Load the content of the base register on the stack
         // If the operation doesn't use a base, just load 0
-        if (mem.disp.has_displacement)
-        {
-            if(!Ldi(mem.disp.value, mapped_memory))
-                return false;
+        if (mem.has_displacement) {
+            Ldi(static_cast<std::uint64_t>(mem.value), writer);
         }
-        else
-        {
-            if(!Ldi(0, mapped_memory))
-                return false;
+        else {
+            Ldi(0, writer);
         }
 
-        spdlog::info("Emitting -> kVADD");
+        IGNOTUM_TRANSLATION_TRACE("Emitting -> kVADD");
         // Generate the virtual instruction to add both values together
         const auto add_inst = Virtual::Instruction(Parameter(Parameter::kNone), Virtual::Command::kVAdd);
-        if(!mapped_memory.Write<Virtual::InstructionLength>(add_inst.AssembleInstruction()))
-            return false;
+        writer.Emit<Virtual::InstructionLength>(add_inst.AssembleInstruction());
 
         // Load the content of the index register on the stack
         // If the operation doesn't use a index, just load 0
-        if (mem.index != ZYDIS_REGISTER_NONE)
-        {
-            if(!Ldr(mem.index, mapped_memory))
-                return false;
+        if (mem.Index() != ZYDIS_REGISTER_NONE) {
+            Ldr(mem.Index(), writer);
         }
-        else
-        {
-            if(!Ldi(0, mapped_memory))
-                return false;
+        else {
+            Ldi(0, writer);
         }
 
         if (mem.scale != 0)
         {
-            if(!Ldi(mem.scale, mapped_memory))
-                return false;
+            Ldi(mem.scale, writer);
 
-            spdlog::info("Emitting -> kVMUL");
+            IGNOTUM_TRANSLATION_TRACE("Emitting -> kVMUL");
             const auto inst = Virtual::Instruction(Parameter(Parameter::kNone), Virtual::Command::kVMul);
-            
-            if(!mapped_memory.Write<Virtual::InstructionLength>(inst.AssembleInstruction()))
-                return false;
+            writer.Emit<Virtual::InstructionLength>(inst.AssembleInstruction());
         }
         else
         {
-            if(!Ldi(0, mapped_memory))
-                return false;
+            Ldi(0, writer);
 
-            spdlog::info("Emitting -> kVADD");
+            IGNOTUM_TRANSLATION_TRACE("Emitting -> kVADD");
             const auto inst = Virtual::Instruction(Parameter(Parameter::kNone), Virtual::Command::kVAdd);
-            
-            if(!mapped_memory.Write<Virtual::InstructionLength>(inst.AssembleInstruction()))
-                return false;
+            writer.Emit<Virtual::InstructionLength>(inst.AssembleInstruction());
         }
 
-        spdlog::info("Emitting -> kVADD");
-        
-        if(!mapped_memory.Write<Virtual::InstructionLength>(add_inst.AssembleInstruction()))
-            return false;
-
-        spdlog::info("Memory unrolling sequence done.");
+        IGNOTUM_TRANSLATION_TRACE("Emitting -> kVADD");
+        writer.Emit<Virtual::InstructionLength>(add_inst.AssembleInstruction());
 
-        return true;
+        IGNOTUM_TRANSLATION_TRACE("Memory unrolling sequence done.");
     }
 
-    HOT_PATH FORCE_INLINE bool Svr(const ZydisRegister &reg, MappedMemory &mapped_memory)
+    HOT_PATH FORCE_INLINE void Svr(const ZydisRegister &reg, BytecodeWriter &writer)
     {
-        spdlog::info("Emitting -> SVR");
+        IGNOTUM_TRANSLATION_TRACE("Emitting -> SVR");
         const auto vm_reg_index = GetRegisterIndex(reg);
         const auto inst = Virtual::Instruction(Virtual::Parameter(vm_reg_index), Virtual::Command::kVSvr);
-        
-        return mapped_memory.Write<Virtual::InstructionLength>(inst.AssembleInstruction());
+
+        writer.Emit<Virtual::InstructionLength>(inst.AssembleInstruction());
     }
 
-    HOT_PATH FORCE_INLINE bool Svm(const ZydisDecodedOperandMem& mem, MappedMemory &mapped_memory)
+    HOT_PATH FORCE_INLINE void Svm(const OperandSummary& mem, BytecodeWriter &writer)
     {
-        if(!UnrollMemoryAddressing(mem, mapped_memory))
-            return false;
+        UnrollMemoryAddressing(mem, writer);
 
-        spdlog::info("Emitting -> SVM");
+        IGNOTUM_TRANSLATION_TRACE("Emitting -> SVM");
         const auto inst = Virtual::Instruction(Virtual::Parameter(Parameter::kNone), Virtual::Command::kVSvm);
-        
-        return mapped_memory.Write<Virtual::InstructionLength>(inst.AssembleInstruction());
+
+        writer.Emit<Virtual::InstructionLength>(inst.AssembleInstruction());
     }
 
-    HOT_PATH FORCE_INLINE bool Ldm(const ZydisDecodedOperandMem &mem, MappedMemory &mapped_memory)
+    HOT_PATH FORCE_INLINE void Ldm(const OperandSummary &mem, BytecodeWriter &writer)
     {
         // Unroll the memory addressing and place the value on the stack
-        if(!UnrollMemoryAddressing(mem, mapped_memory))
-            return false;
+        UnrollMemoryAddressing(mem, writer);
 
-        spdlog::info("Emitting -> LDM");
+        IGNOTUM_TRANSLATION_TRACE("Emitting -> LDM");
 
         // Load the data specified at the unrolled memory addressing
         auto inst = Virtual::Instruction(Parameter(Parameter::kNone), Virtual::Command::kLdm);
-        return mapped_memory.Write<Virtual::InstructionLength>(inst.AssembleInstruction());
+        writer.Emit<Virtual::InstructionLength>(inst.AssembleInstruction());
     }
 
-    HOT_PATH FORCE_INLINE bool Ldm(MappedMemory &mapped_memory)
+    HOT_PATH FORCE_INLINE void Ldm(BytecodeWriter &writer)
     {
-        spdlog::info("Emitting -> LDM");
+        IGNOTUM_TRANSLATION_TRACE("Emitting -> LDM");
         // Load the data specified at the unrolled memory addressing
         auto inst = Virtual::Instruction(Parameter(Parameter::kNone), Virtual::Command::kLdm);
-        
-        return mapped_memory.Write<Virtual::InstructionLength>(inst.AssembleInstruction());
+
+        writer.Emit<Virtual::InstructionLength>(inst.AssembleInstruction());
     }
 
     /**
@@ -249,188 +287,254 @@ namespace Translation
      * will handle the logic of generating the proper virtual instructions
      *
      * @param operand The operand to be handled by the function
-     * @param mapped_memory
-     * Mapped memory which will receive the virtual instructions
+     * @param writer
+     * Writer which will receive the virtual instructions
      * @return HOT_PATH
      */
-    HOT_PATH FORCE_INLINE bool HandleLoadGenericOperands(
-        const ZydisDecodedOperand operands[ZYDIS_MAX_OPERAND_COUNT_VISIBLE],
-        MappedMemory &mapped_memory)
+    HOT_PATH FORCE_INLINE void HandleLoadGenericOperands(
+        const OperandSummary operands[DecodedRegion::OPERANDS_PER_INSTRUCTION],
+        BytecodeWriter &writer)
     {
         const auto first_operand = operands[0];
-        switch (first_operand.type)
+        switch (first_operand.Type())
         {
         case ZydisOperandType::ZYDIS_OPERAND_TYPE_REGISTER:
-            if(!Ldr(first_operand.reg.value, mapped_memory))
-                return false;
+            Ldr(first_operand.Register(), writer);
             break;
         case ZydisOperandType::ZYDIS_OPERAND_TYPE_MEMORY:
-            if(!Ldm(first_operand.mem, mapped_memory))
-                return false;
+            Ldm(first_operand, writer);
             break;
         case ZydisOperandType::ZYDIS_OPERAND_TYPE_POINTER:
-            // if(!LdPtr(operands[0].ptr.segment, mapped_memory))
-                // return false;
+            // LdPtr(operands[0].ptr.segment, writer);
             break;
         default:
-            return true;
-            break;
+            return;
         }
 
         const auto second_operand = operands[1];
-        switch (second_operand.type)
+        switch (second_operand.Type())
         {
         case ZydisOperandType::ZYDIS_OPERAND_TYPE_REGISTER:
-            return Ldr(first_operand.reg.value, mapped_memory);
+            Ldr(first_operand.Register(), writer);
             break;
         case ZydisOperandType::ZYDIS_OPERAND_TYPE_MEMORY:
-            return Ldm(first_operand.mem, mapped_memory);
+            Ldm(first_operand, writer);
             break;
         case ZydisOperandType::ZYDIS_OPERAND_TYPE_IMMEDIATE:
-            return Ldi(second_operand.imm, mapped_memory);
+            Ldi(second_operand, writer);
             break;
         default:
-            return true;
             break;
         }
     }
 
-    HOT_PATH FORCE_INLINE bool HandleLoadSourceOperand(
-        const ZydisDecodedOperand& source_operand,
-        MappedMemory &mapped_memory)
+    HOT_PATH FORCE_INLINE void HandleLoadSourceOperand(
+        const OperandSummary& source_operand,
+        BytecodeWriter &writer)
     {
-        switch (source_operand.type)
+        switch (source_operand.Type())
         {
         case ZydisOperandType::ZYDIS_OPERAND_TYPE_REGISTER:
-            return Ldr(source_operand.reg.value, mapped_memory);
+            Ldr(source_operand.Register(), writer);
             break;
         case ZydisOperandType::ZYDIS_OPERAND_TYPE_MEMORY:
-            return Ldm(source_operand.mem, mapped_memory);
+            Ldm(source_operand, writer);
             break;
         case ZydisOperandType::ZYDIS_OPERAND_TYPE_IMMEDIATE:
-            return Ldi(source_operand.imm, mapped_memory);
+            Ldi(source_operand, writer);
             break;
         default:
-            return true;
             break;
         }
     }
 
-    HOT_PATH FORCE_INLINE bool HandleSaveGeneric(
-        const ZydisDecodedOperand &operand,
-        MappedMemory &mapped_memory)
+    HOT_PATH FORCE_INLINE void HandleSaveGeneric(
+        const OperandSummary &operand,
+        BytecodeWriter &writer)
     {
-        switch (operand.type)
+        switch (operand.Type())
         {
         case ZydisOperandType::ZYDIS_OPERAND_TYPE_REGISTER:
-            return Svr(operand.reg.value, mapped_memory);
+            Svr(operand.Register(), writer);
             break;
         case ZydisOperandType::ZYDIS_OPERAND_TYPE_MEMORY:
-            return Svm(operand.mem, mapped_memory);
-            // Ldm(operand.mem, mapped_memory);
+            Svm(operand, writer);
+            // Ldm(operand, writer);
             break;
         case ZydisOperandType::ZYDIS_OPERAND_TYPE_POINTER:
-            // return LdPtr(operands[0].ptr.segment, mapped_memory)
+            // LdPtr(operands[0].ptr.segment, writer)
             break;
         default:
-            return true;
             break;
         }
-
-        return true;
     }
 
-    HOT_PATH FORCE_INLINE bool SubInstLogic(
-        const ZydisDecodedOperand operands[ZYDIS_MAX_OPERAND_COUNT_VISIBLE],
-        MappedMemory &mapped_memory)
+    HOT_PATH FORCE_INLINE void SubInstLogic(
+        const OperandSummary operands[DecodedRegion::OPERANDS_PER_INSTRUCTION],
+        BytecodeWriter &writer,
+        [[maybe_unused]] const Translation::Context& context)
     {
-        if(!HandleLoadGenericOperands(operands, mapped_memory))
-            return false;
+        HandleLoadGenericOperands(operands, writer);
 
-        spdlog::info("Emitting -> kVSUB");
+        IGNOTUM_TRANSLATION_TRACE("Emitting -> kVSUB");
         const auto inst = Virtual::Instruction(Parameter(Parameter::kNone), Virtual::Command::kVSub);
-        
-        if(!mapped_memory.Write<Virtual::InstructionLength>(inst.AssembleInstruction()))
-            return false;
+        writer.Emit<Virtual::InstructionLength>(inst.AssembleInstruction());
 
-        return HandleSaveGeneric(operands[0], mapped_memory);
+        HandleSaveGeneric(operands[0], writer);
     }
 
-    HOT_PATH FORCE_INLINE bool AddInstLogic(
-        const ZydisDecodedOperand operands[ZYDIS_MAX_OPERAND_COUNT_VISIBLE],
-        MappedMemory &mapped_memory)
+    HOT_PATH FORCE_INLINE void AddInstLogic(
+        const OperandSummary operands[DecodedRegion::OPERANDS_PER_INSTRUCTION],
+        BytecodeWriter &writer,
+        [[maybe_unused]] const Translation::Context& context)
     {
-        if(!HandleLoadGenericOperands(operands, mapped_memory))
-            return false;
+        HandleLoadGenericOperands(operands, writer);
 
-        spdlog::info("Emitting -> kVADD");
+        IGNOTUM_TRANSLATION_TRACE("Emitting -> kVADD");
         const auto inst = Virtual::Instruction(Parameter(Parameter::kNone), Virtual::Command::kVAdd);
-        
-        if(!mapped_memory.Write<Virtual::InstructionLength>(inst.AssembleInstruction()))
-            return false;
-        
-        return HandleSaveGeneric(operands[0], mapped_memory);
+        writer.Emit<Virtual::InstructionLength>(inst.AssembleInstruction());
+
+        HandleSaveGeneric(operands[0], writer);
     }
 
-    HOT_PATH FORCE_INLINE bool MovInstLogic(
-        const ZydisDecodedOperand operands[ZYDIS_MAX_OPERAND_COUNT_VISIBLE],
-        MappedMemory &mapped_memory)
+    HOT_PATH FORCE_INLINE void MovInstLogic(
+        const OperandSummary operands[DecodedRegion::OPERANDS_PER_INSTRUCTION],
+        BytecodeWriter &writer,
+        [[maybe_unused]] const Translation::Context& context)
     {
-        if(!HandleLoadSourceOperand(operands[1], mapped_memory))
-            return false;
-
-        return HandleSaveGeneric(operands[0], mapped_memory);
+        HandleLoadSourceOperand(operands[1], writer);
+        HandleSaveGeneric(operands[0], writer);
     }
 
-    HOT_PATH FORCE_INLINE bool CallInstLogic(
-        const ZydisDecodedOperand operands[ZYDIS_MAX_OPERAND_COUNT_VISIBLE],
-        MappedMemory &mapped_memory,
-        const Translation::Context& context
+    HOT_PATH FORCE_INLINE void CallInstLogic(
+        const OperandSummary operands[DecodedRegion::OPERANDS_PER_INSTRUCTION],
+        [[maybe_unused]] BytecodeWriter &writer,
+        [[maybe_unused]] const Translation::Context& context
     )
     {
-        assert( !(operands[0].type != ZydisOperandType::ZYDIS_OPERAND_TYPE_IMMEDIATE) && "Invalid call type");
+        assert( !(operands[0].Type() != ZydisOperandType::ZYDIS_OPERAND_TYPE_IMMEDIATE) && "Invalid call type");
 
         // Get the relative value of where this will call
-        const auto call_relative_imm = operands[0].imm.value.s;
-        std::cout << std::hex << call_relative_imm << "\n";
+        const auto call_relative_imm = operands[0].value;
+        IGNOTUM_TRANSLATION_DEBUG("Call relative to 0x{:X}", call_relative_imm);
+    }
+
+    /**
+     * @brief
+     * How a native instruction is translated. A mnemonic without an emit function has no
+     * virtual equivalent and goes through a switch to native mode.
+     */
+    struct InstructionHandler
+    {
+        // Whether this form of the instruction is supported, the operands of a mnemonic aren't always
+        using SupportedPredicate = bool(*)(const OperandSummary* operands, const std::uint8_t operand_count);
+        using EmitFunction = void(*)(
+            const OperandSummary operands[DecodedRegion::OPERANDS_PER_INSTRUCTION],
+            BytecodeWriter& writer,
+            const Translation::Context& context
+        );
+
+        SupportedPredicate supported{ nullptr };
+        EmitFunction emit{ nullptr };
+        std::size_t max_size{ 0 }; // Worst case size of the emitted bytecode, reserved before emitting
+    };
+
+    constexpr bool AlwaysSupported(const OperandSummary*, const std::uint8_t)
+    {
         return true;
     }
 
+    constexpr bool CallSupported(const OperandSummary* operands, const std::uint8_t)
+    {
+        return operands[0].Type() == ZydisOperandType::ZYDIS_OPERAND_TYPE_IMMEDIATE;
+    }
+
+    using InstructionHandlerTable = std::array<InstructionHandler, ZYDIS_MNEMONIC_MAX_VALUE + 1>;
+
+    /**
+     * @brief
+     * Builds the table of the handlers, indexed by mnemonic. A new instruction is supported
+     * by registering its handler here, the translation and the probing only look the table up.
+     */
+    consteval InstructionHandlerTable MakeInstructionHandlers()
+    {
+        InstructionHandlerTable handlers{};
+
+        handlers[ZYDIS_MNEMONIC_SUB] = { AlwaysSupported, SubInstLogic, BINARY_OPERATION_SIZE };
+        handlers[ZYDIS_MNEMONIC_ADD] = { AlwaysSupported, AddInstLogic, BINARY_OPERATION_SIZE };
+        handlers[ZYDIS_MNEMONIC_MOV] = { AlwaysSupported, MovInstLogic, MOV_SIZE };
+        handlers[ZYDIS_MNEMONIC_CALL] = { CallSupported, CallInstLogic, 0 };
+
+        return handlers;
+    }
+
+    inline constexpr InstructionHandlerTable INSTRUCTION_HANDLERS = MakeInstructionHandlers();
+
     /**
      * @brief
      * Given a x86_64 instruction, it will translate it to the proper virtal instruction.
      *
-     * @param instruction The native instruction to be translated
-     * @param operands The operands that are within the given instruction
-     * @param mapped_memory
-     * Mapped memory which will be used to write the virtual instruction to.
+     * @param mnemonic The mnemonic of the native instruction to be translated
+     * @param operands The summarized operands of the instruction
+     * @param operand_count The amount of visible operands of the instruction
+     * @param bytecode
+     * Buffer which will be used to write the virtual instruction to.
+     * The whole translation is reserved at once, running out of memory is only checked there
      * @return Result<bool, TranslationError>
      * The Ok value can be ignored. For the error, see above for the enum definition.
      */
     HOT_PATH FORCE_INLINE Translation::RetResult TranslateInstruction(
-        const ZydisDecodedInstruction &instruction,
-        const ZydisDecodedOperand operands[ZYDIS_MAX_OPERAND_COUNT_VISIBLE],
-        MappedMemory &mapped_memory,
+        const ZydisMnemonic mnemonic,
+        const OperandSummary operands[DecodedRegion::OPERANDS_PER_INSTRUCTION],
+        const std::uint8_t operand_count,
+        BytecodeBuffer &bytecode,
         const Translation::Context& context,
         bool is_probing
     );
 
     /**
      * @brief
-     * Given a buffer containing x86_64 instructions, it will go over the buffer and disassemble the instructions.
+     * Given a buffer containing x86_64 instructions and their decoded form, it will go over the instructions.
      * It will then call routines to translate these instructions to the virtual architecture.
+     * The result doesn't depend on context.vcode_block_rva, the block must be placed with RelocateBlock.
      *
      * @param instruction_block
      * The mapped memory block which contains x86_64 instructions
-     * @return MappedMemory
-     * A mapped memory object containing all of the translated instructions
+     * @param decoded
+     * The instructions of the block, decoded with DecodedRegion::Decode
+     * @param arena
+     * Arena the bytecode is allocated from, the block is only valid until it's reset
+     * @return TranslatedBlock
+     * The translated instructions and the fields left to be relocated
      */
-    HOT_PATH std::optional<MappedMemory>
+    HOT_PATH std::optional<TranslatedBlock>
     TranslateInstructionBlock(
         const MappedMemory &instruction_block,
+        const DecodedRegion& decoded,
+        TranslationArena& arena,
         const std::shared_ptr<NativeEmitter> native_emitter,
         const Translation::Context& context
     );
+
+    /**
+     * @brief
+     * Fills the fields of a translated block which depend on its location, once
+     * context.vcode_block_rva is known. A key is drawn from the stream of the region for every
+     * re-entry stub, in the order of the stubs.
+     *
+     * @param block The block returned by TranslateInstructionBlock
+     * @param native_emitter Emitter used to rewrite the re-entry stubs
+     * @param context The context of the block with its final vcode_block_rva
+     * @param keys The keys of the region the block was translated from
+     * @return true The block was relocated
+     * @return false A stub is outside of the bytecode
+     */
+    bool RelocateBlock(
+        TranslatedBlock& block,
+        const std::shared_ptr<NativeEmitter> native_emitter,
+        const Translation::Context& context,
+        cryptography::KeyStream& keys
+    );
 }
 
 #endif
\ No newline at end of file
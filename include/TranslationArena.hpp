@@ -0,0 +1,138 @@
+#ifndef INCLUDE_TRANSLATIONARENA_HPP_
+#define INCLUDE_TRANSLATIONARENA_HPP_
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <vector>
+
+/**
+ * @brief
+ * Bump allocator backing the translation of the regions. The memory is handed out from chunks
+ * which are never zeroed. Reset makes the memory available again for the next region and trims it
+ * to what the last region had live at once: the chunks of a region which needed several of them are
+ * coalesced into one chunk of that size, and a chunk more than twice as big as the region is released.
+ * A block growing alone in its chunk takes a bigger chunk and frees the old one, so a translation
+ * writing a single buffer holds at most its buffer and the one it grows out of.
+ * Regions of a similar size are therefore translated without allocating anything, while the arena
+ * doesn't keep the memory of its biggest region forever.
+ *
+ * Everything handed out is invalidated by Reset. An arena is used by one thread at a time.
+ */
+class TranslationArena
+{
+private:
+    struct Chunk
+    {
+        std::unique_ptr<std::uint8_t[]> data;
+        std::size_t size;
+    };
+private:
+    std::vector<Chunk> m_chunks;
+    std::size_t m_chunk_size;
+    std::size_t m_chunk_index{ 0 }; // Chunk the next allocation is taken from
+    std::size_t m_offset{ 0 }; // Bytes used in that chunk
+    std::uint8_t* m_last{ nullptr }; // The last allocation, the only one which can grow in place
+    std::size_t m_next_chunk_size; // Size of the first chunk allocated once the chunks were released
+    std::size_t m_live{ 0 }; // Bytes of the blocks still in use, the ones left behind by a move aren't
+    std::size_t m_peak_live{ 0 }; // Most bytes in use at once since the last Reset
+private:
+    void AddLive(const std::size_t size);
+public:
+    static constexpr std::size_t DEFAULT_CHUNK_SIZE = 0x10000;
+
+    explicit TranslationArena(const std::size_t chunk_size = DEFAULT_CHUNK_SIZE) : m_chunk_size(chunk_size), m_next_chunk_size(chunk_size) {}
+
+    TranslationArena(const TranslationArena&) = delete;
+    TranslationArena& operator=(const TranslationArena&) = delete;
+public:
+    // Bytes held by the arena, used or not
+    [[nodiscard]] std::size_t Capacity() const;
+public:
+    [[nodiscard]] std::uint8_t* Allocate(const std::size_t size);
+    [[nodiscard]] std::uint8_t* Grow(std::uint8_t* block, const std::size_t size, const std::size_t capacity, const std::size_t new_size);
+    void Reset();
+    void Release();
+};
+
+/**
+ * @brief
+ * Growable buffer receiving the bytecode of a block, allocated from a TranslationArena.
+ * It starts from an estimate of the translated size and doubles when it runs out of space,
+ * which makes the memory used by a translation follow its output rather than its input.
+ * A write only fails when the arena can't get more memory.
+ */
+class BytecodeBuffer
+{
+private:
+    TranslationArena* m_arena{ nullptr };
+    std::uint8_t* m_data{ nullptr };
+    std::size_t m_size{ 0 };
+    std::size_t m_capacity{ 0 };
+private:
+    [[nodiscard]] bool GrowFor(const std::size_t additional);
+public:
+    BytecodeBuffer(TranslationArena& arena, const std::size_t initial_capacity);
+
+    BytecodeBuffer(BytecodeBuffer&& other) noexcept;
+    BytecodeBuffer& operator=(BytecodeBuffer&& other) noexcept;
+    BytecodeBuffer(const BytecodeBuffer&) = delete;
+    BytecodeBuffer& operator=(const BytecodeBuffer&) = delete;
+public:
+    [[nodiscard]] std::uint8_t* Data() const { return m_data; }
+    [[nodiscard]] std::size_t Size() const { return m_size; }
+    [[nodiscard]] std::size_t Capacity() const { return m_capacity; }
+    [[nodiscard]] std::span<std::uint8_t> Span() { return { m_data, m_size }; }
+    [[nodiscard]] std::span<const std::uint8_t> Span() const { return { m_data, m_size }; }
+
+    // Free space after the last byte, writable up to what the last Reserve asked for
+    [[nodiscard]] std::uint8_t* End() const { return m_data + m_size; }
+
+    // Counts the bytes written at End() after a Reserve
+    void Commit(const std::size_t size) { m_size += size; }
+public:
+    // Makes sure the next 'additional' bytes can be written without growing
+    [[nodiscard]] bool Reserve(const std::size_t additional)
+    {
+        return m_capacity - m_size >= additional || GrowFor(additional);
+    }
+
+    // Extends the buffer by 'size' bytes left uninitialized, nullptr if it could not grow
+    [[nodiscard]] std::uint8_t* Append(const std::size_t size)
+    {
+        if(!Reserve(size)) {
+            return nullptr;
+        }
+
+        auto* appended = m_data + m_size;
+        m_size += size;
+        return appended;
+    }
+
+    template<class T>
+    [[nodiscard]] bool Write(const T value)
+    {
+        auto* destination = Append(sizeof(value));
+        if(!destination) {
+            return false;
+        }
+
+        std::memcpy(destination, &value, sizeof(value));
+        return true;
+    }
+
+    [[nodiscard]] bool Write(const std::uint8_t* source, const std::size_t size)
+    {
+        auto* destination = Append(size);
+        if(!destination) {
+            return false;
+        }
+
+        std::memcpy(destination, source, size);
+        return true;
+    }
+};
+
+#endif // INCLUDE_TRANSLATIONARENA_HPP_
@@ -0,0 +1,46 @@
+#ifndef INCLUDE_TRANSLATIONCACHE_HPP_
+#define INCLUDE_TRANSLATIONCACHE_HPP_
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+
+#include <Translation.hpp>
+#include <TranslationArena.hpp>
+#include <result.h>
+
+/**
+ * @brief
+ * On-disk cache of translated blocks, shared between runs.
+ * A block is stored before it's relocated, so a hit only skips the translation and the
+ * block still goes through RelocateBlock like a freshly translated one.
+ *
+ * Every entry is a file named after the hash of its key: the native bytes and the translator version.
+ * The rvas of the block are left out since RelocateBlock fills every field depending on them. The native bytes are stored in the entry
+ * as well and compared on every hit, so a hash collision is a miss instead of wrong code.
+ * Entries are written to a temporary file and renamed, several processes can share the directory.
+ */
+class TranslationCache
+{
+private:
+    std::filesystem::path m_directory;
+private:
+    explicit TranslationCache(std::filesystem::path directory) : m_directory(std::move(directory)) {}
+    [[nodiscard]] std::filesystem::path EntryPath(std::span<const std::uint8_t> native_code) const;
+public:
+    [[nodiscard]] const std::filesystem::path& Directory() const { return m_directory; }
+public:
+    [[nodiscard]] std::optional<Translation::TranslatedBlock> Load(
+        std::span<const std::uint8_t> native_code,
+        TranslationArena& arena
+    ) const;
+    [[nodiscard]] bool Store(
+        std::span<const std::uint8_t> native_code,
+        const Translation::TranslatedBlock& block
+    ) const;
+public:
+    static Result<TranslationCache, const char*> Open(const std::filesystem::path& directory);
+};
+
+#endif // INCLUDE_TRANSLATIONCACHE_HPP_
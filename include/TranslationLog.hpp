@@ -0,0 +1,73 @@
+#ifndef INCLUDE_TRANSLATIONLOG_HPP_
+#define INCLUDE_TRANSLATIONLOG_HPP_
+
+#include <atomic>
+#include <string>
+#include <utility>
+
+#include <utl/Utl.hpp>
+
+#include <spdlog/fmt/fmt.h>
+
+// Most verbose level of the translation log compiled in: 0 nothing, 1 debug, 2 trace.
+// The levels above it cost nothing, their arguments aren't even evaluated
+#ifndef IGNOTUM_TRANSLATION_LOG_LEVEL
+#define IGNOTUM_TRANSLATION_LOG_LEVEL 2
+#endif
+
+/**
+ * @brief
+ * Log of the translation hot path, off unless it's enabled at runtime.
+ *
+ * A disabled level costs a relaxed load and a branch, and nothing at all when it's compiled out.
+ * An enabled message is formatted by the thread logging it and pushed to the queue of that thread.
+ * A background thread drains the queues to spdlog, so a translation worker never waits on the output.
+ * A message which doesn't fit in the queue of its thread is dropped and counted instead.
+ */
+namespace TranslationLog
+{
+    enum class Level : int
+    {
+        OFF = 0,
+        DEBUG = 1, // Every native instruction translated
+        TRACE = 2 // Every virtual instruction emitted
+    };
+
+    static constexpr Level COMPILED_LEVEL = static_cast<Level>(IGNOTUM_TRANSLATION_LOG_LEVEL);
+
+    inline std::atomic<Level> runtime_level{ Level::OFF };
+
+    HOT_PATH FORCE_INLINE bool Enabled(const Level level)
+    {
+        return level <= COMPILED_LEVEL && level <= runtime_level.load(std::memory_order_relaxed);
+    }
+
+    void Push(std::string message);
+
+    template<class... Args>
+    void Write(fmt::format_string<Args...> format, Args&&... args)
+    {
+        Push(fmt::format(format, std::forward<Args>(args)...));
+    }
+
+    // Starts the background thread when a level is enabled
+    void SetLevel(const Level level);
+
+    // Drains every queue and stops the background thread. Called before the process exits
+    void Shutdown();
+}
+
+// Logs a message of the translation when its level is compiled in and enabled, the arguments are only evaluated then
+#define IGNOTUM_TRANSLATION_LOG(level, ...)                                                                 \
+    do {                                                                                                    \
+        if constexpr(TranslationLog::Level::level <= TranslationLog::COMPILED_LEVEL) {                      \
+            if(TranslationLog::Enabled(TranslationLog::Level::level)) {                                     \
+                TranslationLog::Write(__VA_ARGS__);                                                         \
+            }                                                                                               \
+        }                                                                                                   \
+    } while(false)
+
+#define IGNOTUM_TRANSLATION_DEBUG(...) IGNOTUM_TRANSLATION_LOG(DEBUG, __VA_ARGS__)
+#define IGNOTUM_TRANSLATION_TRACE(...) IGNOTUM_TRANSLATION_LOG(TRACE, __VA_ARGS__)
+
+#endif // INCLUDE_TRANSLATIONLOG_HPP_
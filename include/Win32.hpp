@@ -45,6 +45,11 @@ namespace Win32
         constexpr std::uint16_t IMAGE_FILE_MACHINE_I386 = 0x014c;
         // 64 bits specifier
         constexpr std::uint16_t IMAGE_FILE_MACHINE_AMD64 = 0x8664;
+        // Set in a thunk when the function is imported by ordinal
+        constexpr std::uint32_t IMAGE_ORDINAL_FLAG32 = 0x80000000;
+        constexpr std::uint64_t IMAGE_ORDINAL_FLAG64 = 0x8000000000000000;
+        // The section contains executable code
+        constexpr std::uint32_t IMAGE_SCN_MEM_EXECUTE = 0x20000000;
     }
 
     enum class Architecture : std::uint16_t
@@ -85,6 +90,22 @@ namespace Win32
         } u1;
     };
 
+    // Thunks as they are stored in the file. The size depends on the architecture of the image
+    struct IMAGE_THUNK_DATA32 {
+        DWORD AddressOfData;
+    };
+
+    struct IMAGE_THUNK_DATA64 {
+        ULONGLONG AddressOfData;
+    };
+
+    // Entry of the exception directory (.pdata) of a x64 image. There's one per function with unwind data
+    struct IMAGE_RUNTIME_FUNCTION_ENTRY {
+        DWORD BeginAddress;
+        DWORD EndAddress;
+        DWORD UnwindInfoAddress;
+    };
+
     struct IMAGE_DOS_HEADER {      // DOS .EXE header
         WORD   e_magic;                     // Magic number
         WORD   e_cblp;                      // Bytes on last page of file
@@ -13,8 +13,66 @@
 #endif
 
 
+#include <cstdint>
+#include <cstddef>
+#include <span>
+#include <charconv>
+#include <optional>
+#include <string_view>
+
 namespace Utl
 {
+    /**
+     * @brief
+     * Rounds the value up to the next multiple of the alignment.
+     * An alignment of 0 leaves the value untouched.
+     */
+    constexpr std::uint64_t AlignUp(const std::uint64_t value, const std::uint64_t alignment)
+    {
+        if(alignment == 0) {
+            return value;
+        }
+
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    constexpr std::uint64_t kFnv1aOffset = 0xcbf29ce484222325;
+
+    /**
+     * @brief
+     * 64 bit FNV-1a hash of the bytes. The hash of a previous call can be passed as the
+     * starting value to hash multiple buffers as if they were one.
+     */
+    inline std::uint64_t Fnv1a64(const std::span<const std::uint8_t> bytes, std::uint64_t hash = kFnv1aOffset)
+    {
+        constexpr std::uint64_t kFnv1aPrime = 0x100000001b3;
+
+        for(const auto byte : bytes) {
+            hash = (hash ^ byte) * kFnv1aPrime;
+        }
+
+        return hash;
+    }
+
+    /**
+     * @brief
+     * Parses a hexadecimal value, with or without the 0x prefix.
+     * Nothing is returned when the whole token isn't a valid value.
+     */
+    inline std::optional<std::uint64_t> ParseHex(std::string_view token)
+    {
+        if(token.starts_with("0x") || token.starts_with("0X")) {
+            token.remove_prefix(2);
+        }
+
+        std::uint64_t value{ 0 };
+        const auto [end, error] = std::from_chars(token.data(), token.data() + token.size(), value, 16);
+        if(token.empty() || error != std::errc{} || end != token.data() + token.size()) {
+            return {};
+        }
+
+        return value;
+    }
 }
 
 #endif
\ No newline at end of file
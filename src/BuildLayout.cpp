@@ -0,0 +1,186 @@
+#include <BuildLayout.hpp>
+#include <FileMapping.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <string_view>
+
+namespace
+{
+    constexpr std::string_view kLayoutMagic{ "IGNLAYOU", 8 };
+    constexpr std::uint32_t kLayoutVersion = 2;
+    constexpr std::size_t kLayoutHeaderSize = 8 + 4 + 4 + 8 + 4 * 4 + 8 + 4;
+    constexpr std::size_t kLayoutRegionSize = 4 + 4 + 8 + 4 + 4;
+
+    template<class T>
+    void AppendValue(std::vector<std::uint8_t>& buffer, const T value)
+    {
+        const auto* bytes = std::bit_cast<const std::uint8_t*>(&value);
+        buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+    }
+
+    template<class T>
+    T ReadValue(const std::uint8_t* source)
+    {
+        T value;
+        std::memcpy(&value, source, sizeof(T));
+        return value;
+    }
+}
+
+/**
+ * @brief
+ * Adds a region to the layout, keeping the regions sorted by rva.
+ * The regions are usually added in order, which makes this an append.
+ */
+void BuildLayout::AddRegion(const Region& region)
+{
+    const auto it = std::upper_bound(m_regions.begin(), m_regions.end(), region.rva, [](const std::uint32_t rva, const Region& other) {
+        return rva < other.rva;
+    });
+
+    m_regions.insert(it, region);
+}
+
+/**
+ * @brief
+ * Finds the region starting at the rva
+ *
+ * @param rva The first rva of the region
+ * @return std::optional<Region> The region or nullopt if no region starts there
+ */
+std::optional<BuildLayout::Region> BuildLayout::Find(const std::uint32_t rva) const
+{
+    const auto it = std::lower_bound(m_regions.begin(), m_regions.end(), rva, [](const Region& region, const std::uint32_t value) {
+        return region.rva < value;
+    });
+
+    if(it == m_regions.end() || it->rva != rva) {
+        return {};
+    }
+
+    return *it;
+}
+
+/**
+ * @brief
+ * Writes the layout to a file. The file is replaced atomically
+ *
+ * @param path Where the layout is written
+ * @return Result<bool, const char*> Ok or an error message
+ */
+Result<bool, const char*> BuildLayout::Save(const std::filesystem::path& path) const
+{
+    std::vector<std::uint8_t> content;
+    content.reserve(kLayoutHeaderSize + m_regions.size() * kLayoutRegionSize);
+    content.insert(content.end(), kLayoutMagic.begin(), kLayoutMagic.end());
+    AppendValue<std::uint32_t>(content, kLayoutVersion);
+    AppendValue<std::uint32_t>(content, static_cast<std::uint32_t>(m_regions.size()));
+    AppendValue<std::uint64_t>(content, key_seed);
+    AppendValue<std::uint32_t>(content, vm_rva);
+    AppendValue<std::uint32_t>(content, vm_size);
+    AppendValue<std::uint32_t>(content, vcode_rva);
+    AppendValue<std::uint32_t>(content, vcode_size);
+    AppendValue<std::uint64_t>(content, vm_hash);
+    AppendValue<std::uint32_t>(content, translator_version);
+
+    for(const auto& region : m_regions)
+    {
+        AppendValue<std::uint32_t>(content, region.rva);
+        AppendValue<std::uint32_t>(content, region.size);
+        AppendValue<std::uint64_t>(content, region.source_hash);
+        AppendValue<std::uint32_t>(content, region.vcode_offset);
+        AppendValue<std::uint32_t>(content, region.vcode_size);
+    }
+
+    auto temporary_path = path;
+    temporary_path += ".ign-tmp";
+
+    std::ofstream layout_file(temporary_path, std::ios::binary | std::ios::trunc);
+    if(!layout_file.is_open()) {
+        return Err("Could not create the layout file");
+    }
+
+    layout_file.write(std::bit_cast<const char*>(content.data()), content.size());
+    layout_file.close();
+
+    std::error_code ec;
+    if(!layout_file) {
+        std::filesystem::remove(temporary_path, ec);
+        return Err("Writing the layout file failed");
+    }
+
+    std::filesystem::rename(temporary_path, path, ec);
+    if(ec) {
+        std::filesystem::remove(temporary_path, ec);
+        return Err("Could not move the layout to its path");
+    }
+
+    return Ok(true);
+}
+
+/**
+ * @brief
+ * Reads a layout written by Save
+ *
+ * @param path The layout file
+ * @return Result<BuildLayout, const char*> The layout or an error message if the file is invalid
+ */
+Result<BuildLayout, const char*> BuildLayout::Load(const std::filesystem::path& path)
+{
+    auto mapping_res = FileMapping::Open(path);
+    if(mapping_res.isErr()) {
+        return Err(mapping_res.unwrapErr());
+    }
+
+    const auto mapping = mapping_res.unwrap();
+    const auto content = mapping->Span();
+
+    if(content.size() < kLayoutHeaderSize ||
+       std::memcmp(content.data(), kLayoutMagic.data(), kLayoutMagic.size()) != 0)
+    {
+        return Err("The file is not a layout");
+    }
+
+    if(ReadValue<std::uint32_t>(content.data() + 8) != kLayoutVersion) {
+        return Err("The version of the layout is not supported");
+    }
+
+    const auto region_count = ReadValue<std::uint32_t>(content.data() + 12);
+    if((content.size() - kLayoutHeaderSize) / kLayoutRegionSize < region_count) {
+        return Err("The layout is truncated");
+    }
+
+    BuildLayout layout;
+    layout.key_seed = ReadValue<std::uint64_t>(content.data() + 16);
+    layout.vm_rva = ReadValue<std::uint32_t>(content.data() + 24);
+    layout.vm_size = ReadValue<std::uint32_t>(content.data() + 28);
+    layout.vcode_rva = ReadValue<std::uint32_t>(content.data() + 32);
+    layout.vcode_size = ReadValue<std::uint32_t>(content.data() + 36);
+    layout.vm_hash = ReadValue<std::uint64_t>(content.data() + 40);
+    layout.translator_version = ReadValue<std::uint32_t>(content.data() + 48);
+
+    layout.m_regions.reserve(region_count);
+    for(std::size_t i = 0; i < region_count; ++i)
+    {
+        const auto* record = content.data() + kLayoutHeaderSize + i * kLayoutRegionSize;
+
+        const Region region{
+            ReadValue<std::uint32_t>(record),
+            ReadValue<std::uint32_t>(record + 4),
+            ReadValue<std::uint64_t>(record + 8),
+            ReadValue<std::uint32_t>(record + 16),
+            ReadValue<std::uint32_t>(record + 20)
+        };
+
+        if(region.vcode_offset > layout.vcode_size || layout.vcode_size - region.vcode_offset < region.vcode_size) {
+            return Err("A region of the layout is outside of the virtual code section");
+        }
+
+        layout.AddRegion(region);
+    }
+
+    return Ok(layout);
+}
@@ -0,0 +1,69 @@
+#include <DecodedRegion.hpp>
+
+namespace
+{
+    OperandSummary Summarize(const ZydisDecodedOperand& operand)
+    {
+        OperandSummary summary{};
+        summary.type = static_cast<std::uint8_t>(operand.type);
+
+        switch(operand.type)
+        {
+        case ZydisOperandType::ZYDIS_OPERAND_TYPE_REGISTER:
+            summary.reg = static_cast<std::uint16_t>(operand.reg.value);
+            break;
+        case ZydisOperandType::ZYDIS_OPERAND_TYPE_MEMORY:
+            summary.reg = static_cast<std::uint16_t>(operand.mem.base);
+            summary.index = static_cast<std::uint16_t>(operand.mem.index);
+            summary.scale = operand.mem.scale;
+            summary.has_displacement = operand.mem.disp.has_displacement;
+            summary.value = operand.mem.disp.value;
+            break;
+        case ZydisOperandType::ZYDIS_OPERAND_TYPE_IMMEDIATE:
+            summary.value = static_cast<std::int64_t>(operand.imm.value.u);
+            break;
+        default:
+            break;
+        }
+
+        return summary;
+    }
+}
+
+/**
+ * @brief
+ * Decodes the instructions of a region in a single pass, replacing the previous region.
+ *
+ * @param code The native code of the region
+ */
+void DecodedRegion::Decode(std::span<const std::uint8_t> code)
+{
+    m_mnemonics.clear();
+    m_lengths.clear();
+    m_offsets.clear();
+    m_operand_counts.clear();
+    m_operands.clear();
+
+    ZydisDecoder decoder;
+    ZydisDecoderInit(&decoder, ZYDIS_MACHINE_MODE_LONG_64, ZYDIS_STACK_WIDTH_64);
+
+    ZydisDecodedInstruction instruction;
+    ZydisDecodedOperand operands[ZYDIS_MAX_OPERAND_COUNT_VISIBLE];
+
+    std::size_t offset{ 0 };
+    while(ZYAN_SUCCESS(ZydisDecoderDecodeFull(&decoder, code.data() + offset, code.size() - offset,
+        &instruction, operands, ZYDIS_MAX_OPERAND_COUNT_VISIBLE,
+        ZYDIS_DFLAG_VISIBLE_OPERANDS_ONLY)))
+    {
+        m_mnemonics.push_back(static_cast<std::uint16_t>(instruction.mnemonic));
+        m_lengths.push_back(instruction.length);
+        m_offsets.push_back(static_cast<std::uint32_t>(offset));
+        m_operand_counts.push_back(instruction.operand_count_visible);
+
+        for(std::size_t i = 0; i < OPERANDS_PER_INSTRUCTION; ++i) {
+            m_operands.push_back(i < instruction.operand_count_visible ? Summarize(operands[i]) : OperandSummary{});
+        }
+
+        offset += instruction.length;
+    }
+}
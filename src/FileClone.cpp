@@ -0,0 +1,95 @@
+#include <FileClone.hpp>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+/**
+ * @brief
+ * Copies the whole content of a file to another one without going through user space
+ *
+ * @return true Everything was copied
+ * @return false The kernel can't copy between these two files
+ */
+static bool CopyFileRange(const int source_fd, const int destination_fd, std::uintmax_t size)
+{
+    while(size != 0)
+    {
+        const auto copied = copy_file_range(source_fd, nullptr, destination_fd, nullptr, size, 0);
+        if(copied < 0)
+        {
+            if(errno == EINTR) {
+                continue;
+            }
+
+            return false;
+        }
+
+        // The source got shorter while it was being copied
+        if(copied == 0) {
+            return false;
+        }
+
+        size -= static_cast<std::uintmax_t>(copied);
+    }
+
+    return true;
+}
+#endif
+
+Result<bool, const char*>
+FileClone::Clone(const std::filesystem::path& source, const std::filesystem::path& destination)
+{
+#if defined(__linux__)
+    const int source_fd = open(source.c_str(), O_RDONLY | O_CLOEXEC);
+    if(source_fd < 0) {
+        return Err("Could not open the source file");
+    }
+
+    struct stat source_stat{};
+    if(fstat(source_fd, &source_stat) != 0) {
+        close(source_fd);
+        return Err("Could not query the source file");
+    }
+
+    const int destination_fd = open(
+        destination.c_str(),
+        O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+        source_stat.st_mode & 0777
+    );
+
+    if(destination_fd < 0) {
+        close(source_fd);
+        return Err("Could not create the destination file");
+    }
+
+    // Reflink first, no data is copied at all. Then the in-kernel copy
+    const bool cloned =
+        ioctl(destination_fd, FICLONE, source_fd) == 0 ||
+        CopyFileRange(source_fd, destination_fd, static_cast<std::uintmax_t>(source_stat.st_size));
+
+    close(source_fd);
+    if(close(destination_fd) != 0) {
+        return Err("Could not write the destination file");
+    }
+
+    if(cloned) {
+        return Ok(true);
+    }
+#endif
+
+    // Last resort, the standard library copies the file
+    std::error_code ec;
+    std::filesystem::copy_file(source, destination, std::filesystem::copy_options::overwrite_existing, ec);
+    if(ec) {
+        return Err("Could not copy the file");
+    }
+
+    return Ok(true);
+}
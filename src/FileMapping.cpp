@@ -0,0 +1,167 @@
+#include <FileMapping.hpp>
+
+#include <bit>
+#include <cstring>
+#include <new>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+FileMapping::~FileMapping()
+{
+    if(m_base == nullptr || m_copy) {
+        return;
+    }
+
+#if defined(_WIN32)
+    UnmapViewOfFile(m_base);
+#else
+    munmap(m_base, m_size);
+#endif
+}
+
+/**
+ * @brief
+ * Maps the whole file at the given path in memory.
+ * The file handle is closed right after the mapping is created, the mapping
+ * itself keeps the pages alive until the object is destroyed.
+ *
+ * @param path The path of the file to be mapped
+ * @return Result<std::shared_ptr<FileMapping>, const char*>
+ * The mapping or an error message explaining why it could not be created
+ */
+Result<std::shared_ptr<FileMapping>, const char*>
+FileMapping::Open(const std::filesystem::path& path)
+{
+    auto mapping = std::make_shared<FileMapping>();
+
+#if defined(_WIN32)
+    const HANDLE file = CreateFileW(
+        path.c_str(),
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        nullptr,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL,
+        nullptr
+    );
+
+    if(file == INVALID_HANDLE_VALUE) {
+        return Err("Could not open the file");
+    }
+
+    LARGE_INTEGER file_size{};
+    if(!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+        CloseHandle(file);
+        return Err("Could not query the size of the file");
+    }
+
+    // PAGE_WRITECOPY gives us private pages once they are written to
+    const HANDLE section = CreateFileMappingW(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+    CloseHandle(file);
+
+    if(section == nullptr) {
+        return Err("Could not create the file mapping");
+    }
+
+    void* base = MapViewOfFile(section, FILE_MAP_COPY, 0, 0, 0);
+    CloseHandle(section);
+
+    if(base == nullptr) {
+        return Err("Could not map the file in memory");
+    }
+
+    mapping->m_base = static_cast<std::uint8_t*>(base);
+    mapping->m_size = static_cast<std::size_t>(file_size.QuadPart);
+#else
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        return Err("Could not open the file");
+    }
+
+    struct stat file_stat{};
+    if(fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+        close(fd);
+        return Err("Could not query the size of the file");
+    }
+
+    // MAP_PRIVATE makes the pages copy-on-write, nothing written through the mapping reaches the file
+    void* base = mmap(
+        nullptr,
+        static_cast<std::size_t>(file_stat.st_size),
+        PROT_READ | PROT_WRITE,
+        MAP_PRIVATE,
+        fd,
+        0
+    );
+    close(fd);
+
+    if(base == MAP_FAILED) {
+        return Err("Could not map the file in memory");
+    }
+
+    mapping->m_base = static_cast<std::uint8_t*>(base);
+    mapping->m_size = static_cast<std::size_t>(file_stat.st_size);
+#endif
+
+    return Ok(mapping);
+}
+
+/**
+ * @brief
+ * Drops the private copies of the pages covering the range, they read the bytes of the file again.
+ * The whole pages are dropped, including the bytes around the range that share them.
+ * Nothing is done for a mapping made from a buffer, its copy is all there is, nor on Windows
+ * where the private pages of a copy-on-write view can't be given back.
+ *
+ * @param range Bytes of the mapping
+ */
+void FileMapping::Discard(std::span<const std::uint8_t> range) const
+{
+    if(m_copy || range.empty()) {
+        return;
+    }
+
+#if !defined(_WIN32)
+    const auto page_mask = static_cast<std::uintptr_t>(sysconf(_SC_PAGESIZE)) - 1;
+    const auto begin = std::bit_cast<std::uintptr_t>(range.data()) & ~page_mask;
+    const auto end = std::bit_cast<std::uintptr_t>(range.data() + range.size());
+
+    madvise(std::bit_cast<void*>(begin), end - begin, MADV_DONTNEED);
+#endif
+}
+
+/**
+ * @brief
+ * Holds a copy of an image given in memory, with the same guarantees as a mapped file:
+ * the buffers handed out from it can be patched without touching the caller's buffer.
+ *
+ * @param buffer The image. It's copied, the caller can release it right away
+ * @return Result<std::shared_ptr<FileMapping>, const char*> The mapping or an error message
+ */
+Result<std::shared_ptr<FileMapping>, const char*>
+FileMapping::FromBuffer(std::span<const std::uint8_t> buffer)
+{
+    if(buffer.empty()) {
+        return Err("The buffer is empty");
+    }
+
+    auto mapping = std::make_shared<FileMapping>();
+
+    mapping->m_copy.reset(new(std::nothrow) std::uint8_t[buffer.size()]);
+    if(!mapping->m_copy) {
+        return Err("Could not allocate the copy of the image");
+    }
+
+    std::memcpy(mapping->m_copy.get(), buffer.data(), buffer.size());
+    mapping->m_base = mapping->m_copy.get();
+    mapping->m_size = buffer.size();
+
+    return Ok(mapping);
+}
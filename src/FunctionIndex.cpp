@@ -0,0 +1,114 @@
+#include <FunctionIndex.hpp>
+
+#include <algorithm>
+#include <utility>
+
+/**
+ * @brief
+ * Builds the index from a list of functions.
+ * Empty functions are dropped. A function overlapping the previous one is dropped as well,
+ * the exception directory of a valid image never has any, so the index stays usable on a corrupted one.
+ *
+ * @param functions The functions, in any order
+ */
+FunctionIndex::FunctionIndex(std::vector<Function> functions) : m_functions(std::move(functions))
+{
+    std::erase_if(m_functions, [](const Function& function) {
+        return function.end <= function.begin;
+    });
+
+    // The linker already emits them sorted, this is almost free in the common case
+    if(!std::is_sorted(m_functions.begin(), m_functions.end(), [](const Function& a, const Function& b) {
+        return a.begin < b.begin;
+    }))
+    {
+        std::sort(m_functions.begin(), m_functions.end(), [](const Function& a, const Function& b) {
+            return a.begin < b.begin;
+        });
+    }
+
+    std::uint32_t previous_end = 0;
+    std::erase_if(m_functions, [&](const Function& function) {
+        if(function.begin < previous_end) {
+            return true;
+        }
+
+        previous_end = function.end;
+        return false;
+    });
+}
+
+/**
+ * @brief
+ * Builds the index from the entries of the exception directory
+ *
+ * @param entries The RUNTIME_FUNCTION entries, in any order
+ */
+FunctionIndex::FunctionIndex(std::span<const Win32::IMAGE_RUNTIME_FUNCTION_ENTRY> entries)
+    : FunctionIndex([&]() {
+        std::vector<Function> functions;
+        functions.reserve(entries.size());
+        for(const auto& entry : entries) {
+            functions.push_back(Function{ entry.BeginAddress, entry.EndAddress });
+        }
+
+        return functions;
+    }())
+{
+}
+
+/**
+ * @brief
+ * Finds the function containing the rva
+ *
+ * @param rva Any address inside of the function
+ * @return std::optional<Function> The function or nullopt if no function covers the rva
+ */
+std::optional<FunctionIndex::Function> FunctionIndex::Find(const std::uint32_t rva) const
+{
+    // First function starting after the rva, the candidate is the one right before it
+    const auto it = std::upper_bound(m_functions.begin(), m_functions.end(), rva, [](const std::uint32_t value, const Function& function) {
+        return value < function.begin;
+    });
+
+    if(it == m_functions.begin()) {
+        return {};
+    }
+
+    const auto& function = *std::prev(it);
+    if(rva >= function.end) {
+        return {};
+    }
+
+    return function;
+}
+
+/**
+ * @brief
+ * Picks the functions matching the selector, by ascending rva.
+ * Only the functions inside of the range are visited.
+ *
+ * @param selector The conditions a function must meet to be selected
+ * @return std::vector<Function> The selected functions
+ */
+std::vector<FunctionIndex::Function> FunctionIndex::Select(const Selector& selector) const
+{
+    std::vector<Function> selected;
+
+    auto it = std::lower_bound(m_functions.begin(), m_functions.end(), selector.range_begin, [](const Function& function, const std::uint32_t value) {
+        return function.begin < value;
+    });
+
+    for(; it != m_functions.end() && selected.size() < selector.max_count; ++it)
+    {
+        if(it->end > selector.range_end) {
+            break;
+        }
+
+        if(it->Size() > selector.min_size) {
+            selected.push_back(*it);
+        }
+    }
+
+    return selected;
+}
@@ -0,0 +1,817 @@
+#include <ImageBuilder.hpp>
+#include <FileClone.hpp>
+#include <FileMapping.hpp>
+#include <utl/Utl.hpp>
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <bit>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <string_view>
+#include <utility>
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <climits>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+// The copy of the base the extents are written to while streaming
+struct ImageBuilder::WorkImage
+{
+    std::filesystem::path path;
+    std::fstream file;
+    bool committed{ false }; // Moved to its destination, it must not be removed anymore
+
+    ~WorkImage()
+    {
+        if(committed) {
+            return;
+        }
+
+        file.close();
+
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+    }
+};
+
+/**
+ * @brief
+ * Writes every extent to a work image from now on instead of holding it in memory.
+ * The extents staged so far are written right away. The work image takes the place
+ * of the output when committing, so the base bytes are never read back to bridge gaps.
+ *
+ * @param work_path A copy of the base made by the caller. It's removed unless it's committed
+ * @return Result<bool, const char*> Ok or an error message if the work image can't be written
+ */
+Result<bool, const char*> ImageBuilder::StreamTo(const std::filesystem::path& work_path)
+{
+    auto work_image = std::make_shared<WorkImage>();
+    work_image->path = work_path;
+    work_image->file.open(work_path, std::ios::in | std::ios::out | std::ios::binary);
+    if(!work_image->file.is_open()) {
+        return Err("Could not open the work image");
+    }
+
+    m_work_image = std::move(work_image);
+
+    const auto extents = std::exchange(m_extents, {});
+    m_sorted = true;
+
+    for(const auto& extent : extents)
+    {
+        const auto write_res = WriteToWorkImage(extent.offset, extent.bytes.data(), extent.bytes.size());
+        if(write_res.isErr()) {
+            return write_res;
+        }
+    }
+
+    return Ok(true);
+}
+
+/**
+ * @brief
+ * Stages bytes which will replace the content of the file at the given offset.
+ * The bytes are copied, or written to the work image when streaming,
+ * the caller can reuse its buffer right away.
+ *
+ * @param offset Absolute position in the file
+ * @param data Bytes to be written
+ * @param size Amount of bytes to be written
+ * @return Result<bool, const char*> Ok or an error message if the work image could not be written
+ */
+Result<bool, const char*> ImageBuilder::Stage(const std::uintmax_t offset, const std::uint8_t* data, const std::size_t size)
+{
+    if(size == 0) {
+        return Ok(true);
+    }
+
+    if(m_work_image) {
+        return WriteToWorkImage(offset, data, size);
+    }
+
+    if(!m_extents.empty() && m_extents.back().offset > offset) {
+        m_sorted = false;
+    }
+
+    m_extents.emplace_back(Extent{
+        offset,
+        std::vector<std::uint8_t>(data, data + size)
+    });
+
+    return Ok(true);
+}
+
+/**
+ * @brief
+ * Writes an extent at its place in the work image and only keeps where it went
+ */
+Result<bool, const char*> ImageBuilder::WriteToWorkImage(const std::uintmax_t offset, const std::uint8_t* data, const std::size_t size)
+{
+    auto& file = m_work_image->file;
+    file.seekp(static_cast<std::streamoff>(offset), std::ios_base::beg);
+    file.write(std::bit_cast<const char*>(data), static_cast<std::streamsize>(size));
+    if(!file) {
+        return Err("Writing to the work image failed");
+    }
+
+    m_written.push_back(WrittenExtent{ offset, size });
+    return Ok(true);
+}
+
+/**
+ * @brief
+ * Gives a part of the work image to a sink, a bounded piece at a time
+ */
+Result<bool, const char*> ImageBuilder::ReadWorkImage(std::uintmax_t offset, std::uintmax_t size, const Sink& sink)
+{
+    auto& file = m_work_image->file;
+    std::vector<std::uint8_t> buffer(static_cast<std::size_t>(std::min(size, kReadBackChunkSize)));
+
+    file.seekg(static_cast<std::streamoff>(offset), std::ios_base::beg);
+    while(size != 0)
+    {
+        const auto count = static_cast<std::size_t>(std::min<std::uintmax_t>(size, buffer.size()));
+        file.read(std::bit_cast<char*>(buffer.data()), static_cast<std::streamsize>(count));
+        if(!file) {
+            return Err("Reading the work image back failed");
+        }
+
+        if(!sink({ buffer.data(), count })) {
+            return Err("The sink stopped the writing of the image");
+        }
+
+        size -= count;
+    }
+
+    return Ok(true);
+}
+
+/**
+ * @brief
+ * Gives the work image its final size and moves it to the destination, replacing the file there
+ */
+Result<bool, const char*> ImageBuilder::FinishWorkImage(const std::filesystem::path& destination)
+{
+    auto& work_image = *m_work_image;
+    work_image.file.close();
+    if(!work_image.file) {
+        return Err("Writing to the work image failed");
+    }
+
+    // The part of the new sections which isn't staged is zeros, like when the file is grown in Commit
+    std::error_code ec;
+    const auto work_size = std::filesystem::file_size(work_image.path, ec);
+    if(!ec && work_size < m_image_size) {
+        std::filesystem::resize_file(work_image.path, m_image_size, ec);
+    }
+
+    if(ec) {
+        return Err("Could not grow the work image");
+    }
+
+    std::filesystem::rename(work_image.path, destination, ec);
+    if(ec) {
+        return Err("Could not move the work image to the output path");
+    }
+
+    work_image.committed = true;
+    return Ok(true);
+}
+
+/**
+ * @brief
+ * Makes sure the file will be at least as big as the given size once committed.
+ * The added space is not staged as an extent, it's reserved in one go when committing.
+ *
+ * @param image_size The minimum size of the file
+ */
+void ImageBuilder::Grow(const std::uintmax_t image_size)
+{
+    m_image_size = std::max(m_image_size, image_size);
+}
+
+void ImageBuilder::Clear()
+{
+    m_extents.clear();
+    m_image_size = m_base_size;
+    m_sorted = true;
+    m_written.clear();
+    m_work_image.reset();
+    m_base_fingerprint = 0;
+}
+
+/**
+ * @brief
+ * Every extent, held in memory or written, in the order of the file. Only valid once validated
+ */
+std::vector<ImageBuilder::Range> ImageBuilder::Ranges() const
+{
+    std::vector<Range> ranges;
+    ranges.reserve(m_extents.size() + m_written.size());
+
+    auto extent = m_extents.begin();
+    auto written = m_written.begin();
+    while(extent != m_extents.end() || written != m_written.end())
+    {
+        if(written == m_written.end() || (extent != m_extents.end() && extent->offset < written->offset)) {
+            ranges.push_back(Range{ extent->offset, extent->bytes.size(), &*extent });
+            ++extent;
+        }
+        else {
+            ranges.push_back(Range{ written->offset, written->size, nullptr });
+            ++written;
+        }
+    }
+
+    return ranges;
+}
+
+/**
+ * @brief
+ * Orders the staged extents and verifies that they can be written.
+ * The extents already written to the work image are checked the same way.
+ *
+ * @return Result<bool, const char*>
+ * Ok if the extents are valid. An error if two extents overlap or if one goes past the end of the image
+ */
+Result<bool, const char*> ImageBuilder::Validate()
+{
+    if(!m_sorted)
+    {
+        std::stable_sort(m_extents.begin(), m_extents.end(), [](const Extent& a, const Extent& b) {
+            return a.offset < b.offset;
+        });
+
+        m_sorted = true;
+    }
+
+    const auto by_offset = [](const WrittenExtent& a, const WrittenExtent& b) { return a.offset < b.offset; };
+    if(!std::is_sorted(m_written.begin(), m_written.end(), by_offset)) {
+        std::stable_sort(m_written.begin(), m_written.end(), by_offset);
+    }
+
+    // Checked without computing the end first, the offset and the size of an extent loaded from a delta can be anything
+    std::uintmax_t previous_end = 0;
+    for(const auto& range : Ranges())
+    {
+        if(range.offset > m_image_size || range.size > m_image_size - range.offset) {
+            return Err("A staged write goes past the end of the image");
+        }
+
+        if(range.offset < previous_end) {
+            return Err("Two staged writes overlap");
+        }
+
+        previous_end = range.offset + range.size;
+    }
+
+    return Ok(true);
+}
+
+#if !defined(_WIN32)
+/**
+ * @brief
+ * Writes a list of buffers at a position of the file, restarting the call on partial writes
+ *
+ * @param fd Descriptor of the file
+ * @param offset Absolute position of the first buffer
+ * @param iovecs The buffers to be written one after the other. The list is consumed
+ * @return true Everything was written
+ * @return false The write failed
+ */
+static bool WriteVectored(const int fd, std::uintmax_t offset, std::vector<iovec>& iovecs)
+{
+    std::size_t first = 0;
+    while(first < iovecs.size())
+    {
+        const auto count = std::min<std::size_t>(iovecs.size() - first, IOV_MAX);
+        const auto written = pwritev(fd, iovecs.data() + first, static_cast<int>(count), static_cast<off_t>(offset));
+        if(written < 0)
+        {
+            if(errno == EINTR) {
+                continue;
+            }
+
+            return false;
+        }
+
+        offset += static_cast<std::uintmax_t>(written);
+
+        // Skip the buffers that were fully written and adjust the one that was partially written
+        auto remaining = static_cast<std::size_t>(written);
+        while(first < iovecs.size() && remaining >= iovecs[first].iov_len)
+        {
+            remaining -= iovecs[first].iov_len;
+            ++first;
+        }
+
+        if(remaining != 0)
+        {
+            iovecs[first].iov_base = std::bit_cast<std::uint8_t*>(iovecs[first].iov_base) + remaining;
+            iovecs[first].iov_len -= remaining;
+        }
+    }
+
+    return true;
+}
+#endif
+
+/**
+ * @brief
+ * Validates the staged extents and writes them to the file in a single ordered pass.
+ * The file is grown once to its final size, then every run of contiguous extents
+ * is written with one vectored write. Small gaps between two extents are filled with
+ * the bytes of the base image so the extents around them end up in the same run.
+ *
+ * When streaming, every extent is already in the work image, which replaces the file instead.
+ *
+ * @param path The file receiving the modifications
+ * @param base_image
+ * The original content of the file. Only read in the gaps between extents to bridge them,
+ * it must hold the bytes that are currently on disk there. The bytes under an extent are never read.
+ * @return Result<bool, const char*> Ok if everything was written, otherwise an error message
+ */
+Result<bool, const char*>
+ImageBuilder::Commit(const std::filesystem::path& path, std::span<const std::uint8_t> base_image)
+{
+    const auto validate_res = Validate();
+    if(validate_res.isErr()) {
+        return validate_res;
+    }
+
+    if(m_work_image) {
+        return FinishWorkImage(path);
+    }
+
+#if defined(_WIN32)
+    std::error_code ec;
+    if(m_image_size > m_base_size) {
+        std::filesystem::resize_file(path, m_image_size, ec);
+        if(ec) {
+            return Err("Could not grow the file");
+        }
+    }
+
+    std::fstream file_handle(path, std::ios::in | std::ios::out | std::ios::binary);
+    if(!file_handle.is_open()) {
+        return Err("Could not open the file");
+    }
+
+    for(const auto& extent : m_extents)
+    {
+        file_handle.seekp(extent.offset, std::ios_base::beg);
+        file_handle.write(std::bit_cast<const char*>(extent.bytes.data()), extent.bytes.size());
+    }
+
+    if(!file_handle) {
+        return Err("Writing the staged extents failed");
+    }
+
+    static_cast<void>(base_image);
+#else
+    const int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    if(fd < 0) {
+        return Err("Could not open the file");
+    }
+
+    // Reserve the space for the new sections in one call. The new area is sparse until written
+    if(m_image_size > m_base_size && ftruncate(fd, static_cast<off_t>(m_image_size)) != 0) {
+        close(fd);
+        return Err("Could not grow the file");
+    }
+
+    std::vector<iovec> iovecs;
+    std::uintmax_t run_offset = 0;
+    std::uintmax_t run_end = 0;
+
+    for(const auto& extent : m_extents)
+    {
+        if(!iovecs.empty())
+        {
+            const auto gap = extent.offset - run_end;
+            const bool can_bridge = gap <= kMaxBridgedGap && extent.offset <= base_image.size();
+
+            if(gap != 0 && can_bridge)
+            {
+                iovecs.push_back(iovec{
+                    const_cast<std::uint8_t*>(base_image.data() + run_end),
+                    static_cast<std::size_t>(gap)
+                });
+            }
+            else if(gap != 0)
+            {
+                // The gap is too big, the current run is written and a new one starts
+                if(!WriteVectored(fd, run_offset, iovecs)) {
+                    close(fd);
+                    return Err("Writing the staged extents failed");
+                }
+
+                iovecs.clear();
+            }
+        }
+
+        if(iovecs.empty()) {
+            run_offset = extent.offset;
+        }
+
+        iovecs.push_back(iovec{
+            const_cast<std::uint8_t*>(extent.bytes.data()),
+            extent.bytes.size()
+        });
+        run_end = extent.offset + extent.bytes.size();
+    }
+
+    if(!iovecs.empty() && !WriteVectored(fd, run_offset, iovecs)) {
+        close(fd);
+        return Err("Writing the staged extents failed");
+    }
+
+    if(close(fd) != 0) {
+        return Err("Closing the file failed");
+    }
+#endif
+
+    return Ok(true);
+}
+
+/**
+ * @brief
+ * Writes the modified image to another file, the base file is left untouched.
+ * The base is cloned to a temporary file next to the output, which shares the extents
+ * of the base where the filesystem allows it. Only the staged extents are written to the
+ * clone, which is renamed to the output once it's complete. When streaming, the work image
+ * already is that clone and it's renamed right away.
+ *
+ * @param base_path The file the extents are applied on
+ * @param output_path Where the modified image is written
+ * @param base_image The content of the base file. See Commit
+ * @return Result<bool, const char*> Ok if the file was written, otherwise an error message
+ */
+Result<bool, const char*> ImageBuilder::CommitCopy(
+    const std::filesystem::path& base_path,
+    const std::filesystem::path& output_path,
+    std::span<const std::uint8_t> base_image
+)
+{
+    // Validate before cloning, there's no point in copying the file if the extents are invalid
+    const auto validate_res = Validate();
+    if(validate_res.isErr()) {
+        return validate_res;
+    }
+
+    if(m_work_image) {
+        return FinishWorkImage(output_path);
+    }
+
+    auto temporary_path = output_path;
+    temporary_path += ".ign-tmp";
+
+    const auto clone_res = FileClone::Clone(base_path, temporary_path);
+    if(clone_res.isErr()) {
+        return clone_res;
+    }
+
+    std::error_code ec;
+    const auto commit_res = Commit(temporary_path, base_image);
+    if(commit_res.isErr()) {
+        std::filesystem::remove(temporary_path, ec);
+        return commit_res;
+    }
+
+    std::filesystem::rename(temporary_path, output_path, ec);
+    if(ec) {
+        std::filesystem::remove(temporary_path, ec);
+        return Err("Could not move the file to the output path");
+    }
+
+    return Ok(true);
+}
+
+/**
+ * @brief
+ * Gives the whole modified image to a sink instead of writing it to a file.
+ * The pieces come in order: the base bytes between the extents, the extents themselves
+ * and zeros for the part of the grown image which isn't staged. When streaming, the work image
+ * holds all of it and it's read back in order instead.
+ *
+ * @param base_image
+ * The content of the base file, at least as big as the base size. Only read outside of the extents,
+ * the bytes under an extent can differ from the base, they are replaced anyway
+ * @param sink Receives the pieces, they are only valid during the call
+ * @return Result<bool, const char*> Ok once the whole image was given, otherwise an error message
+ */
+Result<bool, const char*>
+ImageBuilder::WriteTo(std::span<const std::uint8_t> base_image, const Sink& sink)
+{
+    const auto validate_res = Validate();
+    if(validate_res.isErr()) {
+        return validate_res;
+    }
+
+    if(m_work_image)
+    {
+        // The buffered writes must reach the file before it's resized and read back
+        m_work_image->file.flush();
+
+        std::error_code ec;
+        if(std::filesystem::file_size(m_work_image->path, ec) < m_image_size && !ec) {
+            std::filesystem::resize_file(m_work_image->path, m_image_size, ec);
+        }
+
+        if(ec || !m_work_image->file) {
+            return Err("Could not grow the work image");
+        }
+
+        return ReadWorkImage(0, m_image_size, sink);
+    }
+
+    if(base_image.size() < m_base_size) {
+        return Err("The base image is smaller than the file the extents are applied on");
+    }
+
+    static constexpr std::array<std::uint8_t, 0x1000> zeros{};
+
+    // Gives the bytes up to the end which aren't staged, from the base then zeros past its end
+    std::uintmax_t position = 0;
+    const auto write_unstaged = [&](const std::uintmax_t end) {
+        while(position < end)
+        {
+            const auto count = position < m_base_size ?
+                std::min(end, m_base_size) - position :
+                std::min<std::uintmax_t>(end - position, zeros.size());
+
+            const auto piece = position < m_base_size ?
+                base_image.subspan(static_cast<std::size_t>(position), static_cast<std::size_t>(count)) :
+                std::span<const std::uint8_t>(zeros.data(), static_cast<std::size_t>(count));
+
+            if(!sink(piece)) {
+                return false;
+            }
+
+            position += count;
+        }
+
+        return true;
+    };
+
+    for(const auto& extent : m_extents)
+    {
+        if(!write_unstaged(extent.offset) || !sink(extent.bytes)) {
+            return Err("The sink stopped the writing of the image");
+        }
+
+        position = extent.offset + extent.bytes.size();
+    }
+
+    if(!write_unstaged(m_image_size)) {
+        return Err("The sink stopped the writing of the image");
+    }
+
+    return Ok(true);
+}
+
+namespace
+{
+    // Layout of a delta file, every value is little endian:
+    // magic[8] | version u32 | extent count u32 | base size u64 | image size u64 | base fingerprint u64
+    // followed by every extent: offset u64 | size u64 | bytes[size]
+    constexpr std::string_view kDeltaMagic{ "IGNDELTA", 8 };
+    constexpr std::uint32_t kDeltaVersion = 1;
+    constexpr std::size_t kDeltaHeaderSize = 8 + 4 + 4 + 8 + 8 + 8;
+    constexpr std::size_t kDeltaExtentHeaderSize = 8 + 8;
+
+    template<class T>
+    void AppendValue(std::vector<std::uint8_t>& buffer, const T value)
+    {
+        const auto* bytes = std::bit_cast<const std::uint8_t*>(&value);
+        buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+    }
+
+    template<class T>
+    T ReadValue(const std::uint8_t* source)
+    {
+        T value;
+        std::memcpy(&value, source, sizeof(T));
+        return value;
+    }
+}
+
+/**
+ * @brief
+ * Fingerprint of the base image, computed over its size and the bytes replaced by the extents.
+ * It's used to make sure a delta is applied on the same base it was created from
+ */
+std::uint64_t ImageBuilder::BaseFingerprint(std::span<const std::uint8_t> base_image) const
+{
+    auto hash = Utl::Fnv1a64({ std::bit_cast<const std::uint8_t*>(&m_base_size), sizeof(m_base_size) });
+
+    for(const auto& range : Ranges())
+    {
+        if(range.offset >= base_image.size()) {
+            break;
+        }
+
+        const auto covered = std::min<std::uintmax_t>(range.size, base_image.size() - range.offset);
+        hash = Utl::Fnv1a64(base_image.subspan(range.offset, covered), hash);
+    }
+
+    return hash;
+}
+
+/**
+ * @brief
+ * Writes the staged extents to a delta file instead of applying them.
+ * The delta only holds the modified bytes and the final size of the image,
+ * it can be applied later on a copy of the same base with ApplyDelta.
+ * The extents written to the work image are read back from it a piece at a time.
+ *
+ * @param delta_path Where the delta is written
+ * @param base_image The content of the base file, used to fingerprint it
+ * @return Result<bool, const char*> Ok if the delta was written, otherwise an error message
+ */
+Result<bool, const char*>
+ImageBuilder::ExportDelta(const std::filesystem::path& delta_path, std::span<const std::uint8_t> base_image)
+{
+    const auto validate_res = Validate();
+    if(validate_res.isErr()) {
+        return validate_res;
+    }
+
+    if(base_image.size() != m_base_size) {
+        return Err("The base image does not match the staged modifications");
+    }
+
+    std::vector<std::uint8_t> header;
+    header.reserve(kDeltaHeaderSize);
+    header.insert(header.end(), kDeltaMagic.begin(), kDeltaMagic.end());
+    AppendValue<std::uint32_t>(header, kDeltaVersion);
+    const auto ranges = Ranges();
+    AppendValue<std::uint32_t>(header, static_cast<std::uint32_t>(ranges.size()));
+    AppendValue<std::uint64_t>(header, m_base_size);
+    AppendValue<std::uint64_t>(header, m_image_size);
+    AppendValue<std::uint64_t>(header, BaseFingerprint(base_image));
+
+    auto temporary_path = delta_path;
+    temporary_path += ".ign-tmp";
+
+    std::ofstream delta_file(temporary_path, std::ios::binary | std::ios::trunc);
+    if(!delta_file.is_open()) {
+        return Err("Could not create the delta file");
+    }
+
+    const auto write_bytes = [&](std::span<const std::uint8_t> bytes) {
+        delta_file.write(std::bit_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+        return static_cast<bool>(delta_file);
+    };
+
+    write_bytes(header);
+    bool read_back{ true };
+    for(const auto& range : ranges)
+    {
+        std::vector<std::uint8_t> extent_header;
+        AppendValue<std::uint64_t>(extent_header, range.offset);
+        AppendValue<std::uint64_t>(extent_header, range.size);
+        write_bytes(extent_header);
+
+        if(range.extent != nullptr) {
+            write_bytes(range.extent->bytes);
+        }
+        else if(ReadWorkImage(range.offset, range.size, write_bytes).isErr()) {
+            read_back = false;
+            break;
+        }
+    }
+
+    delta_file.close();
+
+    std::error_code ec;
+    if(!delta_file || !read_back) {
+        std::filesystem::remove(temporary_path, ec);
+        return Err("Writing the delta file failed");
+    }
+
+    std::filesystem::rename(temporary_path, delta_path, ec);
+    if(ec) {
+        std::filesystem::remove(temporary_path, ec);
+        return Err("Could not move the delta to its path");
+    }
+
+    return Ok(true);
+}
+
+/**
+ * @brief
+ * Reads a delta file back into a builder holding the same extents
+ *
+ * @param delta_path The delta file written by ExportDelta
+ * @return Result<ImageBuilder, const char*> The builder or an error message if the delta is invalid
+ */
+Result<ImageBuilder, const char*> ImageBuilder::LoadDelta(const std::filesystem::path& delta_path)
+{
+    auto mapping_res = FileMapping::Open(delta_path);
+    if(mapping_res.isErr()) {
+        return Err(mapping_res.unwrapErr());
+    }
+
+    const auto mapping = mapping_res.unwrap();
+    const auto delta = mapping->Span();
+
+    if(delta.size() < kDeltaHeaderSize ||
+       std::memcmp(delta.data(), kDeltaMagic.data(), kDeltaMagic.size()) != 0)
+    {
+        return Err("The file is not a delta");
+    }
+
+    if(ReadValue<std::uint32_t>(delta.data() + 8) != kDeltaVersion) {
+        return Err("The version of the delta is not supported");
+    }
+
+    // Every extent takes at least its header, a count the file can't hold is rejected before anything is reserved
+    const auto extent_count = ReadValue<std::uint32_t>(delta.data() + 12);
+    if(extent_count > (delta.size() - kDeltaHeaderSize) / kDeltaExtentHeaderSize) {
+        return Err("The delta is truncated");
+    }
+
+    // The image only grows by the sections added, which are addressed with 32 bits
+    const auto base_size = ReadValue<std::uint64_t>(delta.data() + 16);
+    const auto image_size = ReadValue<std::uint64_t>(delta.data() + 24);
+    if(image_size < base_size || (image_size > base_size && image_size > std::numeric_limits<std::uint32_t>::max())) {
+        return Err("The size of the image in the delta is invalid");
+    }
+
+    ImageBuilder builder(base_size);
+    builder.Grow(image_size);
+    builder.m_base_fingerprint = ReadValue<std::uint64_t>(delta.data() + 32);
+    builder.m_extents.reserve(extent_count);
+
+    std::size_t position = kDeltaHeaderSize;
+    for(std::uint32_t i = 0; i < extent_count; ++i)
+    {
+        if(delta.size() - position < kDeltaExtentHeaderSize) {
+            return Err("The delta is truncated");
+        }
+
+        const auto offset = ReadValue<std::uint64_t>(delta.data() + position);
+        const auto size = ReadValue<std::uint64_t>(delta.data() + position + 8);
+        position += kDeltaExtentHeaderSize;
+
+        if(delta.size() - position < size) {
+            return Err("The delta is truncated");
+        }
+
+        // The builder isn't streaming, staging only copies the bytes
+        static_cast<void>(builder.Stage(offset, delta.data() + position, static_cast<std::size_t>(size)));
+        position += static_cast<std::size_t>(size);
+    }
+
+    const auto validate_res = builder.Validate();
+    if(validate_res.isErr()) {
+        return Err(validate_res.unwrapErr());
+    }
+
+    return Ok(builder);
+}
+
+/**
+ * @brief
+ * Applies a delta on a base file and writes the result to the output path.
+ * The base is verified against the fingerprint of the delta, then cloned and
+ * only the extents of the delta are written to the clone.
+ *
+ * @param delta_path The delta file written by ExportDelta
+ * @param base_path The file the delta was created from
+ * @param output_path Where the patched image is written
+ * @return Result<bool, const char*> Ok if the output was written, otherwise an error message
+ */
+Result<bool, const char*> ImageBuilder::ApplyDelta(
+    const std::filesystem::path& delta_path,
+    const std::filesystem::path& base_path,
+    const std::filesystem::path& output_path
+)
+{
+    auto builder_res = LoadDelta(delta_path);
+    if(builder_res.isErr()) {
+        return Err(builder_res.unwrapErr());
+    }
+
+    auto builder = builder_res.unwrap();
+
+    auto base_res = FileMapping::Open(base_path);
+    if(base_res.isErr()) {
+        return Err(base_res.unwrapErr());
+    }
+
+    const auto base = base_res.unwrap();
+    if(base->Size() != builder.m_base_size || builder.BaseFingerprint(base->Span()) != builder.m_base_fingerprint) {
+        return Err("The delta was not created from this base");
+    }
+
+    return builder.CommitCopy(base_path, output_path, base->Span());
+}
@@ -0,0 +1,116 @@
+#include <ImportIndex.hpp>
+
+#include <bit>
+#include <cctype>
+
+#include <utl/Utl.hpp>
+
+namespace
+{
+    char ToLower(const char c)
+    {
+        return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+}
+
+std::size_t ImportIndex::KeyHash::operator()(const Key& key) const
+{
+    // FNV-1a over the lower case library name and the function name
+    auto hash = Utl::kFnv1aOffset;
+    for(const auto c : key.dll)
+    {
+        const auto lower = static_cast<std::uint8_t>(ToLower(c));
+        hash = Utl::Fnv1a64({ &lower, 1 }, hash);
+    }
+
+    constexpr std::uint8_t separator = '!';
+    hash = Utl::Fnv1a64({ &separator, 1 }, hash);
+    hash = Utl::Fnv1a64({ std::bit_cast<const std::uint8_t*>(key.function.data()), key.function.size() }, hash);
+
+    return static_cast<std::size_t>(hash);
+}
+
+bool ImportIndex::KeyEqual::operator()(const Key& a, const Key& b) const
+{
+    if(a.function != b.function || a.dll.size() != b.dll.size()) {
+        return false;
+    }
+
+    for(std::size_t i = 0; i < a.dll.size(); ++i)
+    {
+        if(ToLower(a.dll[i]) != ToLower(b.dll[i])) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief
+ * Builds the name used for the functions imported by ordinal. For example: #12
+ */
+std::string ImportIndex::OrdinalName(const std::uint16_t ordinal)
+{
+    return "#" + std::to_string(ordinal);
+}
+
+/**
+ * @brief
+ * Stores a copy of the name which will stay valid for as long as the index is alive.
+ * A name is only stored once, the libraries and the functions imported by several of them share it
+ *
+ * @param value The name to be stored
+ * @return std::string_view A view over the stored name
+ */
+std::string_view ImportIndex::Intern(std::string_view value)
+{
+    if(const auto it = m_interned.find(value); it != m_interned.end()) {
+        return *it;
+    }
+
+    const std::string_view interned = m_names.emplace_back(value);
+    m_interned.insert(interned);
+    return interned;
+}
+
+/**
+ * @brief
+ * Maps a function to the rva of its slot in the import address table.
+ * Both names must come from Intern. If the pair is already mapped, the first slot is kept
+ */
+void ImportIndex::Insert(const std::string_view interned_dll, const std::string_view interned_function, const std::uint32_t iat_rva)
+{
+    m_iat_rvas.emplace(Key{ interned_dll, interned_function }, iat_rva);
+}
+
+/**
+ * @brief
+ * Finds the slot of an imported function
+ *
+ * @param dll Name of the library, the case is ignored
+ * @param function Name of the function
+ * @return std::optional<std::uint32_t> The rva of the slot in the import address table or nullopt
+ */
+std::optional<std::uint32_t> ImportIndex::Find(const std::string_view dll, const std::string_view function) const
+{
+    const auto it = m_iat_rvas.find(Key{ dll, function });
+    if(it == m_iat_rvas.end()) {
+        return {};
+    }
+
+    return it->second;
+}
+
+/**
+ * @brief
+ * Finds the slot of a function imported by ordinal
+ *
+ * @param dll Name of the library, the case is ignored
+ * @param ordinal Ordinal of the function
+ * @return std::optional<std::uint32_t> The rva of the slot in the import address table or nullopt
+ */
+std::optional<std::uint32_t> ImportIndex::Find(const std::string_view dll, const std::uint16_t ordinal) const
+{
+    return Find(dll, OrdinalName(ordinal));
+}
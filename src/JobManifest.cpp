@@ -0,0 +1,92 @@
+#include <JobManifest.hpp>
+
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#include <utl/Utl.hpp>
+
+Result<std::vector<JobManifest::Entry>, const char*>
+JobManifest::Load(const std::filesystem::path& manifest_path)
+{
+    std::ifstream ifs(manifest_path);
+    if(!ifs.is_open()) {
+        return Err("The manifest could not be opened");
+    }
+
+    const auto base_directory = manifest_path.parent_path();
+
+    std::vector<Entry> entries;
+    std::string line;
+    while(std::getline(ifs, line))
+    {
+        const auto first = line.find_first_not_of(" \t\r");
+        if(first == std::string::npos || line[first] == '#') {
+            continue;
+        }
+
+        auto entry_res = ParseLine(line, base_directory);
+        if(entry_res.isErr()) {
+            return Err(entry_res.unwrapErr());
+        }
+
+        entries.push_back(entry_res.unwrap());
+    }
+
+    if(ifs.bad()) {
+        return Err("Reading the manifest failed");
+    }
+
+    return Ok(entries);
+}
+
+Result<JobManifest::Entry, const char*>
+JobManifest::ParseLine(const std::string_view line, const std::filesystem::path& base_directory)
+{
+    const auto resolve = [&](const std::string& path) {
+        const std::filesystem::path p{ path };
+        return p.is_relative() ? base_directory / p : p;
+    };
+
+    std::istringstream tokens{ std::string(line) };
+    std::string input, output;
+    if(!(tokens >> std::quoted(input)) || !(tokens >> std::quoted(output))) {
+        return Err("A line of the manifest is missing its output path");
+    }
+
+    Entry entry{ resolve(input), resolve(output), {} };
+
+    std::string rva_token, size_token;
+    while(tokens >> rva_token)
+    {
+        if(!(tokens >> size_token)) {
+            return Err("A region of the manifest is missing its size");
+        }
+
+        const auto rva = Utl::ParseHex(rva_token);
+        const auto size = Utl::ParseHex(size_token);
+        if(!rva || !size) {
+            return Err("A region of the manifest is not in hexadecimal");
+        }
+
+        entry.region_pairs.emplace_back(*rva, *size);
+    }
+
+    return Ok(entry);
+}
+
+std::string JobManifest::FormatLine(const Entry& entry)
+{
+    std::ostringstream line;
+    line << std::quoted(entry.input.string()) << ' ' << std::quoted(entry.output.string());
+
+    for(const auto& [rva, size] : entry.region_pairs) {
+        line << std::hex << " 0x" << rva << " 0x" << size;
+    }
+
+    return line.str();
+}
@@ -1,12 +1,23 @@
+#include <algorithm>
 #include <filesystem>
-#include <string_view>
+#include <fstream>
 #include <cstdint>
 #include <cstring>
-#include <iostream>
-
-#include <Translation.hpp>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <Cryptography.hpp>
+#include <Ignotum.h>
+#include <MappedMemory.hpp>
 #include <PeFile.hpp>
-#include <Assembler.hpp>
+#include <Protector.hpp>
+#include <RegionManifest.hpp>
+#include <ThreadPool.hpp>
 #include <result.h>
 
 #ifdef _WIN32
@@ -17,22 +28,15 @@
 #define DllExport __attribute__((visibility("default")))
 #endif
 
-#ifdef _WIN32
 #pragma pack(push, 1)
-#endif
-#ifdef __unix__
-__attribute__((packed));
-#endif
-struct Query 
+struct Query
 {
      const char* file_path; // Path of the file to be translated
      const char* vm_path; // Path to the virtual machine
      size_t region; // Array of address to find the code to be translated
      size_t region_size; // Size of the array
 };
-#ifdef _WIN32
 #pragma pack(pop)
-#endif
 
 enum class ObfuscateResult : std::uint32_t
 {
@@ -44,128 +48,378 @@ enum class ObfuscateResult : std::uint32_t
     kInvalidFunctionAddress
 };
 
-/**
- * @brief In charge of validating a given path. It will check if exists.
- * Then it will check if the file is valid and not a directory
- * If it's valid, a filesystem::path will be returned
- * 
- * @param file_path The path of the file to be checked
- * @return Result<std::filesystem::path, const char*>
- * Either a path for the given path string or an error message 
- */
-Result<std::filesystem::path, const char*> ValidateFile(const std::string_view& file_path)
+struct IgnotumSession
 {
-    std::filesystem::path p{file_path};
-
-    if(!std::filesystem::exists(p))
-        return Err("The file does not exist");
-    if(!std::filesystem::is_regular_file(p))
-        return Err("The format of the file is not valid");
-
-    return Ok(p);
-}
-
+    // A failed protection leaves the image half modified, the session can only be closed then
+    enum class State { OPEN, PROTECTED, WRITTEN, FAILED };
+
+    std::shared_ptr<PeFile> pe_file;
+    MappedMemory virtual_machine;
+    std::unique_ptr<ThreadPool> pool;
+    std::vector<RegionManifest::Entry> regions;
+    std::uint64_t key_seed;
+    std::uint64_t memory_budget;
+    std::filesystem::path work_directory; // Empty for the temporary directory of the system
+    std::size_t image_size{ 0 }; // Known once protected
+    State state{ State::OPEN };
+    const char* last_error{ "" };
+
+    IgnotumSession(std::shared_ptr<PeFile> _pe_file, MappedMemory _virtual_machine, const IgnotumOptions& options) :
+        pe_file(std::move(_pe_file)),
+        virtual_machine(std::move(_virtual_machine)),
+        key_seed(options.use_key_seed ? options.key_seed : cryptography::GenerateSeed()),
+        memory_budget(options.memory_budget),
+        work_directory(options.work_directory ? options.work_directory : "")
+    {}
+};
 
-std::optional<MappedMemory> LoadVirtualMachine(const char* path)
+namespace
 {
-    std::filesystem::path p{path};
-    std::ifstream ifs(p, std::ios::binary);
-    if(!ifs.is_open())
-        return {};
-
-    const auto file_size = std::filesystem::file_size(p);
-
-    auto mapped_memory_res = MappedMemory::Allocate(file_size);
-    if(mapped_memory_res.isErr())
-        return {};
-
-    const auto mapped_memory = mapped_memory_res.unwrap();
-    ifs.read(std::bit_cast<char*>(mapped_memory.InnerPtr().get()), file_size);
-
-    return mapped_memory;
+    IgnotumResult Fail(IgnotumSession* session, const IgnotumResult result, const char* message)
+    {
+        session->last_error = message;
+        return result;
+    }
+
+    IgnotumResult FailedSession(IgnotumSession* session)
+    {
+        return Fail(session, IGNOTUM_INVALID_STATE, "The protection failed, the session can only be closed");
+    }
+
+    // Nothing can be thrown across the C interface. An allocation failing in the translation
+    // or a thread that can't be started ends up here
+    template<class F>
+    IgnotumResult Guarded(IgnotumSession* session, F&& function)
+    {
+        try {
+            return function();
+        }
+        catch(const std::exception&) {
+            return session ? Fail(session, IGNOTUM_INTERNAL_ERROR, "An internal error occurred") : IGNOTUM_INTERNAL_ERROR;
+        }
+    }
+
+    // Work image of a session with a memory budget, named after a random value so several sessions can run at once.
+    // It's removed with the file of the session unless it's committed, which the sessions never do
+    std::filesystem::path WorkImagePath(const std::filesystem::path& work_directory)
+    {
+        const auto directory = work_directory.empty() ? std::filesystem::temp_directory_path() : work_directory;
+        return directory / ("ignotum-" + std::to_string(cryptography::GenerateSeed()) + ".ign-work");
+    }
+
+    std::optional<MappedMemory> CopyVirtualMachine(std::span<const std::uint8_t> virtual_machine)
+    {
+        auto mapped_memory = MappedMemory::Allocate(virtual_machine.size());
+        if(!mapped_memory) {
+            return {};
+        }
+
+        std::memcpy(mapped_memory->InnerPtrRaw(), virtual_machine.data(), virtual_machine.size());
+        return mapped_memory;
+    }
+
+    std::optional<MappedMemory> LoadVirtualMachine(const char* path)
+    {
+        std::error_code ec;
+        const std::filesystem::path p{ path };
+        if(!std::filesystem::is_regular_file(p, ec)) {
+            return {};
+        }
+
+        std::ifstream ifs(p, std::ios::binary);
+        if(!ifs.is_open()) {
+            return {};
+        }
+
+        const auto file_size = std::filesystem::file_size(p, ec);
+        if(ec) {
+            return {};
+        }
+
+        auto mapped_memory = MappedMemory::Allocate(file_size);
+        if(!mapped_memory) {
+            return {};
+        }
+
+        ifs.read(std::bit_cast<char*>(mapped_memory->InnerPtrRaw()), static_cast<std::streamsize>(file_size));
+        if(!ifs) {
+            return {};
+        }
+
+        return mapped_memory;
+    }
+
+    unsigned ThreadCount(const std::uint32_t requested)
+    {
+        if(requested != 0) {
+            return requested;
+        }
+
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
 }
 
-extern "C" DllExport ObfuscateResult Obfuscate(const Query* query)
+extern "C" DllExport IgnotumResult IgnotumOpenSession(
+    const uint8_t* image, size_t image_size,
+    const uint8_t* virtual_machine, size_t virtual_machine_size,
+    const IgnotumOptions* options,
+    IgnotumSession** session)
 {
-    const auto file_path = std::string_view(query->file_path);
-    const auto validate_path_res = ValidateFile(file_path);
-    if(validate_path_res.isErr())
-        return ObfuscateResult::kInvalidPath;
+    if(!image || image_size == 0 || !virtual_machine || virtual_machine_size == 0 || !session) {
+        return IGNOTUM_INVALID_ARGUMENT;
+    }
 
-    const auto path_handle_res = validate_path_res;
-    if(path_handle_res.isErr())
-        return ObfuscateResult::kInvalidPath;
-
-    const auto path_handle = path_handle_res.unwrap();
-
-    // Parse the exe file to begin the translation process
-    const auto pe_file_res = PeFile::Load(path_handle, PeFile::LoadOption::FULL_LOAD);
-    if(pe_file_res.isErr())
-        return ObfuscateResult::kInvalidFile;
-
-    auto pe_file = pe_file_res.unwrap();
+    *session = nullptr;
 
-    const auto virtual_machine_res = LoadVirtualMachine(query->vm_path);
-    if(!virtual_machine_res)
-        return ObfuscateResult::kVmNotFound;
+    return Guarded(nullptr, [&]() {
+        // Lazily loaded, the protection only needs the headers and the sections
+        const auto pe_file_res = PeFile::Load(std::span(image, image_size), PeFile::LoadOption::LAZY_LOAD);
+        if(pe_file_res.isErr()) {
+            return IGNOTUM_INVALID_IMAGE;
+        }
 
-    const auto virtual_machine = *virtual_machine_res;
+        auto vm_copy = CopyVirtualMachine(std::span(virtual_machine, virtual_machine_size));
+        if(!vm_copy) {
+            return IGNOTUM_INTERNAL_ERROR;
+        }
 
-    // Create the first region which will hold the virtual machine
-    // Write the vm to it
-    const auto ign1_region_res = pe_file->AddSection(".Ign1");
-    if(ign1_region_res.isErr())
-        return ObfuscateResult::kInvalidFile;
+        const IgnotumOptions default_options{};
+        const auto& session_options = options ? *options : default_options;
 
-    const auto ign1_region = ign1_region_res.unwrap();
-    pe_file->WriteToRegion(ign1_region.VirtualAddress, virtual_machine).unwrap();
+        auto new_session = std::make_unique<IgnotumSession>(pe_file_res.unwrap(), std::move(*vm_copy), session_options);
+        new_session->pool = std::make_unique<ThreadPool>(ThreadCount(session_options.threads));
 
-    // Create the second region which will hold all of the translated code
-    const auto ign2_region_res = pe_file->AddSection(".Ign2");
-    if(ign2_region_res.isErr())
-        return ObfuscateResult::kInvalidFile;
-
-    const auto ign2_region = ign2_region_res.unwrap();
-
-    // Go over the region specified to translate them
-    const auto block_size = query->region_size;
-    const auto start_address = query->region;
-
-    // Load that section of the file in memory to start going over the instructions
-    const auto instruction_block_res = pe_file->LoadRegion(start_address, block_size);
-    if(instruction_block_res.isErr())
-        return ObfuscateResult::kInvalidFunctionAddress;
+        *session = new_session.release();
+        return IGNOTUM_SUCCESS;
+    });
+}
 
-    auto instruction_block = instruction_block_res.unwrap();
+extern "C" DllExport IgnotumResult IgnotumAddRegions(IgnotumSession* session, const IgnotumRegion* regions, size_t region_count)
+{
+    if(!session || (!regions && region_count != 0)) {
+        return IGNOTUM_INVALID_ARGUMENT;
+    }
+
+    if(session->state == IgnotumSession::State::FAILED) {
+        return FailedSession(session);
+    }
+
+    if(session->state != IgnotumSession::State::OPEN) {
+        return Fail(session, IGNOTUM_INVALID_STATE, "The regions must be added before the image is protected");
+    }
+
+    return Guarded(session, [&]() {
+        session->regions.reserve(session->regions.size() + region_count);
+        for(const auto& region : std::span(regions, region_count))
+        {
+            if(region.size == 0) {
+                return Fail(session, IGNOTUM_INVALID_REGION, "A region is empty");
+            }
+
+            session->regions.push_back(RegionManifest::Entry{ region.rva, region.size, {}, false });
+        }
+
+        return IGNOTUM_SUCCESS;
+    });
+}
 
-    // Translated the block and then write it in it's region block which is 'Ign2'
-    const auto translated_block_res = Translation::TranslateInstructionBlock(instruction_block);
-    if(translated_block_res.isErr())
-        return ObfuscateResult::kInvalidFunctionAddress;
-        
+extern "C" DllExport IgnotumResult IgnotumProtect(IgnotumSession* session, size_t* image_size)
+{
+    if(!session) {
+        return IGNOTUM_INVALID_ARGUMENT;
+    }
+
+    if(session->state == IgnotumSession::State::FAILED) {
+        return FailedSession(session);
+    }
+
+    if(session->state != IgnotumSession::State::OPEN) {
+        return Fail(session, IGNOTUM_INVALID_STATE, "The image was already protected");
+    }
+
+    return Guarded(session, [&]() {
+        // Every region of every call is checked at once, each one keeps its own entry
+        const auto region_index_res = Protector::IndexRegions(session->regions, *session->pe_file);
+        if(region_index_res.isErr()) {
+            return Fail(session, IGNOTUM_INVALID_REGION, region_index_res.unwrapErr());
+        }
+
+        // The image is modified from here on, the session stays failed unless the protection goes through
+        session->state = IgnotumSession::State::FAILED;
+
+        // Under a memory budget nothing staged stays in memory, the protected image is built in a work file
+        if(session->memory_budget != 0)
+        {
+            const auto stream_res = session->pe_file->StreamTo(WorkImagePath(session->work_directory));
+            if(stream_res.isErr()) {
+                return Fail(session, IGNOTUM_INTERNAL_ERROR, stream_res.unwrapErr());
+            }
+        }
+
+        const auto protected_res = Protector::ProtectRegions(
+            session->pe_file,
+            region_index_res.unwrap().Pairs(),
+            session->virtual_machine,
+            *session->pool,
+            session->key_seed,
+            nullptr,
+            nullptr,
+            session->memory_budget
+        );
+
+        if(protected_res.isErr()) {
+            return Fail(session, IGNOTUM_PROTECTION_FAILED, protected_res.unwrapErr());
+        }
+
+        session->image_size = session->pe_file->ImageSize();
+        session->state = IgnotumSession::State::PROTECTED;
+        if(image_size) {
+            *image_size = session->image_size;
+        }
+
+        return IGNOTUM_SUCCESS;
+    });
+}
 
-    const auto translated_block = translated_block_res.unwrap();
-    pe_file->WriteToRegion(ign2_region.VirtualAddress, translated_block);
+extern "C" DllExport IgnotumResult IgnotumWriteImage(IgnotumSession* session, IgnotumWriteCallback callback, void* user_data)
+{
+    if(!session || !callback) {
+        return IGNOTUM_INVALID_ARGUMENT;
+    }
+
+    if(session->state == IgnotumSession::State::FAILED) {
+        return FailedSession(session);
+    }
+
+    // The staged modifications are consumed by the write, the image can only be given back once
+    if(session->state != IgnotumSession::State::PROTECTED) {
+        return Fail(session, IGNOTUM_INVALID_STATE, "The image is not protected or was already written");
+    }
+
+    return Guarded(session, [&]() {
+        bool stopped{ false };
+        const auto write_res = session->pe_file->CommitTo([&](std::span<const std::uint8_t> chunk) {
+            stopped = callback(user_data, chunk.data(), chunk.size()) == 0;
+            return !stopped;
+        });
+
+        session->state = IgnotumSession::State::WRITTEN;
+        if(write_res.isErr()) {
+            return Fail(session, stopped ? IGNOTUM_WRITE_FAILED : IGNOTUM_INTERNAL_ERROR, write_res.unwrapErr());
+        }
+
+        return IGNOTUM_SUCCESS;
+    });
+}
 
-    // Calculate the offset of the virtual block relative to the start address of the virtual machine
-    // Then, generate the instruction to push it on the stack
-    const auto section_offset = ign2_region.VirtualAddress - ign1_region.VirtualAddress;
-    if(!X64::Generator::PushX32(instruction_block, section_offset))
-        return ObfuscateResult::kBufferTooSmall;
+extern "C" DllExport IgnotumResult IgnotumCopyImage(IgnotumSession* session, uint8_t* buffer, size_t buffer_size)
+{
+    if(!session || !buffer) {
+        return IGNOTUM_INVALID_ARGUMENT;
+    }
+
+    // Checked before anything is written, the caller can retry with a bigger buffer
+    if(session->state == IgnotumSession::State::PROTECTED && buffer_size < session->image_size) {
+        return Fail(session, IGNOTUM_BUFFER_TOO_SMALL, "The buffer can't hold the protected image");
+    }
+
+    struct Cursor
+    {
+        uint8_t* data;
+        size_t remaining;
+    } cursor{ buffer, buffer_size };
+
+    return IgnotumWriteImage(session, [](void* user_data, const uint8_t* data, size_t size) {
+        auto* cursor = static_cast<Cursor*>(user_data);
+        if(size > cursor->remaining) {
+            return 0;
+        }
+
+        std::memcpy(cursor->data, data, size);
+        cursor->data += size;
+        cursor->remaining -= size;
+        return 1;
+    }, &cursor);
+}
 
-    // Calculate the offset of the virtual machine entry relative to the function we're in right now
-    // Then, generate the instruction to call that relative offset
-    const auto call_offset = ign1_region.VirtualAddress - (start_address + instruction_block.CursorPos());
-    if(!X64::Generator::CallNear(instruction_block, call_offset))
-        return ObfuscateResult::kBufferTooSmall;
+extern "C" DllExport uint64_t IgnotumKeySeed(const IgnotumSession* session)
+{
+    return session ? session->key_seed : 0;
+}
 
-    // Fill the rest of the function with NOP instructions for now.
-    // A mutation engine should be created in the future to put valid instructions
-    const auto size_remaining = instruction_block.Size() - instruction_block.CursorPos();
-    std::memset(instruction_block.InnerPtr().get() + instruction_block.CursorPos(), '\x90', size_remaining);
+extern "C" DllExport const char* IgnotumLastError(const IgnotumSession* session)
+{
+    return session ? session->last_error : "";
+}
 
-    // Write back the original patched function
-    pe_file->WriteToRegion(start_address, instruction_block);
+extern "C" DllExport void IgnotumCloseSession(IgnotumSession* session)
+{
+    delete session;
+}
 
-    return ObfuscateResult::kSuccess;
+/**
+ * @brief
+ * Protects a single region of a file in place. Kept for the callers of the first version of the library,
+ * the sessions protect any amount of regions from memory.
+ *
+ * @param query The file, the virtual machine and the region to protect
+ * @return ObfuscateResult kSuccess or the reason it failed
+ */
+extern "C" DllExport ObfuscateResult Obfuscate(const Query* query)
+{
+    if(!query || !query->file_path || !query->vm_path) {
+        return ObfuscateResult::kInvalidPath;
+    }
+
+    try
+    {
+        std::error_code ec;
+        const std::filesystem::path file_path{ query->file_path };
+        if(!std::filesystem::is_regular_file(file_path, ec)) {
+            return ObfuscateResult::kInvalidPath;
+        }
+
+        const auto pe_file_res = PeFile::Load(file_path, PeFile::LoadOption::LAZY_LOAD, PeFile::AccessMode::MEMORY_MAPPED);
+        if(pe_file_res.isErr()) {
+            return ObfuscateResult::kInvalidFile;
+        }
+
+        auto pe_file = pe_file_res.unwrap();
+
+        const auto virtual_machine = LoadVirtualMachine(query->vm_path);
+        if(!virtual_machine) {
+            return ObfuscateResult::kVmNotFound;
+        }
+
+        const std::vector<RegionManifest::Entry> entries{
+            RegionManifest::Entry{ static_cast<std::uint32_t>(query->region), static_cast<std::uint32_t>(query->region_size), {}, false }
+        };
+
+        const auto region_index_res = Protector::IndexRegions(entries, *pe_file);
+        if(region_index_res.isErr()) {
+            return ObfuscateResult::kInvalidFunctionAddress;
+        }
+
+        ThreadPool pool(1);
+        const auto protected_res = Protector::ProtectRegions(
+            pe_file,
+            region_index_res.unwrap().Pairs(),
+            *virtual_machine,
+            pool,
+            cryptography::GenerateSeed()
+        );
+
+        if(protected_res.isErr()) {
+            return ObfuscateResult::kInvalidFunctionAddress;
+        }
+
+        if(pe_file->Commit().isErr()) {
+            return ObfuscateResult::kInvalidFile;
+        }
+
+        return ObfuscateResult::kSuccess;
+    }
+    catch(const std::exception&) {
+        return ObfuscateResult::kInvalidFile;
+    }
 }
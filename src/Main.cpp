@@ -8,6 +8,12 @@
 #include <cstring>
 #include <cstdint>
 #include <random>
+#include <limits>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <span>
+#include <mutex>
 
 #include <Main.hpp>
 #include <Translation.hpp>
@@ -17,14 +23,22 @@
 #include <NativeEmitter/x64NativeEmitter.hpp>
 #include <TranslationContext.hpp>
 #include <Cryptography.hpp>
+#include <JobManifest.hpp>
+#include <RegionManifest.hpp>
+#include <RegionIndex.hpp>
+#include <ThreadPool.hpp>
+#include <TranslationCache.hpp>
+#include <TranslationLog.hpp>
+#include <BuildLayout.hpp>
+#include <ProtectionServer.hpp>
+#include <Protector.hpp>
+#include <utl/Utl.hpp>
 
 #include <result.h>
 #include <Zydis/Zydis.h>
 #include <argparse/argparse.hpp>
 #include <spdlog/spdlog.h>
 
-#define DEBUG
-
 /**
  * @brief
  * Displays a messages before quiting.
@@ -34,6 +48,7 @@
  */
 [[noreturn]] inline void Panic(const char* msg)
 {
+    TranslationLog::Shutdown();
     std::puts(msg);
     std::exit(-1);
 }
@@ -91,26 +106,168 @@ ValidateFile(const std::string& file_path)
 
 /**
  * @brief Given a vector of n amount of size_t, this function check if the size of it is big enough for pairs
- * by using modulo. If the format is correct, they are then but in pairs to make them more readable when processing
+ * by using modulo. If the format is correct, they are then but in pairs to make them more readable when processing.
+ * Overlaps and section membership are checked later by RegionIndex, once the file is loaded
  *
  * @param vec The vector containing all of the addresses and the size of them
- * @return Result<std::vector<std::pair<std::size_t, std::size_t>>, const char*>
- * A vector of pair is returned is it was successful, otherwise, an error message is returned
+ * @return Result<std::vector<RegionManifest::Entry>, const char*>
+ * The regions are returned is it was successful, otherwise, an error message is returned
  */
-Result<std::vector<std::pair<std::size_t, std::size_t>>, const char*>
+Result<std::vector<RegionManifest::Entry>, const char*>
 ValidateRegions(const std::vector<std::size_t> &vec)
 {
     if(vec.size() % 2 != 0) {
         return Err("The format of the regions is invalid");
     }
 
-    std::vector<std::pair<std::size_t, std::size_t>> pairs;
-    for(auto i = 0; i < vec.size() - 1; i += 2)
+    std::vector<RegionManifest::Entry> regions;
+    regions.reserve(vec.size() / 2);
+    for(std::size_t i = 0; i + 1 < vec.size(); i += 2)
+    {
+        if(vec[i] > std::numeric_limits<std::uint32_t>::max() || vec[i+1] > std::numeric_limits<std::uint32_t>::max()) {
+            return Err("A region does not fit in 32 bits");
+        }
+
+        regions.push_back(RegionManifest::Entry{
+            static_cast<std::uint32_t>(vec[i]),
+            static_cast<std::uint32_t>(vec[i+1]),
+            {},
+            false
+        });
+    }
+
+    return Ok(regions);
+}
+
+/**
+ * @brief
+ * Gathers the regions given with --block and the ones listed in the --regions manifest
+ *
+ * @param cmd_args The parsed command line
+ * @return Result<std::vector<RegionManifest::Entry>, const char*> Every region in the order given or an error message
+ */
+Result<std::vector<RegionManifest::Entry>, const char*>
+CollectRegions(const argparse::ArgumentParser& cmd_args)
+{
+    const auto regions = cmd_args.present<std::vector<std::uint64_t>>("--block")
+                            .value_or(std::vector<std::uint64_t>{});
+    const auto block_regions_res = ValidateRegions(regions);
+    if(block_regions_res.isErr()) {
+        return Err("Failed to pair the regions");
+    }
+
+    auto job_regions = block_regions_res.unwrap();
+
+    // The regions listed in a manifest are checked and added to the ones from --block
+    if(const auto manifest_path = cmd_args.present<std::string>("--regions"))
+    {
+        const auto manifest_res = RegionManifest::Load(*manifest_path);
+        if(manifest_res.isErr()) {
+            return Err(manifest_res.unwrapErr());
+        }
+
+        const auto manifest_regions = manifest_res.unwrap();
+        job_regions.insert(job_regions.end(), manifest_regions.begin(), manifest_regions.end());
+    }
+
+    return Ok(job_regions);
+}
+
+/**
+ * @brief
+ * Reads the options selecting the functions to discover from the command line.
+ * The selection is shared by every file of a batch.
+ * @param cmd_args The parsed command line
+ * @return Result<mainspace::FunctionSelection, const char*> The selection or an error message
+ */
+Result<mainspace::FunctionSelection, const char*>
+ParseFunctionSelection(const argparse::ArgumentParser& cmd_args)
+{
+    mainspace::FunctionSelection selection;
+    selection.scan_prologues = cmd_args.get<bool>("--scan-prologues");
+    selection.enabled =
+        selection.scan_prologues ||
+        cmd_args.is_used("--function-range") ||
+        cmd_args.is_used("--function-min-size") ||
+        cmd_args.is_used("--function-count");
+
+    auto& selector = selection.selector;
+    if(const auto range = cmd_args.present<std::vector<std::uint64_t>>("--function-range"))
+    {
+        if(range->size() != 2 || (*range)[0] > (*range)[1] || (*range)[1] > std::numeric_limits<std::uint32_t>::max()) {
+            return Err("The function range is invalid");
+        }
+
+        selector.range_begin = static_cast<std::uint32_t>((*range)[0]);
+        selector.range_end = static_cast<std::uint32_t>((*range)[1]);
+    }
+
+    if(const auto min_size = cmd_args.present<std::uint32_t>("--function-min-size")) {
+        selector.min_size = *min_size;
+    }
+
+    if(const auto count = cmd_args.present<std::size_t>("--function-count")) {
+        selector.max_count = *count;
+    }
+
+    // A smaller function can't hold the instructions entering the virtual machine
+    selector.min_size = std::max(selector.min_size, mainspace::MIN_REGION_SIZE - 1);
+
+    return Ok(selection);
+}
+
+/**
+ * @brief
+ * Picks the regions to translate from the functions of the exception directory,
+ * using the given selection. A function overlapping a region that was given
+ * explicitly is skipped.
+ * @param pe_file The file being protected
+ * @param selection The selection parsed from the command line
+ * @param explicit_regions The regions given with --block, --regions or in the batch manifest
+ * @return Result<std::vector<std::pair<std::size_t, std::size_t>>, const char*>
+ * The selected regions as (rva, size) pairs or an error message
+ */
+Result<std::vector<std::pair<std::size_t, std::size_t>>, const char*>
+SelectFunctionRegions(
+    const std::shared_ptr<PeFile>& pe_file,
+    const mainspace::FunctionSelection& selection,
+    const RegionIndex& explicit_regions
+)
+{
+    const FunctionIndex* functions{ nullptr };
+    if(!selection.scan_prologues)
     {
-        pairs.emplace_back(std::make_pair(vec[i], vec[i+1]));
+        const auto functions_res = pe_file->GetFunctions();
+        if(functions_res.isErr()) {
+            return Err(functions_res.unwrapErr());
+        }
+
+        functions = functions_res.unwrap();
     }
 
-    return Ok(pairs);
+    // Without an exception directory, the functions are found from their prologues
+    FunctionIndex scanned_functions;
+    if(selection.scan_prologues || functions->Empty())
+    {
+        auto scan_res = pe_file->ScanFunctions();
+        if(scan_res.isErr()) {
+            return Err(scan_res.unwrapErr());
+        }
+
+        scanned_functions = scan_res.unwrap();
+        functions = &scanned_functions;
+        spdlog::info("{} functions found by scanning the prologues", functions->Size());
+    }
+
+    std::vector<std::pair<std::size_t, std::size_t>> regions;
+    for(const auto& function : functions->Select(selection.selector))
+    {
+        if(!explicit_regions.Overlaps(function.begin, function.end)) {
+            regions.emplace_back(function.begin, function.Size());
+        }
+    }
+
+    return Ok(regions);
 }
 
 /**
@@ -173,20 +330,89 @@ InitAndParseCmdArgs(int argc, char** argv)
 {
     argparse::ArgumentParser arg_parser("Project Ignotum");
 
+    // Required unless a batch is given or a server is started, which is verified after parsing
     arg_parser.add_argument("--input", "-i")
-        .help("Path of the file to be translated")
-        .required();
+        .help("Path of the file to be translated");
+
+    arg_parser.add_argument("--batch")
+        .help("Path of a manifest listing the files to protect, one per line: [input] [output] [address size]...");
+
+    arg_parser.add_argument("--output", "-o")
+        .help("Path of the protected file. The input is modified in place when it's not specified");
+
+    arg_parser.add_argument("--delta")
+        .help("Write the modifications to a delta file instead of writing the protected file");
+
+    arg_parser.add_argument("--serve")
+        .help("Listen on a Unix domain socket and protect the jobs submitted to it. The virtual machine is loaded once for all of them");
+
+    arg_parser.add_argument("--submit")
+        .help("Submit the input to the server listening on a Unix domain socket instead of protecting it in this process. "
+              "Only the input, the output and the regions are sent, --delta, --layout, --seed and --previous can't be used with it");
+
+    arg_parser.add_argument("--apply-delta")
+        .help("Apply a delta file on the input and write the result to the output. No translation is done");
+
+    arg_parser.add_argument("--seed")
+        .help("Seed every key is derived from, in hexadecimal. The same seed always gives the same output. A random one is drawn without it")
+        .scan<'x', std::uint64_t>();
+
+    arg_parser.add_argument("--layout")
+        .help("Write the layout of the protected file, used to update it incrementally with the next build");
 
+    arg_parser.add_argument("--previous")
+        .help("Previous protected build of the input. The regions that didn't change keep their code and keys");
+
+    arg_parser.add_argument("--previous-layout")
+        .help("Layout written with the previous build, required with --previous");
+
+    arg_parser.add_argument("--cache")
+        .help("Directory caching the translated regions between runs. It can be shared by concurrent runs");
+
+    arg_parser.add_argument("--memory-budget")
+        .help("Memory the translation can use at once, in megabytes. The image is built in a work file next to the output and a region that can't fit fails the protection")
+        .scan<'u', std::uint64_t>();
+
+    arg_parser.add_argument("--translation-log")
+        .help("Log the translation: 'debug' logs every native instruction, 'trace' every virtual instruction as well")
+        .default_value(std::string("off"));
+
+    arg_parser.add_argument("--jobs", "-j")
+        .help("Amount of threads translating the regions. 0 uses every core")
+        .scan<'u', unsigned>()
+        .default_value(1u);
+
+    // Both are required unless a delta is applied, which is verified after parsing
     arg_parser.add_argument("--vm")
-        .help("Path of the virtual machine")
-        .required();
+        .help("Path of the virtual machine");
 
     arg_parser.add_argument("--block", "-b")
         .help("Used to specify the block to be translated. The format used is: --block [address] [size]")
         .scan<'x', std::uint64_t>()
         .nargs(2)
-        .append()
-        .required();
+        .append();
+
+    arg_parser.add_argument("--regions")
+        .help("Path of a region manifest, one region per line: [address] [size] [name=...] [merge=yes]");
+
+    // The functions are discovered from the exception directory, any of these enables the discovery
+    arg_parser.add_argument("--function-range")
+        .help("Translate the functions inside of a range of rvas. The format used is: --function-range [begin] [end]")
+        .scan<'x', std::uint64_t>()
+        .nargs(2);
+
+    arg_parser.add_argument("--function-min-size")
+        .help("Translate the functions bigger than this amount of bytes")
+        .scan<'u', std::uint32_t>();
+
+    arg_parser.add_argument("--function-count")
+        .help("Translate at most this many functions, by ascending rva")
+        .scan<'u', std::size_t>();
+
+    arg_parser.add_argument("--scan-prologues")
+        .help("Find the functions by scanning the code for prologues instead of using the exception directory")
+        .default_value(false)
+        .implicit_value(true);
 
     try
     {
@@ -204,117 +430,376 @@ InitAndParseCmdArgs(int argc, char** argv)
 
 /**
  * @brief
- * This function goes over all of the provided virtual addresses and loads the regions
- * in memory. Once loaded, these regions are then translated to the custom p-code
+ * Loads a previous protected build of the program with the layout written along with it.
  *
- * @param proc_context
- * @return int The value 0 is returned to indicate a success
+ * @param output_path The previous protected file
+ * @param layout_path The layout written when it was protected
+ * @return Result<mainspace::PreviousBuild, const char*> The build or an error message
  */
-int BeginTranslationProcess(const mainspace::BeginProcessContext& proc_context)
+Result<mainspace::PreviousBuild, const char*>
+LoadPreviousBuild(const std::filesystem::path& output_path, const std::filesystem::path& layout_path)
 {
-    // Keeps track of where we're at in the virtual code section
-    // The section can't grow more than 4.2gb because of the windows header definition
-    std::uint32_t vcode_offset{0};
+    auto layout_res = BuildLayout::Load(layout_path);
+    if(layout_res.isErr()) {
+        return Err(layout_res.unwrapErr());
+    }
+
+    auto image_res = PeFile::Load(output_path, PeFile::LoadOption::LAZY_LOAD, PeFile::AccessMode::MEMORY_MAPPED);
+    if(image_res.isErr()) {
+        return Err(image_res.unwrapErr());
+    }
+
+    mainspace::PreviousBuild previous{ layout_res.unwrap(), image_res.unwrap(), {} };
+
+    const auto& sections = previous.image->GetSections();
+    const bool has_vcode_section = std::any_of(sections.begin(), sections.end(), [&](const Win32::IMAGE_SECTION_HEADER& section) {
+        return section.VirtualAddress == previous.layout.vcode_rva &&
+               std::memcmp(section.Name, ".Ign2", 5) == 0;
+    });
+
+    if(!has_vcode_section) {
+        return Err("The previous build does not match its layout");
+    }
+
+    const auto vcode_res = previous.image->RegionView(previous.layout.vcode_rva, previous.layout.vcode_size);
+    if(vcode_res.isErr()) {
+        return Err(vcode_res.unwrapErr());
+    }
+
+    previous.vcode = vcode_res.unwrap();
+    return Ok(previous);
+}
+
+/**
+ * @brief
+ * Protects one file from start to end: the regions are selected, translated,
+ * the sections are added and the result is written where the job asks for it.
+ * Nothing is written if anything fails.
+ *
+ * @param job The file to protect
+ * @param virtual_machine The virtual machine blob. Only read, it's shared by every file of a batch
+ * @param pool Pool translating the regions
+ * @return Result<bool, const char*> Ok or an error message
+ */
+Result<bool, const char*> ProtectFile(
+    const mainspace::ProtectJob& job,
+    const MappedMemory& virtual_machine,
+    ThreadPool& pool
+)
+{
+    const auto path_handle_res = ValidateFile(job.input.string());
+    if(!path_handle_res) {
+        return Err("The input file provided is not valid");
+    }
+
+    // Parse the exe file to begin the translation process
+    // The imports are not loaded right now because the API hollowing is not yet available
+    // The file is memory mapped, so the regions are handed out without copying them
+    auto pe_file_res = PeFile::Load(
+        path_handle_res.value(),
+        PeFile::LoadOption::LAZY_LOAD,
+        PeFile::AccessMode::MEMORY_MAPPED
+    );
+    if(pe_file_res.isErr()) {
+        return Err(pe_file_res.unwrapErr());
+    }
 
-    auto native_emitter = std::make_shared<x64NativeEmitter>();
+    auto pe_file = pe_file_res.unwrap();
+
+    // The explicit regions are sorted, checked against the sections and merged when they are adjacent and allow it
+    const auto region_index_res = Protector::IndexRegions(job.regions, *pe_file);
+    if(region_index_res.isErr()) {
+        return Err(region_index_res.unwrapErr());
+    }
+
+    const auto region_index = region_index_res.unwrap();
+    if(region_index.Size() != job.regions.size()) {
+        spdlog::info("{}: {} regions merged into {}", job.input.string(), job.regions.size(), region_index.Size());
+    }
 
-    // Go over every region specified to translated them
-    for(const auto& pair : proc_context.region_pairs)
+    auto region_pairs = region_index.Pairs();
+
+    // The functions picked from the exception directory are translated after the explicit blocks
+    if(job.functions.enabled)
     {
-        const auto block_size = pair.second;
-        const auto start_address = pair.first;
-
-        Translation::Context context(
-            start_address, // Rva of the original instructions to maybe do some fixups for relative addressing
-            block_size, // The size of the block
-            proc_context.vm_section.VirtualAddress, // Pass the start of the vm RVA and the size of it
-            proc_context.vm_section.SizeOfRawData,
-            proc_context.vcode_section.VirtualAddress + vcode_offset, // Pass where we currently at in the virtualized code section
-            proc_context.vcode_section.SizeOfRawData - vcode_offset // Substract the offset to keep a accurate size
-        );
-
-#ifdef DEBUG
-        spdlog::info("Start RVA: 0x{:X}", start_address);
-        spdlog::info("Block size: 0x{:X}", block_size);
-#endif
-        // Load that section of the file in memory to start going over the instructions
-        auto instruction_block = proc_context.pe_file->LoadRegion(start_address, block_size)
-                .expect("The provided address could not be loaded in memory");
-
-        // Translate the whole instruction block. The p-code should be returned
-        // From this function.
-        const auto translated_block_res = Translation::TranslateInstructionBlock(
-            instruction_block, native_emitter, context
-        );
-
-        if(!translated_block_res) {
-            Panic("The translation failed");
-        }
-
-        /*
-        Everything was translated succesfully, write it to the '.Ign2' section
-        Inside the pe file.
-        */
-        const auto ign2_write_res = proc_context.pe_file->WriteToRegionPos(
-            context.vcode_block_rva,
-            translated_block_res.value()
-        );
-
-        if(ign2_write_res.isErr()) {
-            spdlog::critical("Writing to section failed with msg: {}", ign2_write_res.unwrapErr());
-            return -1;
+        const auto function_regions_res = SelectFunctionRegions(pe_file, job.functions, region_index);
+        if(function_regions_res.isErr()) {
+            return Err(function_regions_res.unwrapErr());
+        }
+
+        const auto function_regions = function_regions_res.unwrap();
+        region_pairs.insert(region_pairs.end(), function_regions.begin(), function_regions.end());
+        spdlog::info("{}: {} functions selected", job.input.string(), function_regions.size());
+    }
+
+    // In incremental mode, the regions that didn't change are taken from the previous build
+    std::optional<mainspace::PreviousBuild> previous;
+    if(job.previous_output && job.previous_layout)
+    {
+        auto previous_res = LoadPreviousBuild(*job.previous_output, *job.previous_layout);
+        if(previous_res.isErr()) {
+            return Err(previous_res.unwrapErr());
         }
 
-        // Update the offset with the size of the translated block
-        vcode_offset += translated_block_res.value().CursorPos();
+        previous.emplace(previous_res.unwrap());
+    }
+
+    // Under a memory budget nothing staged stays in memory, the image is built in a work image
+    // next to where it ends up and renamed there once it's complete
+    if(job.memory_budget != 0)
+    {
+        auto work_path = job.delta ? *job.delta : job.output ? *job.output : job.input;
+        work_path += ".ign-work";
+
+        const auto stream_res = pe_file->StreamTo(work_path);
+        if(stream_res.isErr()) {
+            return Err(stream_res.unwrapErr());
+        }
+    }
+
+    const auto protected_res = Protector::ProtectRegions(
+        pe_file,
+        region_pairs,
+        virtual_machine,
+        pool,
+        job.key_seed,
+        job.cache,
+        previous ? &previous.value() : nullptr,
+        job.memory_budget
+    );
+
+    if(protected_res.isErr()) {
+        return Err(protected_res.unwrapErr());
+    }
+
+    const auto protected_image = protected_res.unwrap();
+
+    // The seed the keys were derived from, which is the one of the previous build when its regions were kept
+    spdlog::info("{}: key seed 0x{:X}", job.input.string(), protected_image.key_seed);
+
+    // The modifications can be shipped as a delta, which is applied later with --apply-delta
+    // Otherwise, the staged modifications can now be written to the file.
+    // With an output path, the input is cloned and only the modified bytes are written to the clone
+    const auto commit_res = job.delta ? pe_file->ExportDelta(*job.delta) :
+                            job.output ? pe_file->Commit(*job.output) :
+                            pe_file->Commit();
+    if(commit_res.isErr() || !job.layout) {
+        return commit_res;
+    }
+
+    // The layout lets the next build of the program keep the regions that don't change
+    BuildLayout layout;
+    layout.key_seed = protected_image.key_seed;
+    layout.vm_rva = protected_image.vm_section.VirtualAddress;
+    layout.vm_size = protected_image.vm_size;
+    layout.vcode_rva = protected_image.vcode_section.VirtualAddress;
+    layout.vcode_size = protected_image.vcode_size;
+    layout.vm_hash = protected_image.vm_hash;
+    layout.translator_version = Translation::TRANSLATOR_VERSION;
+
+    for(const auto& region : protected_image.regions)
+    {
+        layout.AddRegion(BuildLayout::Region{
+            region.rva,
+            region.size,
+            region.source_hash,
+            region.vcode_offset,
+            region.vcode_size
+        });
+    }
+
+    return layout.Save(*job.layout);
+}
+
+/**
+ * @brief
+ * Turns a line of a batch manifest, or a job submitted to the server, into a job
+ *
+ * @param entry The file and its regions
+ * @param selection The selection used when the entry lists no region
+ * @param key_seed Seed of the keys of the file
+ * @param cache Cache of translated blocks, can be null
+ * @param memory_budget Bytes the translation can use at once, unbounded when it's 0
+ * @return Result<mainspace::ProtectJob, const char*> The job or an error message
+ */
+Result<mainspace::ProtectJob, const char*> MakeManifestJob(
+    const JobManifest::Entry& entry,
+    const mainspace::FunctionSelection& selection,
+    const std::uint64_t key_seed,
+    const TranslationCache* cache,
+    const std::uint64_t memory_budget
+)
+{
+    // A file without any region gets its functions discovered, even without a selection
+    auto functions = selection;
+    functions.enabled = functions.enabled || entry.region_pairs.empty();
 
-        // Write the patched instructions to the buffer to patch the region
-        const std::uint32_t section_offset_raw = context.vcode_block_rva - proc_context.vm_section.VirtualAddress;
-        if(section_offset_raw > std::numeric_limits<std::uint16_t>::max()) {
-            Panic("The section offset is too big");
+    std::vector<RegionManifest::Entry> regions;
+    regions.reserve(entry.region_pairs.size());
+    for(const auto& [rva, size] : entry.region_pairs)
+    {
+        if(rva > std::numeric_limits<std::uint32_t>::max() || size > std::numeric_limits<std::uint32_t>::max()) {
+            return Err("A region does not fit in 32 bits");
         }
 
-        // Generate a unique key to encode the VIP(virtual instruction pointer)
-        const auto enc_key = cryptography::Generate16BitKey();
-        const std::uint32_t encoded_section_offset = cryptography::EncodeVIPEntry(section_offset_raw, enc_key);
+        regions.push_back(RegionManifest::Entry{ static_cast<std::uint32_t>(rva), static_cast<std::uint32_t>(size), {}, false });
+    }
+
+    mainspace::ProtectJob job{ entry.input, entry.output, {}, std::move(regions), functions, key_seed, cache };
+    job.memory_budget = memory_budget;
 
-        /// Patching section.
-        /// This part is in charge of removing the original instructions with
-        /// NOPs.
+    return Ok(job);
+}
 
-        // Emit a push instruction with the encoded value containing the
-        // offset of where the vip should start
-        // In x86, this would look like this [push 0xdeadbeef]
-        if(!native_emitter->EmitPush32Bit(encoded_section_offset, instruction_block)) {
-            Panic("The buffer is too small to call the virtual machine");
+/**
+ * @brief
+ * Protects every file of a batch manifest in this process. The files are queued on the pool
+ * and split in regions there, so a big file is spread over the threads left idle by the small ones.
+ *
+ * @param manifest_path Path of the manifest
+ * @param selection The selection used for the files listing no region
+ * @param virtual_machine The virtual machine blob, shared by every file
+ * @param pool Pool running the files and their regions
+ * @param key_seed Seed of the keys, shared by every file
+ * @param cache Cache of translated blocks shared by every file, can be null
+ * @param memory_budget Bytes a file can use at once, the files are protected one at a time when it's set
+ * @return int The value 0 is returned when every file was protected
+ */
+int RunBatch(
+    const std::filesystem::path& manifest_path,
+    const mainspace::FunctionSelection& selection,
+    const MappedMemory& virtual_machine,
+    ThreadPool& pool,
+    const std::uint64_t key_seed,
+    const TranslationCache* cache,
+    const std::uint64_t memory_budget
+)
+{
+    const auto entries_res = JobManifest::Load(manifest_path);
+    if(entries_res.isErr()) {
+        spdlog::critical("Loading the manifest failed with msg: {}", entries_res.unwrapErr());
+        return -1;
+    }
+
+    const auto entries = entries_res.unwrap();
+
+    std::vector<mainspace::ProtectJob> jobs;
+    jobs.reserve(entries.size());
+    for(const auto& entry : entries)
+    {
+        auto job_res = MakeManifestJob(entry, selection, key_seed, cache, memory_budget);
+        if(job_res.isErr()) {
+            spdlog::critical("{}: {}", entry.input.string(), job_res.unwrapErr());
+            return -1;
         }
 
-        // Calculate the distance from the rva to the virtual machine inside the file
-        // This offset will be used to generate a call inside the virtual machine
-        const auto call_offset = proc_context.vm_section.VirtualAddress - (pair.first + instruction_block.CursorPos());
+        jobs.push_back(job_res.unwrap());
+    }
+
+    std::vector<std::optional<const char*>> errors(jobs.size());
+    const auto protect_job = [&](const std::size_t i) {
+        const auto protect_res = ProtectFile(jobs[i], virtual_machine, pool);
+        if(protect_res.isErr()) {
+            errors[i] = protect_res.unwrapErr();
+        }
+    };
 
-        // Emit the call instruction using the relative offset that we just calculated
-        if(!native_emitter->EmitNearCall(call_offset, instruction_block)) {
-            Panic("The buffer is too small to call the virtual machine");
+    // With a memory budget, the files are protected one after the other and each one gets the whole budget.
+    // The regions of a file are still translated by every thread of the pool
+    if(memory_budget != 0)
+    {
+        for(std::size_t i = 0; i < jobs.size(); ++i) {
+            protect_job(i);
+        }
+    }
+    else
+    {
+        std::atomic<std::size_t> remaining{ jobs.size() };
+        for(std::size_t i = 0; i < jobs.size(); ++i)
+        {
+            pool.Submit([&, i]() {
+                protect_job(i);
+                --remaining;
+            });
         }
 
-        // Overwrite everything after the new instructions and replace them
-        // With 0x90(NOP) to remove any original instructions
-        const auto size_remaining = instruction_block.Size() - instruction_block.CursorPos();
-        std::memset(instruction_block.InnerPtr().get() + instruction_block.CursorPos(), '\x90', size_remaining);
+        pool.RunUntil([&remaining]() { return remaining == 0; });
+    }
 
-        // Write the patched buffer back to the original location
-        const auto native_overwrite_res = proc_context.pe_file->WriteToRegion(pair.first, instruction_block);
-        if(native_overwrite_res.isErr()) {
-            Panic("Could not patch the original native code");
+    std::size_t failed_count{ 0 };
+    for(std::size_t i = 0; i < jobs.size(); ++i)
+    {
+        if(errors[i]) {
+            spdlog::critical("Protecting {} failed with msg: {}", jobs[i].input.string(), *errors[i]);
+            ++failed_count;
         }
+    }
+
+    spdlog::info("{} of {} files protected", jobs.size() - failed_count, jobs.size());
 
-        // Once this is all done, the patched function should look like this
-        // Push 0xdeadbeef // Encoded vip location
-        // Call vm // Relative offset to the virtual machione
+    return failed_count == 0 ? 0 : -1;
+}
+
+/**
+ * @brief
+ * Protects the jobs submitted on a Unix domain socket until the server fails.
+ * The virtual machine, the pool and the cache are loaded once and shared by every job,
+ * the jobs run concurrently like the files of a batch.
+ *
+ * @param socket_path Path of the socket
+ * @param selection The selection used for the jobs listing no region
+ * @param virtual_machine The virtual machine blob, shared by every job
+ * @param pool Pool running the regions of every job
+ * @param key_seed Seed of the keys of every job. A new one is drawn for every job without it
+ * @param cache Cache of translated blocks shared by every job, can be null
+ * @param memory_budget Bytes a job can use at once, the jobs are protected one at a time when it's set
+ * @return int Only returns when the server fails
+ */
+int RunServer(
+    const std::filesystem::path& socket_path,
+    const mainspace::FunctionSelection& selection,
+    const MappedMemory& virtual_machine,
+    ThreadPool& pool,
+    const std::optional<std::uint64_t> key_seed,
+    const TranslationCache* cache,
+    const std::uint64_t memory_budget
+)
+{
+    const auto server_res = ProtectionServer::Listen(socket_path);
+    if(server_res.isErr()) {
+        spdlog::critical("Starting the server failed with msg: {}", server_res.unwrapErr());
+        return -1;
     }
 
-    return 0;
+    const auto server = server_res.unwrap();
+    spdlog::info("Listening on {}", server->Path().string());
+
+    std::mutex budget_mutex;
+    const auto serve_res = server->Serve([&](const JobManifest::Entry& entry) -> Result<bool, const char*> {
+        // The seed is logged by ProtectFile so the build can be reproduced
+        const auto job_seed = key_seed.value_or(cryptography::GenerateSeed());
+
+        const auto job_res = MakeManifestJob(entry, selection, job_seed, cache, memory_budget);
+        if(job_res.isErr()) {
+            return Err(job_res.unwrapErr());
+        }
+
+        std::unique_lock budget_lock(budget_mutex, std::defer_lock);
+        if(memory_budget != 0) {
+            budget_lock.lock();
+        }
+
+        const auto protect_res = ProtectFile(job_res.unwrap(), virtual_machine, pool);
+        if(protect_res.isErr()) {
+            spdlog::error("Protecting {} failed with msg: {}", entry.input.string(), protect_res.unwrapErr());
+        }
+
+        return protect_res;
+    });
+
+    spdlog::critical("The server stopped with msg: {}", serve_res.unwrapErr());
+    TranslationLog::Shutdown();
+    return -1;
 }
 
 int main([[maybe_unused]]int argc, [[maybe_unused]]char** argv)
@@ -322,16 +807,101 @@ int main([[maybe_unused]]int argc, [[maybe_unused]]char** argv)
     // Might not return if the arguments provided are invalid
     const auto cmd_args = InitAndParseCmdArgs(argc, argv);
 
-    // Get the input file path from the arg parser and make sure the file is valid
-    const auto file_path = cmd_args.get<std::string>("--input");
-    const auto path_handle_res = ValidateFile(file_path);
-    if(!path_handle_res) {
-        Panic("The input file provided is not valid");
+    const auto batch_path = cmd_args.present<std::string>("--batch");
+    const auto serve_path = cmd_args.present<std::string>("--serve");
+    if(!batch_path && !serve_path && !cmd_args.is_used("--input")) {
+        Panic("An input file, a batch manifest or a server socket is required");
+    }
+
+    // Applying a delta only needs the base file and the output, nothing is translated
+    if(const auto delta_path = cmd_args.present<std::string>("--apply-delta"))
+    {
+        if(batch_path) {
+            Panic("Applying a delta requires a single input file");
+        }
+
+        const auto path_handle_res = ValidateFile(cmd_args.get<std::string>("--input"));
+        if(!path_handle_res) {
+            Panic("The input file provided is not valid");
+        }
+
+        const auto output_path = cmd_args.present<std::string>("--output");
+        if(!output_path) {
+            Panic("Applying a delta requires an output path");
+        }
+
+        const auto apply_res = ImageBuilder::ApplyDelta(*delta_path, path_handle_res.value(), *output_path);
+        if(apply_res.isErr()) {
+            spdlog::critical("Applying the delta failed with msg: {}", apply_res.unwrapErr());
+            return -1;
+        }
+
+        return 0;
     }
 
-    const auto path_handle = path_handle_res.value();
+    // The job is protected by a running server, which already has the virtual machine loaded
+    if(const auto submit_path = cmd_args.present<std::string>("--submit"))
+    {
+        if(batch_path || serve_path) {
+            Panic("Submitting a job requires a single input file");
+        }
+
+        // A job line only holds the paths and the regions, the server uses its own settings for the rest
+        for(const auto* option : { "--delta", "--layout", "--seed", "--previous", "--previous-layout" })
+        {
+            if(cmd_args.is_used(option)) {
+                spdlog::critical("{} can't be used with --submit, the server protects the job with its own settings", option);
+                return -1;
+            }
+        }
+
+        const auto regions_res = CollectRegions(cmd_args);
+        if(regions_res.isErr()) {
+            spdlog::critical("Loading the regions failed with msg: {}", regions_res.unwrapErr());
+            return -1;
+        }
+
+        // The server doesn't run in this directory, the paths are made absolute
+        const auto input_path = std::filesystem::absolute(cmd_args.get<std::string>("--input"));
+        JobManifest::Entry entry{ input_path, input_path, {} };
+        if(const auto output_path = cmd_args.present<std::string>("--output")) {
+            entry.output = std::filesystem::absolute(*output_path);
+        }
+
+        for(const auto& region : regions_res.unwrap()) {
+            entry.region_pairs.emplace_back(region.rva, region.size);
+        }
+
+        const auto submit_res = ProtectionServer::Submit(*submit_path, entry);
+        if(submit_res.isErr()) {
+            spdlog::critical("Submitting the job failed with msg: {}", submit_res.unwrapErr());
+            return -1;
+        }
+
+        const auto response = submit_res.unwrap();
+        if(response != "ok") {
+            spdlog::critical("The server failed to protect the file: {}", response);
+            return -1;
+        }
+
+        return 0;
+    }
+
+    const auto selection_res = ParseFunctionSelection(cmd_args);
+    if(selection_res.isErr()) {
+        spdlog::critical("Failed to parse the function selection: MSG-> {}", selection_res.unwrapErr());
+        return -1;
+    }
+
+    const auto selection = selection_res.unwrap();
+
+    const bool explicit_regions = cmd_args.is_used("--block") || cmd_args.is_used("--regions");
+    if(!cmd_args.is_used("--vm") || (!batch_path && !serve_path && !explicit_regions && !selection.enabled)) {
+        Panic("The virtual machine and at least one block or function selection are required");
+    }
 
     // Get the virtual machine path from the arg parser and load it in memory
+    // It's loaded once and shared by every file of a batch
     const auto vm_path = cmd_args.get<std::string>("--vm");
     const auto virtual_machine_res = LoadVirtualMachine(vm_path);
     if(!virtual_machine_res) {
@@ -339,52 +909,114 @@ int main([[maybe_unused]]int argc, [[maybe_unused]]char** argv)
     }
 
     const auto virtual_machine = virtual_machine_res.value();
+    if(virtual_machine.Size() == 0 || virtual_machine.Size() > std::numeric_limits<std::uint32_t>::max()) {
+        Panic("The size of the virtual machine is invalid");
+    }
 
-    // Parse the exe file to begin the translation process
-    // The imports are not loaded right now because the API hollowing is not yet available
-    auto pe_file_res = PeFile::Load(path_handle, PeFile::LoadOption::LAZY_LOAD);
-    if(pe_file_res.isErr()) {
-        spdlog::critical("Failed to load the PE file: MSG-> {}", pe_file_res.unwrapErr());
-        return -1;
+    // The translation log is written from a background thread, it doesn't slow the translation down when it's off
+    const auto translation_log = cmd_args.get<std::string>("--translation-log");
+    if(translation_log != "off")
+    {
+        if(translation_log != "debug" && translation_log != "trace") {
+            Panic("The translation log must be off, debug or trace");
+        }
+
+        const auto log_level = translation_log == "trace" ? TranslationLog::Level::TRACE : TranslationLog::Level::DEBUG;
+        if(log_level > TranslationLog::COMPILED_LEVEL) {
+            spdlog::warn("The translation log was built up to level {}, rebuild with IGNOTUM_TRANSLATION_LOG_LEVEL to get more",
+                         static_cast<int>(TranslationLog::COMPILED_LEVEL));
+        }
+
+        TranslationLog::SetLevel(log_level);
     }
 
-    auto pe_file = pe_file_res.unwrap();
+    // Whichever path main returns from, the messages still queued are written before the process exits
+    struct TranslationLogScope
+    {
+        ~TranslationLogScope() { TranslationLog::Shutdown(); }
+    } translation_log_scope;
 
-    // Create the first region which will hold the virtual machine
-    // Write the vm to it
-    const auto vm_region_size = 0x1000; // it's 0x1000 because of the alignment
-    const auto ign1_region_res = pe_file->AddSection(".Ign1", vm_region_size);
-    if(!ign1_region_res) {
-        Panic("Failed to add the first region for the virtual machine");
+    auto jobs = cmd_args.get<unsigned>("--jobs");
+    if(jobs == 0) {
+        jobs = std::max(std::thread::hardware_concurrency(), 1u);
     }
 
-    // The addition of the section was a section, get the returned handle
-    const auto ign1_region = ign1_region_res.value();
+    ThreadPool pool(jobs);
 
-    // Write the vm binary to the '.Ign1' region
-    pe_file->WriteToRegion(ign1_region.VirtualAddress, virtual_machine)
-            .expect("The writing of the virtual machine failed");
+    // Every protected file logs the seed it was built with, so a build made without one can be reproduced.
+    // A server draws one for every job instead, unless it's given
+    const auto given_seed = cmd_args.present<std::uint64_t>("--seed");
+    const auto key_seed = given_seed.value_or(cryptography::GenerateSeed());
 
-    const auto vcode_region_size = 0x1000; // it's 0x1000 because of the alignment
+    // The cache is opened once, every file of a batch shares it
+    std::optional<TranslationCache> cache;
+    if(const auto cache_path = cmd_args.present<std::string>("--cache"))
+    {
+        auto cache_res = TranslationCache::Open(*cache_path);
+        if(cache_res.isErr()) {
+            spdlog::critical("Opening the cache failed with msg: {}", cache_res.unwrapErr());
+            return -1;
+        }
 
-    // Create the second region which will hold all of the translated code
-    const auto ign2_region_res = pe_file->AddSection(".Ign2", vcode_region_size);
-    if(!ign2_region_res) {
-        Panic("Failed to add the second region for the virtualized code");
+        cache.emplace(cache_res.unwrap());
+    }
+
+    const TranslationCache* cache_ptr = cache ? &cache.value() : nullptr;
+
+    // Given in megabytes, 0 doesn't bound the memory
+    const auto memory_budget = cmd_args.present<std::uint64_t>("--memory-budget").value_or(0);
+    if(memory_budget > std::numeric_limits<std::uint64_t>::max() >> 20) {
+        Panic("The memory budget is too big");
+    }
+
+    const auto memory_budget_bytes = memory_budget << 20;
+
+    if(serve_path) {
+        return RunServer(*serve_path, selection, virtual_machine, pool, given_seed, cache_ptr, memory_budget_bytes);
+    }
+
+    if(batch_path) {
+        return RunBatch(*batch_path, selection, virtual_machine, pool, key_seed, cache_ptr, memory_budget_bytes);
     }
-    const auto ign2_region = ign2_region_res.value();
 
     // Once the file was successfully loaded, we manage the specified block for translation
-    const auto regions = cmd_args.get<std::vector<std::uint64_t>>("--block");
-    const auto region_pairs = ValidateRegions(regions)
-                                .expect("Failed to pair the regions");
+    auto job_regions_res = CollectRegions(cmd_args);
+    if(job_regions_res.isErr()) {
+        spdlog::critical("Loading the regions failed with msg: {}", job_regions_res.unwrapErr());
+        return -1;
+    }
 
-    mainspace::BeginProcessContext proc_context(
-        pe_file,
-        ign1_region,
-        ign2_region,
-        region_pairs
-    );
+    mainspace::ProtectJob job{ cmd_args.get<std::string>("--input"), {}, {}, job_regions_res.unwrap(), selection, key_seed, cache_ptr };
+    job.memory_budget = memory_budget_bytes;
+    if(const auto output_path = cmd_args.present<std::string>("--output")) {
+        job.output = *output_path;
+    }
+
+    if(const auto delta_path = cmd_args.present<std::string>("--delta")) {
+        job.delta = *delta_path;
+    }
+
+    if(const auto layout_path = cmd_args.present<std::string>("--layout")) {
+        job.layout = *layout_path;
+    }
+
+    // Incremental mode, both the previous build and its layout are needed
+    const auto previous_output = cmd_args.present<std::string>("--previous");
+    const auto previous_layout = cmd_args.present<std::string>("--previous-layout");
+    if(previous_output.has_value() != previous_layout.has_value()) {
+        Panic("An incremental build needs both the previous build and its layout");
+    }
+
+    if(previous_output) {
+        job.previous_output = *previous_output;
+        job.previous_layout = *previous_layout;
+    }
+
+    const auto protect_res = ProtectFile(job, virtual_machine, pool);
+    if(protect_res.isErr()) {
+        spdlog::critical("Protecting the file failed with msg: {}", protect_res.unwrapErr());
+        return -1;
+    }
 
-    return BeginTranslationProcess(proc_context);
-}
\ No newline at end of file
+    return 0;
+}
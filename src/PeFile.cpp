@@ -3,33 +3,136 @@
 #include <cstring>
 #include <iostream>
 #include <bit>
+#include <algorithm>
+#include <limits>
+#include <tuple>
+#include <iterator>
+
+#include <utl/Utl.hpp>
+#include <PrologueScanner.hpp>
+#include <FileClone.hpp>
+
+/**
+ * @brief
+ * Copies bytes located at an absolute position of the file into the destination.
+ * When the file is memory mapped, the bytes are copied straight from the mapping and the
+ * stream cursor is never touched, which makes the call safe from multiple readers.
+ *
+ * @param offset Absolute position in the file
+ * @param destination Buffer receiving the bytes
+ * @param size Amount of bytes to be copied
+ * @return true The bytes were copied
+ * @return false The range is outside of the file
+ */
+bool PeFile::ReadAt(const std::uintmax_t offset, void* destination, const std::size_t size)
+{
+    if(m_mapping)
+    {
+        const auto image = m_mapping->Span();
+        if(offset > image.size() || image.size() - offset < size) {
+            return false;
+        }
+
+        std::memcpy(destination, image.data() + offset, size);
+        return true;
+    }
+
+    m_file_handle.seekg(offset, std::ios_base::beg);
+    m_file_handle.read(std::bit_cast<char*>(destination), size);
+
+    if(!m_file_handle) {
+        // Reset the state so the following reads can still be done
+        m_file_handle.clear();
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief
+ * Adds the section to the sorted list of intervals used by RvaToRaw.
+ * Sections without raw data can't be translated and are ignored
+ *
+ * @param section The header of the section
+ */
+void PeFile::IndexSection(const Win32::IMAGE_SECTION_HEADER& section)
+{
+    if(section.PointerToRawData == 0) {
+        return;
+    }
+
+    // Some linkers leave the virtual size empty, the raw size is used instead
+    const std::uint32_t virtual_size = section.Misc.VirtualSize != 0 ?
+        section.Misc.VirtualSize :
+        section.SizeOfRawData;
+
+    const SectionInterval interval{
+        section.VirtualAddress,
+        section.VirtualAddress + virtual_size,
+        section.PointerToRawData
+    };
+
+    // New sections are almost always added at the end, the insertion is usually free
+    const auto position = std::upper_bound(
+        m_section_intervals.begin(),
+        m_section_intervals.end(),
+        interval.virtual_address,
+        [](const std::uint32_t rva, const SectionInterval& other) { return rva < other.virtual_address; }
+    );
+
+    m_section_intervals.insert(position, interval);
+    m_last_interval_hit.store(0, std::memory_order_relaxed);
+}
 
 /**
  * @brief
  * Converts the given relative virtual address to a raw address that
- * can be directly accessed in the file buffer
+ * can be directly accessed in the file buffer.
+ * The last section that matched is checked first, since consecutive lookups
+ * usually land in the same section. Otherwise a binary search is done over the
+ * sorted intervals.
  *
  * @param rva Relative virtual address to be converted
  * @return std::uint32_t The raw address. IF 0 then it was not found
  */
 std::uint32_t PeFile::RvaToRaw(const std::uint32_t rva) const
 {
-    // Iterate over all of the sections and check if the given value is
-    // within the range of the section. If yes, convert it to a memory region address
-    for(const auto& section_it : m_sections_map)
-    {
-        const auto section = section_it.second;
+    const auto interval_count = m_section_intervals.size();
 
-        if(
-            rva >= section.VirtualAddress &&
-            rva <= section.VirtualAddress + section.Misc.VirtualSize
-        )
-        {
-            return section.PointerToRawData + (rva - section.VirtualAddress);
+    // Fast path, the same section as the last lookup
+    const auto last_hit = m_last_interval_hit.load(std::memory_order_relaxed);
+    if(last_hit < interval_count)
+    {
+        const auto& interval = m_section_intervals[last_hit];
+        if(rva >= interval.virtual_address && rva < interval.virtual_end) {
+            return interval.raw_address + (rva - interval.virtual_address);
         }
     }
 
-    return 0;
+    // Find the first interval starting after the rva, the candidate is the one before it
+    const auto next = std::upper_bound(
+        m_section_intervals.begin(),
+        m_section_intervals.end(),
+        rva,
+        [](const std::uint32_t value, const SectionInterval& interval) { return value < interval.virtual_address; }
+    );
+
+    if(next == m_section_intervals.begin()) {
+        return 0;
+    }
+
+    const auto candidate = std::prev(next);
+    if(rva >= candidate->virtual_end) {
+        return 0;
+    }
+
+    m_last_interval_hit.store(
+        static_cast<std::size_t>(std::distance(m_section_intervals.begin(), candidate)),
+        std::memory_order_relaxed
+    );
+
+    return candidate->raw_address + (rva - candidate->virtual_address);
 }
 
 /**
@@ -38,89 +141,131 @@ std::uint32_t PeFile::RvaToRaw(const std::uint32_t rva) const
  * @return std::optional<Win32::IMAGE_DATA_DIRECTORY>
  * The requested structure or nullopt
  */
-std::optional<Win32::IMAGE_DATA_DIRECTORY> PeFile::GetImportDirectory() const
+std::optional<Win32::IMAGE_DATA_DIRECTORY> PeFile::GetDataDirectory(const std::uint32_t index) const
 {
     if(m_arch == Win32::Architecture::AMD64) {
-        return m_nt_headers64.OptionalHeader64.DataDirectory[Win32::Constants::IMAGE_DIRECTORY_ENTRY_IMPORT];
+        return m_nt_headers64.OptionalHeader64.DataDirectory[index];
     }
     else if(m_arch == Win32::Architecture::I386) {
-        return m_nt_headers32.OptionalHeader32.DataDirectory[Win32::Constants::IMAGE_DIRECTORY_ENTRY_IMPORT];
+        return m_nt_headers32.OptionalHeader32.DataDirectory[index];
     }
 
     // Else we just return a nullopt
     return {};
 }
 
+std::optional<Win32::IMAGE_DATA_DIRECTORY> PeFile::GetImportDirectory() const
+{
+    return GetDataDirectory(Win32::Constants::IMAGE_DIRECTORY_ENTRY_IMPORT);
+}
+
 /**
  * @brief
- * Goes over all of the functions imported from a library and maps them to a easily accessible structure
- * @param dll_name Name of the imported library
- * @param first_thunk_rva The rva to the first IMAGE_THUNK_DATA structure
- * @return true The functions for the library were loaded and mapped in the structure
- * @return false The functions could not be loaded and mapped because of invalid data
+ * Reads the exception directory (.pdata) and indexes the boundaries of every function it describes.
+ * The entries are read in one go, they are not parsed one by one from the file.
+ * Only x64 images have one, the index of a x86 image stays empty.
+ * @return true The directory was indexed, or the image doesn't have one
+ * @return false The directory points outside of the file
  */
-bool PeFile::MapImports(const std::string& dll_name, const std::uint32_t first_thunk_rva)
+bool PeFile::LoadFunctions()
 {
-    // Save the position, so we can roll back to it after being done
-    const auto saved_position = m_file_handle.tellg();
+    const auto exception_directory = GetDataDirectory(Win32::Constants::IMAGE_DIRECTORY_ENTRY_EXCEPTION);
+    if(exception_directory == std::nullopt) {
+        return false;
+    }
+
+    if(m_arch != Win32::Architecture::AMD64 || exception_directory->VirtualAddress == 0) {
+        m_function_index = FunctionIndex();
+        return true;
+    }
+
+    const auto entry_count = exception_directory->Size / sizeof(Win32::IMAGE_RUNTIME_FUNCTION_ENTRY);
+    const auto raw_address = RvaToRaw(exception_directory->VirtualAddress);
+    if(raw_address == 0 || raw_address > m_file_size ||
+       (m_file_size - raw_address) / sizeof(Win32::IMAGE_RUNTIME_FUNCTION_ENTRY) < entry_count)
+    {
+        return false;
+    }
 
-    // We convert the rva to raw, to access it in the buffer
-    const auto first_thunk_raw = RvaToRaw(first_thunk_rva);
-    // We failed to find it, return
-    if(first_thunk_raw == 0)
+    std::vector<Win32::IMAGE_RUNTIME_FUNCTION_ENTRY> entries(entry_count);
+    if(!ReadAt(raw_address, entries.data(), entries.size() * sizeof(Win32::IMAGE_RUNTIME_FUNCTION_ENTRY))) {
         return false;
+    }
 
-    // Seek to the first thunk
-    m_file_handle.seekg(first_thunk_raw);
+    m_function_index = FunctionIndex(entries);
+    return true;
+}
 
-    std::vector<ImportedFunction> imported_functions;
-    Win32::IMAGE_THUNK_DATA thunk_data{ 0 };
-    for(std::size_t i = 0;; ++i)
+/**
+ * @brief
+ * Finds the functions of the image by scanning its executable sections for prologues.
+ * Meant for the x64 images without an exception directory, nothing is found in the other ones.
+ * When the file was not loaded as memory mapped, it's temporarily mapped for the scan.
+ * @return Result<FunctionIndex, const char*> The functions found or an error message
+ */
+Result<FunctionIndex, const char*> PeFile::ScanFunctions() const
+{
+    auto mapping = m_mapping;
+    if(!mapping)
     {
-        m_file_handle.read(
-            std::bit_cast<char *>(&thunk_data),
-            sizeof(Win32::IMAGE_THUNK_DATA)
-        );
+        auto mapping_res = FileMapping::Open(m_path);
+        if(mapping_res.isErr()) {
+            return Err(mapping_res.unwrapErr());
+        }
 
-        const auto import_by_name_rva = std::bit_cast<std::uintptr_t>(thunk_data.u1.AddressOfData);
-        const auto import_by_name_raw = RvaToRaw(import_by_name_rva);
-        if(import_by_name_raw == 0)
-            break;
+        mapping = mapping_res.unwrap();
+    }
 
-        // Save the position to know where we were before jumping to the string rva
-        const auto descriptor_position = m_file_handle.tellg();
+    const auto image = mapping->Span();
 
-        // Seek to the raw address of the name import
-        m_file_handle.seekg(import_by_name_raw);
+    std::vector<FunctionIndex::Function> functions;
+    for(const auto& section : m_section_headers)
+    {
+        if((section.Characteristics & Win32::Constants::IMAGE_SCN_MEM_EXECUTE) == 0) {
+            continue;
+        }
 
-        Win32::IMAGE_IMPORT_BY_NAME name_import{ 0 };
-        // Read the hint flag
-        m_file_handle.read(std::bit_cast<char *>(&name_import), sizeof(Win32::IMAGE_IMPORT_BY_NAME::Hint));
+        // The raw data is padded up to the file alignment, the virtual size is the size of the code
+        const auto code_size = section.Misc.VirtualSize != 0 ?
+            std::min(section.Misc.VirtualSize, section.SizeOfRawData) :
+            section.SizeOfRawData;
 
-        std::string import_name;
-        // Read the name of the import
-        std::getline(m_file_handle, import_name, '\0');
-        if(import_name[0] == 'l')
-            break;
+        if(section.PointerToRawData > image.size() || image.size() - section.PointerToRawData < code_size) {
+            return Err("An executable section is outside of the file");
+        }
+
+        const auto found = PrologueScanner::Scan(
+            image.subspan(section.PointerToRawData, code_size),
+            section.VirtualAddress,
+            m_arch
+        );
+        functions.insert(functions.end(), found.begin(), found.end());
+    }
 
-        // Seek to the raw address of the name import
-        m_file_handle.seekg(descriptor_position);
+    return Ok(FunctionIndex(std::move(functions)));
+}
 
-        imported_functions.emplace_back(ImportedFunction{
-            import_name,
-            0
-        });
+/**
+ * @brief
+ * Gives the boundaries of the functions of the image. The exception directory
+ * is parsed on the first call when the file was loaded lazily.
+ * @return Result<const FunctionIndex*, const char*> The index or an error message if the directory is invalid
+ */
+Result<const FunctionIndex*, const char*> PeFile::GetFunctions()
+{
+    if(!m_function_index && !LoadFunctions()) {
+        return Err("The exception directory is invalid");
     }
-    m_imported_functions_map[dll_name] = imported_functions;
 
-    // Roll back to the original position
-    m_file_handle.seekg(saved_position);
-    return true;
+    return Ok(static_cast<const FunctionIndex*>(&*m_function_index));
 }
 
 /**
  * @brief
- * Goes over all of the imported libraries and loads and maps them into memory
+ * Goes over all of the imported libraries and their functions and maps them in the
+ * import index. The whole import directory is walked directly over the mapped image,
+ * no stream operation is done per entry. When the file was not loaded as memory mapped,
+ * it's temporarily mapped for the parsing.
  * @return true All of the libraries and their functions are mapped
  * @return false Could not be fully mapped due to invalid data
  */
@@ -138,76 +283,150 @@ bool PeFile::LoadImports()
         return true;
     }
 
-    // We need to get the raw address to find it in the local buffer
-    const auto import_descriptor_raw = RvaToRaw(import_descriptor_rva);
-    // It failed to find the raw address in the buffer, we stop the import parsing
-    if(import_descriptor_raw == 0) {
-        return false;
+    auto mapping = m_mapping;
+    if(!mapping)
+    {
+        auto mapping_res = FileMapping::Open(m_path);
+        if(mapping_res.isErr()) {
+            return false;
+        }
+
+        mapping = mapping_res.unwrap();
     }
 
-    // Save the position, so we can roll back to it after being done
-    const auto saved_position = m_file_handle.tellg();
+    const auto image = mapping->Span();
+
+    // Gives a pointer to the bytes at the rva if the requested size is inside of the file
+    const auto bytes_at = [&](const std::uint64_t rva, const std::size_t size) -> const std::uint8_t* {
+        if(rva > std::numeric_limits<std::uint32_t>::max()) {
+            return nullptr;
+        }
+
+        const auto raw_address = RvaToRaw(static_cast<std::uint32_t>(rva));
+        if(raw_address == 0 || raw_address > image.size() || image.size() - raw_address < size) {
+            return nullptr;
+        }
+
+        return image.data() + raw_address;
+    };
+
+    // Reads a null terminated string at the rva without going past the end of the file
+    const auto string_at = [&](const std::uint64_t rva) -> std::optional<std::string_view> {
+        const auto* start = bytes_at(rva, 1);
+        if(start == nullptr) {
+            return {};
+        }
+
+        const auto MAX_FN_NAME_LEN = 0x1000;
+        const auto available = std::min<std::size_t>(image.data() + image.size() - start, MAX_FN_NAME_LEN + 1);
+        const auto length = strnlen(std::bit_cast<const char*>(start), available);
+
+        // The names can't be greater than 4096 bytes
+        if(length == available) {
+            return {};
+        }
 
-    m_file_handle.seekg(import_descriptor_raw);
+        return std::string_view(std::bit_cast<const char*>(start), length);
+    };
+
+    const bool is_64bit = m_arch == Win32::Architecture::AMD64;
+    const std::size_t thunk_size = is_64bit ?
+        sizeof(Win32::IMAGE_THUNK_DATA64) :
+        sizeof(Win32::IMAGE_THUNK_DATA32);
+    const std::uint64_t ordinal_flag = is_64bit ?
+        Win32::Constants::IMAGE_ORDINAL_FLAG64 :
+        Win32::Constants::IMAGE_ORDINAL_FLAG32;
 
     // This is the table place in an array
-    Win32::IMAGE_IMPORT_DESCRIPTOR import_descriptor { 0 };
-    for(std::size_t i = 0;; ++i)
+    for(std::uint64_t descriptor_rva = import_descriptor_rva;; descriptor_rva += sizeof(Win32::IMAGE_IMPORT_DESCRIPTOR))
     {
-        // We increment to go over every structures
-        m_file_handle.read(
-            std::bit_cast<char *>(&import_descriptor),
-            sizeof(Win32::IMAGE_IMPORT_DESCRIPTOR)
-        );
+        const auto* descriptor_bytes = bytes_at(descriptor_rva, sizeof(Win32::IMAGE_IMPORT_DESCRIPTOR));
+        if(descriptor_bytes == nullptr) {
+            return false;
+        }
+
+        Win32::IMAGE_IMPORT_DESCRIPTOR import_descriptor;
+        std::memcpy(&import_descriptor, descriptor_bytes, sizeof(import_descriptor));
 
-        // When we have reached the end, the name rva will be nulL
-        const auto import_name_rva = import_descriptor.Name;
-        // The struct is empty, we break
-        if(import_name_rva == 0) {
+        // When we have reached the end, the name rva will be null
+        if(import_descriptor.Name == 0) {
             break;
         }
 
-        // We convert the rva for the dll name to raw
-        const auto import_name_raw = RvaToRaw(import_name_rva);
-        if(import_name_raw == 0) {
-            break;
+        const auto dll_import_name = string_at(import_descriptor.Name);
+        if(!dll_import_name) {
+            return false;
         }
 
-        // Save the position to know where we were before jumping to the string rva
-        const auto descriptor_position = m_file_handle.tellg();
+        const auto interned_dll = m_import_index.Intern(*dll_import_name);
 
-        // Peek to where the string is stored to copy it
-        m_file_handle.seekg(import_name_raw);
+        // Old linkers leave the lookup table empty, the names are then only in the import address table
+        const std::uint64_t lookup_rva = import_descriptor.OriginalFirstThunk != 0 ?
+            import_descriptor.OriginalFirstThunk :
+            import_descriptor.FirstThunk;
 
-        const auto MAX_FN_NAME_LEN = 0x1000;
+        std::vector<ImportedFunction> imported_functions;
+        for(std::uint64_t i = 0;; ++i)
+        {
+            const auto* thunk_bytes = bytes_at(lookup_rva + i * thunk_size, thunk_size);
+            if(thunk_bytes == nullptr) {
+                return false;
+            }
 
-        // We copy the name
-        std::string dll_import_name;
-        std::getline(m_file_handle, dll_import_name, '\0');
+            std::uint64_t thunk_data = 0;
+            std::memcpy(&thunk_data, thunk_bytes, thunk_size);
 
-        // The names can't be greater than 4096 bytes
-        if(dll_import_name.size() > MAX_FN_NAME_LEN) {
-            return false;
-        }
+            // The list is terminated by an empty thunk
+            if(thunk_data == 0) {
+                break;
+            }
 
-        // Roll back to the array of import descriptors
-        m_file_handle.seekg(descriptor_position);
+            const auto iat_rva = static_cast<std::uint32_t>(import_descriptor.FirstThunk + i * thunk_size);
 
-        bool map_success = MapImports(
-            dll_import_name,
-            import_descriptor.OriginalFirstThunk
-        );
+            std::string_view import_name;
+            if(thunk_data & ordinal_flag)
+            {
+                const auto ordinal = static_cast<std::uint16_t>(thunk_data & 0xFFFF);
+                import_name = m_import_index.Intern(ImportIndex::OrdinalName(ordinal));
+            }
+            else
+            {
+                // Skip the hint to get to the name of the import
+                const auto name_res = string_at((thunk_data & 0x7FFFFFFF) + sizeof(Win32::IMAGE_IMPORT_BY_NAME::Hint));
+                if(!name_res) {
+                    return false;
+                }
 
-        if(!map_success) {
-            return false;
+                import_name = m_import_index.Intern(*name_res);
+            }
+
+            m_import_index.Insert(interned_dll, import_name, iat_rva);
+            imported_functions.emplace_back(ImportedFunction{
+                std::string(import_name),
+                iat_rva
+            });
         }
+
+        m_imported_functions_map[std::string(interned_dll)] = std::move(imported_functions);
     }
 
-    // Roll back to the original position before this function was called
-    m_file_handle.seekg(saved_position);
     return true;
 }
 
+/**
+ * @brief
+ * Finds the slot in the import address table of an imported function.
+ * The imports are only available when the file was loaded with LoadOption::FULL_LOAD
+ *
+ * @param dll Name of the library, the case is ignored
+ * @param function Name of the function or #ordinal for the functions imported by ordinal
+ * @return std::optional<std::uint32_t> The rva of the slot or nullopt
+ */
+std::optional<std::uint32_t> PeFile::FindImport(const std::string_view dll, const std::string_view function) const
+{
+    return m_import_index.Find(dll, function);
+}
+
 /**
  * @brief
  * Goes over all of the sections after the NT_HEADERS and maps them in memory
@@ -220,26 +439,26 @@ bool PeFile::LoadSections()
 
     Win32::IMAGE_SECTION_HEADER section;
 
-    std::uintmax_t nt_headers_size = [&]() -> std::uintmax_t {
-        if(m_arch == Win32::Architecture::AMD64)
-            return sizeof(Win32::IMAGE_NT_HEADERS64);
-        else if(m_arch == Win32::Architecture::I386)
-            return sizeof(Win32::IMAGE_NT_HEADERS32);
-        else
-            return 0;
-    }();
+    const std::uintmax_t nt_headers_size = NtHeadersSize();
 
-    m_file_handle.seekg(
-        m_dos_header.e_lfanew + nt_headers_size,
-        m_file_handle.beg
-    );
+    m_section_headers.reserve(section_count);
+
+    const std::uintmax_t section_table_raw = m_dos_header.e_lfanew + nt_headers_size;
 
     for(std::uint16_t i = 0; i < section_count; ++i)
     {
-        m_file_handle.read(
-            std::bit_cast<char *>(&section),
+        if(!ReadAt(
+            section_table_raw + i * sizeof(Win32::IMAGE_SECTION_HEADER),
+            &section,
             sizeof(Win32::IMAGE_SECTION_HEADER)
-        );
+        ))
+        {
+            return false;
+        }
+
+        // Keep the table as it is in the file, it's written back when committing
+        m_section_headers.push_back(section);
+        IndexSection(section);
 
         // Verify if any data is invalid
         if(section.PointerToRawData == 0) {
@@ -284,28 +503,30 @@ bool PeFile::LoadSections()
  */
 Win32::Architecture PeFile::GetArchitecture()
 {
-    // Save the position, so we can roll back to it after being done
-    const auto saved_position = m_file_handle.tellg();
-
-    // Let's seek paste the signature to read the 2 bytes in charge of telling the machine type
-    m_file_handle.seekg(
-        sizeof(Win32::IMAGE_NT_HEADERS32::Signature),
-        std::ios::cur
-    );
-
-    // Create a temporary variable to find the architecture
+    // The machine type is stored right after the signature
     std::uint16_t nt_machine = 0;
-    m_file_handle.read(
-        std::bit_cast<char *>(&nt_machine),
+    if(!ReadAt(
+        m_dos_header.e_lfanew + sizeof(Win32::IMAGE_NT_HEADERS32::Signature),
+        &nt_machine,
         sizeof(nt_machine)
-    );
-
-    // Roll back
-    m_file_handle.seekg(saved_position);
+    ))
+    {
+        return Win32::Architecture::NOT_SUPPORTED;
+    }
 
     return static_cast<Win32::Architecture>(nt_machine);
 }
 
+std::uintmax_t PeFile::NtHeadersSize() const
+{
+    if(m_arch == Win32::Architecture::AMD64)
+        return sizeof(Win32::IMAGE_NT_HEADERS64);
+    else if(m_arch == Win32::Architecture::I386)
+        return sizeof(Win32::IMAGE_NT_HEADERS32);
+
+    return 0;
+}
+
 std::uint32_t PeFile::GetEntryPoint() const
 {
     switch(m_arch)
@@ -319,6 +540,15 @@ std::uint32_t PeFile::GetEntryPoint() const
     }
 }
 
+/**
+ * @brief
+ * Stages the whole buffer to be written at the given rva.
+ * Nothing is written to the file before Commit is called.
+ *
+ * @param rva Relative virtual address of where the buffer will be written
+ * @param mapped_memory The buffer to be written
+ * @return Result<bool, const char*> Ok or an error if the rva is not in a section
+ */
 Result<bool, const char*>
 PeFile::WriteToRegion(const std::uint32_t rva, const MappedMemory& mapped_memory)
 {
@@ -327,23 +557,18 @@ PeFile::WriteToRegion(const std::uint32_t rva, const MappedMemory& mapped_memory
         return Err("The provided rva was not found in the sections");
     }
 
-    // Save the old position, so it can be rolled back at the end
-    const auto previous_cur_position = m_file_handle.tellg();
-
-    // Seek to where the requested region is
-    m_file_handle.seekg(raw_address);
-
-    // Write the memory to the specified location
-    m_file_handle.write(
-        std::bit_cast<const char*>(mapped_memory.InnerPtr().get()),
-        mapped_memory.Size()
-    );
-
-    // Roll back the region
-    m_file_handle.seekg(previous_cur_position);
-    return Ok(true);
+    return m_image_builder.Stage(raw_address, mapped_memory.InnerPtrRaw(), mapped_memory.Size());
 }
 
+/**
+ * @brief
+ * Stages the buffer up to its cursor to be written at the given rva.
+ * Nothing is written to the file before Commit is called.
+ *
+ * @param rva Relative virtual address of where the buffer will be written
+ * @param mapped_memory The buffer to be written
+ * @return Result<bool, const char*> Ok or an error if the rva is not in a section
+ */
 Result<bool, const char*>
 PeFile::WriteToRegionPos(const std::uint32_t rva, const MappedMemory& mapped_memory)
 {
@@ -352,36 +577,64 @@ PeFile::WriteToRegionPos(const std::uint32_t rva, const MappedMemory& mapped_mem
         return Err("The provided rva was not found in the sections");
     }
 
-    // Save the old position, so it can be rolled back at the end
-    const auto previous_cur_position = m_file_handle.tellg();
-
-    // Seek to where the requested region is
-    m_file_handle.seekg(raw_address);
+    return m_image_builder.Stage(raw_address, mapped_memory.InnerPtrRaw(), mapped_memory.CursorPos());
+}
 
-    // Write the memory to the specified location
-    m_file_handle.write(
-        std::bit_cast<const char*>(mapped_memory.InnerPtr().get()),
-        mapped_memory.CursorPos()
-    );
+/**
+ * @brief
+ * Stages a buffer at an offset inside of a section. The section can be one returned by
+ * PlanSections which isn't added yet, its raw address is taken from the given header.
+ * This lets the content of a new section be staged before its final size is known.
+ *
+ * @param section Header of the section, added or planned
+ * @param offset Offset of the buffer from the start of the section
+ * @param data The bytes to be written
+ * @return Result<bool, const char*> Ok or an error if the section has no raw data
+ */
+Result<bool, const char*> PeFile::WriteToSection(
+    const Win32::IMAGE_SECTION_HEADER& section,
+    const std::uint32_t offset,
+    std::span<const std::uint8_t> data
+)
+{
+    if(section.PointerToRawData == 0) {
+        return Err("The section has no raw data");
+    }
 
-    // Roll back the region
-    m_file_handle.seekg(previous_cur_position);
-    return Ok(true);
+    return m_image_builder.Stage(std::uintmax_t{ section.PointerToRawData } + offset, data.data(), data.size());
 }
 
+/**
+ * @brief
+ * Loads a region of the file in a buffer which can be modified by the caller.
+ * When the file is memory mapped, no copy is made. The returned buffer points
+ * directly inside of the copy-on-write mapping, so patching it never modifies the file.
+ *
+ * @param rva Relative virtual address of the start of the region
+ * @param region_size Size of the region
+ * @return Result<MappedMemory, const char*> The region or an error message
+ */
 Result<MappedMemory, const char*>
 PeFile::LoadRegion(const std::uint32_t rva, const std::size_t region_size)
 {
+    if(m_mapping)
+    {
+        const auto view_res = RegionView(rva, region_size);
+        if(view_res.isErr()) {
+            return Err(view_res.unwrapErr());
+        }
+
+        // The aliasing constructor keeps the mapping alive for as long as the region is used
+        auto* region_ptr = const_cast<std::uint8_t*>(view_res.unwrap().data());
+        std::shared_ptr<std::uint8_t[]> region_buffer(m_mapping, region_ptr);
+
+        return Ok(MappedMemory(region_buffer, region_size));
+    }
+
     const auto raw_address = RvaToRaw(rva);
     if(raw_address == 0)
         return Err("The provided rva was not found in the sections");
 
-    // Save the old position, so it can be rolled back at the end
-    const auto previous_cur_position = m_file_handle.tellg();
-
-    // Seek to where the requested region is
-    m_file_handle.seekg(raw_address);
-
     auto memory_buffer_res = MappedMemory::Allocate(region_size);
     if(!memory_buffer_res) {
         return Err("Allocation of the memory buffer for the region failed");
@@ -390,144 +643,429 @@ PeFile::LoadRegion(const std::uint32_t rva, const std::size_t region_size)
     auto memory_buffer = memory_buffer_res.value();
 
     // Read the file in the allocated buffer
-    m_file_handle.read(
-        std::bit_cast<char *>(memory_buffer.InnerPtr().get()),
-        region_size
-    );
+    if(!ReadAt(raw_address, memory_buffer.InnerPtrRaw(), region_size)) {
+        return Err("The region goes past the end of the file");
+    }
 
-    // Roll back the region
-    m_file_handle.seekg(previous_cur_position);
     return Ok(memory_buffer);
 }
 
+/**
+ * @brief
+ * Gives a read only view of a region of a memory mapped file.
+ * The view is only valid for as long as the PeFile object is alive.
+ * This function never touches the stream and can be called from multiple threads.
+ *
+ * @param rva Relative virtual address of the start of the region
+ * @param region_size Size of the region
+ * @return Result<std::span<const std::uint8_t>, const char*> The view or an error message
+ */
+Result<std::span<const std::uint8_t>, const char*>
+PeFile::RegionView(const std::uint32_t rva, const std::size_t region_size) const
+{
+    if(!m_mapping) {
+        return Err("Region views are only available for memory mapped files");
+    }
+
+    const auto raw_address = RvaToRaw(rva);
+    if(raw_address == 0) {
+        return Err("The provided rva was not found in the sections");
+    }
+
+    const auto image = m_mapping->Span();
+    if(raw_address > image.size() || image.size() - raw_address < region_size) {
+        return Err("The region goes past the end of the file");
+    }
+
+    return Ok(image.subspan(raw_address, region_size));
+}
+
+/**
+ * @brief
+ * Adds a single section at the end of the section table.
+ * See AddSections, this is the same as adding a list containing one section.
+ *
+ * @param section_name Name of the section, it can't be longer than 8 characters
+ * @param section_size Size of the raw data of the section
+ * @return std::optional<Win32::IMAGE_SECTION_HEADER> The header of the new section or nullopt
+ */
 std::optional<Win32::IMAGE_SECTION_HEADER>
 PeFile::AddSection(const std::string_view& section_name, const std::uint32_t section_size)
 {
-    const auto section_alignment = [&]() -> std::uint32_t {
-        if(m_arch == Win32::Architecture::AMD64)
-            return m_nt_headers64.OptionalHeader64.SectionAlignment;
-        else if(m_arch == Win32::Architecture::I386)
-            return m_nt_headers32.OptionalHeader32.SectionAlignment;
+    const auto sections_res = AddSections({ SectionSpec{ std::string(section_name), section_size } });
+    if(sections_res.isErr()) {
+        return {};
+    }
 
-        return 0;
-    }();
+    return sections_res.unwrap().front();
+}
 
-    if(section_size < section_alignment) {
-        return {};
+/**
+ * @brief
+ * Computes the headers the given sections would have if they were added right now, without
+ * modifying the file. The virtual addresses only depend on the sections placed before,
+ * so the address of a section can be known before the size of its content is.
+ *
+ * @param specs The sections to be placed, in the order they will be placed in the image
+ * @return Result<std::vector<Win32::IMAGE_SECTION_HEADER>, const char*>
+ * The headers of the sections in the same order as the specs, or an error message
+ */
+Result<std::vector<Win32::IMAGE_SECTION_HEADER>, const char*>
+PeFile::PlanSections(const std::vector<SectionSpec>& specs) const
+{
+    if(specs.empty() || m_section_headers.empty()) {
+        return Err("There are no sections to add");
     }
 
-    std::uintmax_t nt_headers_size = [&]() -> std::uintmax_t {
+    const auto [section_alignment, file_alignment, size_of_headers] = [&]() -> std::tuple<std::uint32_t, std::uint32_t, std::uint32_t> {
         if(m_arch == Win32::Architecture::AMD64)
-            return sizeof(Win32::IMAGE_NT_HEADERS64);
+            return {
+                m_nt_headers64.OptionalHeader64.SectionAlignment,
+                m_nt_headers64.OptionalHeader64.FileAlignment,
+                m_nt_headers64.OptionalHeader64.SizeOfHeaders
+            };
         else if(m_arch == Win32::Architecture::I386)
-            return sizeof(Win32::IMAGE_NT_HEADERS32);
-        else
-            return 0;
+            return {
+                m_nt_headers32.OptionalHeader32.SectionAlignment,
+                m_nt_headers32.OptionalHeader32.FileAlignment,
+                m_nt_headers32.OptionalHeader32.SizeOfHeaders
+            };
+
+        return { 0, 0, 0 };
     }();
 
-    // Go at the end of the nt headers
-    m_file_handle.seekg(m_dos_header.e_lfanew + nt_headers_size, m_file_handle.beg);
+    if(section_alignment == 0 || file_alignment == 0) {
+        return Err("The alignments of the image are invalid");
+    }
 
-    auto section_count = nt_headers_hybrid->FileHeader.NumberOfSections;
+    // The new entries of the section table must fit in the headers, otherwise they would overwrite the first section
+    const auto section_table_end =
+        m_dos_header.e_lfanew + NtHeadersSize() +
+        (m_section_headers.size() + specs.size()) * sizeof(Win32::IMAGE_SECTION_HEADER);
 
-    // Seek to the end of the image section headers - 1. Which will get us the previous section
-    m_file_handle.seekg(
-        sizeof(Win32::IMAGE_SECTION_HEADER) * (section_count - 1),
-        m_file_handle.cur
-    );
+    if(section_table_end > size_of_headers) {
+        return Err("There is not enough space in the headers for the new sections");
+    }
 
-    // Init the struct and write into it
-    Win32::IMAGE_SECTION_HEADER previous_section;
+    std::vector<Win32::IMAGE_SECTION_HEADER> new_sections;
+    new_sections.reserve(specs.size());
 
-    m_file_handle.read(
-        std::bit_cast<char*>(&previous_section),
-        sizeof(Win32::IMAGE_SECTION_HEADER)
-    );
+    // The previous section is the last entry of the table, staged sections included
+    auto previous_section = m_section_headers.back();
 
-    // Go at the end of the nt headers
-    m_file_handle.seekg(
-        m_dos_header.e_lfanew + nt_headers_size,
-        m_file_handle.beg
-    );
+    // The raw data is placed after everything that is in the file, so an overlay is never overwritten
+    std::uint64_t next_raw = m_image_builder.ImageSize();
 
-    m_file_handle.seekg(
-        sizeof(Win32::IMAGE_SECTION_HEADER) * section_count,
-        std::ios_base::cur
-    );
+    for(const auto& spec : specs)
+    {
+        if(spec.size == 0) {
+            return Err("A section can't be empty");
+        }
 
-    // After reading the last section, the cursor is now at the place of the new section
-    Win32::IMAGE_SECTION_HEADER new_section;
+        if(spec.name.length() > Win32::Constants::IMAGE_SIZEOF_SHORT_NAME) {
+            return Err("The name of the section is too long");
+        }
 
-    // Set the pointer for the new section
-    new_section.PointerToRawData = previous_section.PointerToRawData + previous_section.SizeOfRawData;
+        const std::uint64_t previous_virtual_size = previous_section.Misc.VirtualSize != 0 ?
+            previous_section.Misc.VirtualSize :
+            previous_section.SizeOfRawData;
 
-    // Size of the new section
-    new_section.SizeOfRawData = section_size;
+        const auto virtual_address = Utl::AlignUp(previous_section.VirtualAddress + previous_virtual_size, section_alignment);
+        const auto raw_address = Utl::AlignUp(
+            std::max<std::uint64_t>(next_raw, std::uint64_t{ previous_section.PointerToRawData } + previous_section.SizeOfRawData),
+            file_alignment
+        );
+        const auto raw_size = Utl::AlignUp(spec.size, file_alignment);
 
-    // The virtual address for the new section and the virtual size
-    new_section.VirtualAddress = previous_section.VirtualAddress + 0x1000;
-    new_section.Misc.VirtualSize = 0x200;
+        if(virtual_address + spec.size > std::numeric_limits<std::uint32_t>::max() ||
+           raw_address + raw_size > std::numeric_limits<std::uint32_t>::max())
+        {
+            return Err("The section does not fit in the image");
+        }
 
-    new_section.Characteristics = 0x60000020;
+        Win32::IMAGE_SECTION_HEADER new_section{};
+        new_section.VirtualAddress = static_cast<std::uint32_t>(virtual_address);
+        new_section.Misc.VirtualSize = spec.size;
+        new_section.PointerToRawData = static_cast<std::uint32_t>(raw_address);
+        new_section.SizeOfRawData = static_cast<std::uint32_t>(raw_size);
+        new_section.Characteristics = spec.characteristics;
 
-    std::memcpy(&new_section.Name, section_name.data(), section_name.length());
+        std::memcpy(&new_section.Name, spec.name.data(), spec.name.length());
 
-    // Write the structure in the file
-    m_file_handle.write(
-        std::bit_cast<char*>(&new_section),
-        sizeof(Win32::IMAGE_SECTION_HEADER)
-    );
+        new_sections.push_back(new_section);
+        previous_section = new_section;
+        next_raw = raw_address + raw_size;
+    }
 
-    // Go at the start of the nt headers
-    m_file_handle.seekg(
-        m_dos_header.e_lfanew,
-        std::ios_base::beg
-    );
+    return Ok(new_sections);
+}
+
+/**
+ * @brief
+ * Adds all of the given sections at the end of the section table in one go.
+ * Each section is sized from its spec and aligned on the SectionAlignment and the
+ * FileAlignment of the image. The nt headers are updated once for the whole list
+ * and the file is grown once to hold the raw data of every new section when committing.
+ *
+ * @param specs The sections to be added, in the order they will be placed in the image
+ * @return Result<std::vector<Win32::IMAGE_SECTION_HEADER>, const char*>
+ * The headers of the new sections in the same order as the specs, or an error message
+ */
+Result<std::vector<Win32::IMAGE_SECTION_HEADER>, const char*>
+PeFile::AddSections(const std::vector<SectionSpec>& specs)
+{
+    const auto plan_res = PlanSections(specs);
+    if(plan_res.isErr()) {
+        return plan_res;
+    }
 
-    const auto image_size = new_section.VirtualAddress - previous_section.VirtualAddress + new_section.Misc.VirtualSize;
+    const auto new_sections = plan_res.unwrap();
+    const auto& last_section = new_sections.back();
+    const auto section_count_increase = static_cast<std::uint16_t>(new_sections.size());
 
     switch(m_arch)
     {
         case Win32::Architecture::AMD64:
-            m_nt_headers64.FileHeader.NumberOfSections += 1;
-            m_nt_headers64.OptionalHeader64.SizeOfImage += 0x400;
-            m_nt_headers64.OptionalHeader64.SizeOfImage += image_size;
+            m_nt_headers64.FileHeader.NumberOfSections += section_count_increase;
+            m_nt_headers64.OptionalHeader64.SizeOfImage = static_cast<std::uint32_t>(Utl::AlignUp(
+                last_section.VirtualAddress + last_section.Misc.VirtualSize,
+                m_nt_headers64.OptionalHeader64.SectionAlignment
+            ));
             break;
         case Win32::Architecture::I386:
-            m_nt_headers32.FileHeader.NumberOfSections += 1;
-            m_nt_headers32.OptionalHeader32.SizeOfImage += 0x400;
-            m_nt_headers32.OptionalHeader32.SizeOfImage += image_size;
+            m_nt_headers32.FileHeader.NumberOfSections += section_count_increase;
+            m_nt_headers32.OptionalHeader32.SizeOfImage = static_cast<std::uint32_t>(Utl::AlignUp(
+                last_section.VirtualAddress + last_section.Misc.VirtualSize,
+                m_nt_headers32.OptionalHeader32.SectionAlignment
+            ));
             break;
         default:
             break;
     }
 
-    // Write the modified nt header to add the new section to the file
-    m_file_handle.write(
-        std::bit_cast<char*>(&m_nt_headers64),
-        nt_headers_size
-    );
+    // The headers are staged when committing, only the size of the file is reserved here.
+    // The file is extended once for all of the sections
+    m_image_builder.Grow(std::uintmax_t{ last_section.PointerToRawData } + last_section.SizeOfRawData);
+
+    for(std::size_t i = 0; i < new_sections.size(); ++i)
+    {
+        m_section_headers.push_back(new_sections[i]);
+        IndexSection(new_sections[i]);
+        m_sections_map[specs[i].name] = new_sections[i];
+    }
+
+    return Ok(new_sections);
+}
+
+/**
+ * @brief
+ * Writes every modification staged from now on to a work image instead of holding it in memory,
+ * which bounds the memory taken by the protection of a big image. The work image starts as a copy
+ * of the loaded file and takes the place of the output on Commit. It's removed if nothing is committed.
+ *
+ * @param work_path Where the work image is created. It's renamed to the output, so it must be on the same filesystem
+ * @return Result<bool, const char*> Ok or an error message if the work image could not be created
+ */
+Result<bool, const char*> PeFile::StreamTo(const std::filesystem::path& work_path)
+{
+    if(!m_path.empty())
+    {
+        const auto clone_res = FileClone::Clone(m_path, work_path);
+        if(clone_res.isErr()) {
+            return clone_res;
+        }
+    }
+    else
+    {
+        // An image loaded from memory has no file to clone, the work image starts as a copy of its buffer
+        const auto image = m_mapping->Span();
+        std::ofstream work_file(work_path, std::ios::binary | std::ios::trunc);
+        work_file.write(std::bit_cast<const char*>(image.data()), static_cast<std::streamsize>(image.size()));
+        work_file.close();
+
+        if(!work_file) {
+            std::error_code ec;
+            std::filesystem::remove(work_path, ec);
+            return Err("Could not create the work image");
+        }
+    }
+
+    return m_image_builder.StreamTo(work_path);
+}
+
+/**
+ * @brief
+ * Gives back the memory of a region patched through LoadRegion once it's staged.
+ * The pages of the mapping read the bytes of the file again, so the region must not be read anymore.
+ * Nothing is done when the file isn't memory mapped.
+ *
+ * @param rva Relative virtual address of the start of the region
+ * @param region_size Size of the region
+ */
+void PeFile::DiscardRegion(const std::uint32_t rva, const std::size_t region_size)
+{
+    const auto view_res = RegionView(rva, region_size);
+    if(view_res.isOk()) {
+        m_mapping->Discard(view_res.unwrap());
+    }
+}
+
+/**
+ * @brief
+ * Writes every staged modification to the file. The nt headers and the section table
+ * are staged once here, then everything is flushed in a single ordered pass.
+ * Regions loaded before the commit keep the original content of the file.
+ *
+ * @return Result<bool, const char*> Ok if the file was written, otherwise an error message
+ */
+Result<bool, const char*> PeFile::Commit()
+{
+    return Commit(m_path);
+}
 
-    // Go to the end of the file
-    m_file_handle.seekg(0, std::ios_base::end);
+/**
+ * @brief
+ * Writes the modified image to another file, the loaded file is left untouched.
+ * The loaded file is cloned to a temporary file next to the output, which shares the
+ * extents of the original where the filesystem allows it. Only the staged modifications
+ * are then written to the clone, which is renamed to the output once it's complete.
+ * When streaming, the work image already holds every modification and is renamed to the output instead.
+ *
+ * @param output_path Where the modified image is written. If it's the loaded file, it's modified in place
+ * @return Result<bool, const char*> Ok if the file was written, otherwise an error message
+ */
+Result<bool, const char*> PeFile::Commit(const std::filesystem::path& output_path)
+{
+    if(m_path.empty()) {
+        return Err("The image was loaded from memory, it can only be given back with CommitTo");
+    }
+
+    const auto stage_res = StageHeaders();
+    if(stage_res.isErr()) {
+        return stage_res;
+    }
+
+    // The gaps between the extents are bridged with the bytes on disk, like ExportDelta fingerprints them.
+    // The pages of m_mapping can't be used, the regions handed out by LoadRegion may have been patched through them.
+    // Without a mapping, the gaps are simply not bridged
+    auto base_mapping_res = FileMapping::Open(m_path);
+    const auto base_mapping = base_mapping_res.isOk() ? base_mapping_res.unwrap() : nullptr;
+    const auto base_image = base_mapping ? base_mapping->Span() : std::span<const std::uint8_t>{};
+
+    std::error_code ec;
+    const bool in_place = std::filesystem::equivalent(m_path, output_path, ec);
+
+    const auto commit_res = in_place ?
+        m_image_builder.Commit(m_path, base_image) :
+        m_image_builder.CommitCopy(m_path, output_path, base_image);
+
+    // The extents were written or rejected, either way they must not be written twice
+    m_image_builder.Clear();
+    return commit_res;
+}
+
+/**
+ * @brief
+ * Writes the staged modifications to a delta file instead of a protected image.
+ * The delta can be applied on a copy of the loaded file with ImageBuilder::ApplyDelta.
+ * The loaded file is left untouched.
+ *
+ * @param delta_path Where the delta is written
+ * @return Result<bool, const char*> Ok if the delta was written, otherwise an error message
+ */
+Result<bool, const char*> PeFile::ExportDelta(const std::filesystem::path& delta_path)
+{
+    if(m_path.empty()) {
+        return Err("The image was loaded from memory, it can only be given back with CommitTo");
+    }
+
+    const auto stage_res = StageHeaders();
+    if(stage_res.isErr()) {
+        return stage_res;
+    }
+
+    // The base is fingerprinted from the bytes under the extents as they are on disk. The pages of m_mapping
+    // can't be used, the regions handed out by LoadRegion may have been patched through them
+    auto mapping_res = FileMapping::Open(m_path);
+    if(mapping_res.isErr()) {
+        m_image_builder.Clear();
+        return Err(mapping_res.unwrapErr());
+    }
 
-    // Expand the size of the file by writing null bytes
-    for(std::uintmax_t i = 0; i < new_section.SizeOfRawData; ++i){
-        m_file_handle << '\x00';
+    const auto export_res = m_image_builder.ExportDelta(delta_path, mapping_res.unwrap()->Span());
+    m_image_builder.Clear();
+    return export_res;
+}
+
+/**
+ * @brief
+ * Gives the modified image to a sink instead of writing it to a file, the loaded image is left untouched.
+ * The base is only read outside of the extents, and every region patched through LoadRegion is staged,
+ * so the pages of the mapping can be used even once patched. An image loaded from memory has no other copy.
+ *
+ * @param sink Receives the image in order, a piece at a time
+ * @return Result<bool, const char*> Ok once the whole image was given, otherwise an error message
+ */
+Result<bool, const char*> PeFile::CommitTo(const ImageBuilder::Sink& sink)
+{
+    const auto stage_res = StageHeaders();
+    if(stage_res.isErr()) {
+        return stage_res;
     }
 
-    m_sections_map[std::string(section_name)] = new_section;
+    auto mapping = m_mapping;
+    if(!mapping)
+    {
+        auto mapping_res = FileMapping::Open(m_path);
+        if(mapping_res.isErr()) {
+            m_image_builder.Clear();
+            return Err(mapping_res.unwrapErr());
+        }
+
+        mapping = mapping_res.unwrap();
+    }
 
-    return new_section;
+    const auto write_res = m_image_builder.WriteTo(mapping->Span(), sink);
+    m_image_builder.Clear();
+    return write_res;
+}
+
+/**
+ * @brief
+ * Stages the nt headers and the whole section table from their in-memory copy
+ */
+Result<bool, const char*> PeFile::StageHeaders()
+{
+    const auto nt_headers_size = NtHeadersSize();
+    if(nt_headers_size == 0) {
+        return Err("Invalid NT Header size");
+    }
+
+    const auto* nt_headers = [&]() -> const std::uint8_t* {
+        if(m_arch == Win32::Architecture::AMD64)
+            return std::bit_cast<const std::uint8_t*>(&m_nt_headers64);
+
+        return std::bit_cast<const std::uint8_t*>(&m_nt_headers32);
+    }();
+
+    const auto nt_headers_res = m_image_builder.Stage(m_dos_header.e_lfanew, nt_headers, nt_headers_size);
+    if(nt_headers_res.isErr()) {
+        return nt_headers_res;
+    }
+
+    return m_image_builder.Stage(
+        m_dos_header.e_lfanew + nt_headers_size,
+        std::bit_cast<const std::uint8_t*>(m_section_headers.data()),
+        m_section_headers.size() * sizeof(Win32::IMAGE_SECTION_HEADER)
+    );
 }
 
 bool PeFile::ParseAndVerifyDosHeader()
 {
     // Load the dos header in memory for further analysis
-    m_file_handle.read(
-        std::bit_cast<char*>(&m_dos_header),
-        sizeof(m_dos_header)
-    );
+    if(!ReadAt(0, &m_dos_header, sizeof(m_dos_header))) {
+        return false;
+    }
 
     // Check if the first bytes of the file is equal to "MZ"
     if(m_dos_header.e_magic != Win32::Constants::DOS_MAGIC) {
@@ -555,14 +1093,8 @@ bool PeFile::ParseAndVerifyNtHeaders()
 {
     char nt_headers_raw[sizeof(Win32::IMAGE_NT_HEADERS64)] = { 0 };
 
-    try {
-        // Load the dos header in memory for further analysis
-        m_file_handle.read(
-            nt_headers_raw,
-            sizeof(Win32::IMAGE_NT_HEADERS64)
-        );
-
-    } catch (const std::ios::failure& ex) {
+    // Load the nt headers in memory for further analysis
+    if(!ReadAt(m_dos_header.e_lfanew, nt_headers_raw, sizeof(Win32::IMAGE_NT_HEADERS64))) {
         return false;
     }
 
@@ -599,11 +1131,14 @@ bool PeFile::ParseAndVerifyNtHeaders()
  * functions won't be loaded in memory.
  * This can save quite a lot of memory and execution time depending on the
  * file imports size
+ * @param access_mode
+ * How the bytes of the file are read. With the memory mapped mode, the whole image
+ * is mapped once and regions are handed out without any copy or stream operation
  * @return std::optional<PeFile> If the process succeeded, the file will be
  * returned. Otherwise nullopt will be returned to signal a invalid file
  */
 Result<std::shared_ptr<PeFile>, const char*>
-PeFile::Load(const std::filesystem::path& path, const LoadOption& load_option)
+PeFile::Load(const std::filesystem::path& path, const LoadOption& load_option, const AccessMode& access_mode)
 {
     const auto file_size = std::filesystem::file_size(path);
     // If the file size is somehow smaller than the two first structures. Just cancel the parsing
@@ -617,30 +1152,84 @@ PeFile::Load(const std::filesystem::path& path, const LoadOption& load_option)
     // Create the struct and create the handle to the file using the open function.
     auto pe = std::make_shared<PeFile>();
     pe->m_load_option = load_option;
+    pe->m_access_mode = access_mode;
+    pe->m_file_size = file_size;
+    pe->m_path = path;
+    pe->m_image_builder = ImageBuilder(file_size);
 
     // Open the file and verify if the handle is valid
+    // The stream is only used for reading, the modifications are written when committing
     pe->m_file_handle.open(
         path,
-        std::ios::in | std::ios::out | std::ios::binary
+        std::ios::in | std::ios::binary
     );
 
     if(!pe->m_file_handle.is_open()) {
         return Err("Could not open the file");
     }
 
-    if(!pe->ParseAndVerifyDosHeader()) {
-        return Err("The dos header is invalid");
+    if(pe->m_access_mode == AccessMode::MEMORY_MAPPED)
+    {
+        auto mapping_res = FileMapping::Open(path);
+        if(mapping_res.isErr()) {
+            return Err(mapping_res.unwrapErr());
+        }
+
+        pe->m_mapping = mapping_res.unwrap();
     }
 
-    try {
-        // Seek to the absolute position of e_lfanew
-        pe->m_file_handle.seekg(
-            pe->m_dos_header.e_lfanew,
-            pe->m_file_handle.beg
-        );
+    return Parse(pe);
+}
 
-    } catch (const std::ios::failure& ex) {
-        return Err("Failed to reach the nt header location");
+/**
+ * @brief
+ * Loads an image given in memory, for the callers which don't have it in a file.
+ * The image is copied and accessed like a memory mapped file, the caller's buffer is never modified.
+ * The modifications can't be committed to a file, they are given back with CommitTo.
+ *
+ * @param image The whole image
+ * @param load_option See the other overload
+ * @return Result<std::shared_ptr<PeFile>, const char*> The parsed image or an error message
+ */
+Result<std::shared_ptr<PeFile>, const char*>
+PeFile::Load(std::span<const std::uint8_t> image, const LoadOption& load_option)
+{
+    constexpr auto headers_size = sizeof(Win32::IMAGE_DOS_HEADER) + sizeof(Win32::IMAGE_NT_HEADERS32);
+    if(image.size() < headers_size)
+    {
+        return Err("File size invalid");
+    }
+
+    auto pe = std::make_shared<PeFile>();
+    pe->m_load_option = load_option;
+    pe->m_access_mode = AccessMode::MEMORY_MAPPED;
+    pe->m_file_size = image.size();
+    pe->m_image_builder = ImageBuilder(image.size());
+
+    auto mapping_res = FileMapping::FromBuffer(image);
+    if(mapping_res.isErr()) {
+        return Err(mapping_res.unwrapErr());
+    }
+
+    pe->m_mapping = mapping_res.unwrap();
+
+    return Parse(pe);
+}
+
+/**
+ * @brief
+ * Parses the headers and the sections of an image once its bytes can be read
+ *
+ * @param pe The image, with its size and its stream or mapping set
+ * @return Result<std::shared_ptr<PeFile>, const char*> The image or an error message
+ */
+Result<std::shared_ptr<PeFile>, const char*>
+PeFile::Parse(std::shared_ptr<PeFile> pe)
+{
+    const auto file_size = pe->m_file_size;
+
+    if(!pe->ParseAndVerifyDosHeader()) {
+        return Err("The dos header is invalid");
     }
 
     // Load the nt header in memory
@@ -684,7 +1273,11 @@ PeFile::Load(const std::filesystem::path& path, const LoadOption& load_option)
         if(!pe->LoadImports()) {
             return Err("Failed to load the imports");
         }
+
+        if(!pe->LoadFunctions()) {
+            return Err("Failed to load the exception directory");
+        }
     }
 
     return Ok(pe);
-}
\ No newline at end of file
+}
@@ -0,0 +1,199 @@
+#include <PrologueScanner.hpp>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <optional>
+
+#include <utl/Utl.hpp>
+#include <Zydis/Zydis.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define IGNOTUM_SCANNER_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    constexpr std::uint8_t INT3 = 0xCC;
+    constexpr std::uint8_t NOP = 0x90;
+    constexpr std::uint8_t RET = 0xC3;
+
+    struct Prologue { std::array<std::uint8_t, 4> bytes; std::uint8_t size; };
+
+    constexpr std::array<Prologue, 18> PROLOGUES_AMD64{{
+        { { 0x48, 0x89, 0x5C, 0x24 }, 4 }, // mov [rsp+x], rbx
+        { { 0x48, 0x89, 0x4C, 0x24 }, 4 }, // mov [rsp+x], rcx
+        { { 0x48, 0x89, 0x54, 0x24 }, 4 }, // mov [rsp+x], rdx
+        { { 0x48, 0x89, 0x6C, 0x24 }, 4 }, // mov [rsp+x], rbp
+        { { 0x48, 0x89, 0x74, 0x24 }, 4 }, // mov [rsp+x], rsi
+        { { 0x48, 0x89, 0x7C, 0x24 }, 4 }, // mov [rsp+x], rdi
+        { { 0x4C, 0x89, 0x44, 0x24 }, 4 }, // mov [rsp+x], r8
+        { { 0x4C, 0x89, 0x4C, 0x24 }, 4 }, // mov [rsp+x], r9
+        { { 0x48, 0x83, 0xEC }, 3 },       // sub rsp, imm8
+        { { 0x48, 0x81, 0xEC }, 3 },       // sub rsp, imm32
+        { { 0x48, 0x8B, 0xC4 }, 3 },       // mov rax, rsp
+        { { 0x4C, 0x8B, 0xDC }, 3 },       // mov r11, rsp
+        { { 0x55, 0x48, 0x89, 0xE5 }, 4 }, // push rbp; mov rbp, rsp
+        { { 0x55, 0x48, 0x8B, 0xEC }, 4 }, // push rbp; mov rbp, rsp
+        { { 0x40, 0x53 }, 2 },             // push rbx
+        { { 0x40, 0x55 }, 2 },             // push rbp
+        { { 0x40, 0x56 }, 2 },             // push rsi
+        { { 0x40, 0x57 }, 2 },             // push rdi
+    }};
+
+    FORCE_INLINE bool IsPadding(const std::uint8_t value)
+    {
+        return value == INT3 || value == NOP;
+    }
+
+    FORCE_INLINE bool IsBoundary(const std::uint8_t previous, const std::uint8_t current)
+    {
+        return (IsPadding(previous) || previous == RET) && !IsPadding(current);
+    }
+
+    bool MatchesPrologue(std::span<const std::uint8_t> code, const std::size_t position, std::span<const Prologue> prologues)
+    {
+        return std::any_of(prologues.begin(), prologues.end(), [&](const Prologue& prologue) {
+            return code.size() - position >= prologue.size &&
+                   std::memcmp(code.data() + position, prologue.bytes.data(), prologue.size) == 0;
+        });
+    }
+
+    /**
+     * @brief
+     * Decodes a candidate from its prologue to find where it ends, which is after its first ret,
+     * before the padding that follows it or at the next candidate.
+     * The code past a ret may be another function without a known prologue, so it is left out
+     * rather than risking to patch over its entry.
+     *
+     * @return The end of the function relative to the code, or nothing when an instruction
+     * does not decode or runs over the next candidate
+     */
+    std::optional<std::uint32_t> FindFunctionEnd(const ZydisDecoder& decoder, std::span<const std::uint8_t> code, std::size_t position, const std::size_t limit)
+    {
+        ZydisDecodedInstruction instruction;
+        while(position < limit)
+        {
+            // The length is bounded by the next candidate so an instruction overlapping it fails to decode
+            if(!ZYAN_SUCCESS(ZydisDecoderDecodeInstruction(&decoder, nullptr, code.data() + position, limit - position, &instruction))) {
+                return std::nullopt;
+            }
+
+            if(instruction.mnemonic == ZYDIS_MNEMONIC_INT3 || instruction.mnemonic == ZYDIS_MNEMONIC_NOP) {
+                break;
+            }
+
+            position += instruction.length;
+            if(instruction.mnemonic == ZYDIS_MNEMONIC_RET) {
+                break;
+            }
+        }
+
+        return static_cast<std::uint32_t>(position);
+    }
+
+    /**
+     * @brief
+     * Collects the positions where a function may start, which are the positions
+     * following a ret or padding that don't hold padding themselves.
+     * The start of the code is always a candidate.
+     */
+    std::vector<std::uint32_t> FindBoundaries(std::span<const std::uint8_t> code)
+    {
+        std::vector<std::uint32_t> boundaries;
+        if(code.empty()) {
+            return boundaries;
+        }
+
+        boundaries.push_back(0);
+
+        std::size_t position = 1;
+#if defined(IGNOTUM_SCANNER_SSE2)
+        const auto int3 = _mm_set1_epi8(static_cast<char>(INT3));
+        const auto nop = _mm_set1_epi8(static_cast<char>(NOP));
+        const auto ret = _mm_set1_epi8(static_cast<char>(RET));
+
+        // Each lane compares a byte with the one before it, loaded from the same block shifted by one
+        for(; position + 16 <= code.size(); position += 16)
+        {
+            const auto current = _mm_loadu_si128(std::bit_cast<const __m128i*>(code.data() + position));
+            const auto previous = _mm_loadu_si128(std::bit_cast<const __m128i*>(code.data() + position - 1));
+
+            const auto current_padding = _mm_or_si128(_mm_cmpeq_epi8(current, int3), _mm_cmpeq_epi8(current, nop));
+            const auto previous_end = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(previous, int3), _mm_cmpeq_epi8(previous, nop)),
+                _mm_cmpeq_epi8(previous, ret)
+            );
+
+            auto mask = static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_andnot_si128(current_padding, previous_end)));
+            while(mask != 0)
+            {
+                boundaries.push_back(static_cast<std::uint32_t>(position + std::countr_zero(mask)));
+                mask &= mask - 1;
+            }
+        }
+#endif
+        // Whatever the vector loop did not cover
+        for(; position < code.size(); ++position)
+        {
+            if(IsBoundary(code[position - 1], code[position])) {
+                boundaries.push_back(static_cast<std::uint32_t>(position));
+            }
+        }
+
+        return boundaries;
+    }
+}
+
+/**
+ * @brief
+ * Scans a block of code for the functions it contains.
+ * A function spans from its prologue up to its first ret, the padding after it
+ * or the start of the next function, whichever comes first. The candidates that
+ * can't be decoded up to their end are dropped.
+ * Only x64 code is scanned since the translation decodes nothing else.
+ *
+ * @param code The bytes of an executable section
+ * @param code_rva Rva of the first byte of the code
+ * @param arch Architecture of the image, nothing is found unless it's AMD64
+ * @return std::vector<FunctionIndex::Function> The functions found, sorted by rva
+ */
+std::vector<FunctionIndex::Function> PrologueScanner::Scan(
+    std::span<const std::uint8_t> code,
+    const std::uint32_t code_rva,
+    const Win32::Architecture arch
+)
+{
+    std::vector<FunctionIndex::Function> functions;
+    if(arch != Win32::Architecture::AMD64) {
+        return functions;
+    }
+
+    ZydisDecoder decoder;
+    ZydisDecoderInit(&decoder, ZYDIS_MACHINE_MODE_LONG_64, ZYDIS_STACK_WIDTH_64);
+
+    std::vector<std::uint32_t> starts;
+    for(const auto boundary : FindBoundaries(code))
+    {
+        if(MatchesPrologue(code, boundary, PROLOGUES_AMD64)) {
+            starts.push_back(boundary);
+        }
+    }
+
+    functions.reserve(starts.size());
+    for(std::size_t i = 0; i < starts.size(); ++i)
+    {
+        const auto limit = i + 1 < starts.size() ? starts[i + 1] : code.size();
+
+        const auto end = FindFunctionEnd(decoder, code, starts[i], limit);
+        if(!end || *end == starts[i]) {
+            continue;
+        }
+
+        functions.push_back(FunctionIndex::Function{ code_rva + starts[i], code_rva + *end });
+    }
+
+    return functions;
+}
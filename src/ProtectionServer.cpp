@@ -0,0 +1,319 @@
+#include <ProtectionServer.hpp>
+
+#include <atomic>
+#include <bit>
+#include <list>
+#include <optional>
+#include <string_view>
+#include <thread>
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#if !defined(_WIN32)
+namespace
+{
+    // A request is a single line, anything longer is rejected
+    constexpr std::size_t MAX_REQUEST_SIZE = 0x10000;
+
+    // A client which went away must not kill the server with a SIGPIPE
+#if defined(MSG_NOSIGNAL)
+    constexpr int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+    constexpr int SEND_FLAGS = 0;
+#endif
+
+    Result<sockaddr_un, const char*> SocketAddress(const std::filesystem::path& socket_path)
+    {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+
+        const auto& native_path = socket_path.native();
+        if(native_path.empty() || native_path.size() >= sizeof(address.sun_path)) {
+            return Err("The socket path is empty or too long");
+        }
+
+        std::memcpy(address.sun_path, native_path.c_str(), native_path.size() + 1);
+        return Ok(address);
+    }
+
+    /**
+     * @brief
+     * Reads the socket up to the first line break.
+     * A peer closing its side without a line break ends the line as well
+     *
+     * @return std::optional<std::string> The line without its line break, nothing if the read failed
+     */
+    std::optional<std::string> ReadLine(const int fd)
+    {
+        std::string line;
+        char buffer[0x1000];
+
+        while(line.size() < MAX_REQUEST_SIZE)
+        {
+            const auto received = recv(fd, buffer, sizeof(buffer), 0);
+            if(received < 0)
+            {
+                if(errno == EINTR) {
+                    continue;
+                }
+
+                return {};
+            }
+
+            if(received == 0) {
+                break;
+            }
+
+            line.append(buffer, static_cast<std::size_t>(received));
+            if(const auto line_end = line.find('\n'); line_end != std::string::npos) {
+                line.resize(line_end);
+                break;
+            }
+        }
+
+        if(line.size() >= MAX_REQUEST_SIZE) {
+            return {};
+        }
+
+        if(!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+
+        return line;
+    }
+
+    bool WriteAll(const int fd, std::string_view data)
+    {
+        while(!data.empty())
+        {
+            const auto sent = send(fd, data.data(), data.size(), SEND_FLAGS);
+            if(sent < 0)
+            {
+                if(errno == EINTR) {
+                    continue;
+                }
+
+                return false;
+            }
+
+            data.remove_prefix(static_cast<std::size_t>(sent));
+        }
+
+        return true;
+    }
+
+    // Runs the job of a connection and answers with its result
+    void HandleConnection(const int client, const ProtectionServer::Handler& handler)
+    {
+        const auto request = ReadLine(client);
+        if(!request) {
+            static_cast<void>(WriteAll(client, "error The request could not be read\n"));
+            return;
+        }
+
+        const auto response = [&]() -> std::string {
+            const auto entry_res = JobManifest::ParseLine(*request, {});
+            if(entry_res.isErr()) {
+                return std::string("error ") + entry_res.unwrapErr();
+            }
+
+            // The server doesn't run in the directory of the client, a relative path would be ambiguous
+            const auto entry = entry_res.unwrap();
+            if(entry.input.is_relative() || entry.output.is_relative()) {
+                return "error The paths of a job must be absolute";
+            }
+
+            const auto protect_res = handler(entry);
+            if(protect_res.isErr()) {
+                return std::string("error ") + protect_res.unwrapErr();
+            }
+
+            return "ok";
+        }();
+
+        static_cast<void>(WriteAll(client, response + "\n"));
+    }
+}
+#endif
+
+ProtectionServer::~ProtectionServer()
+{
+#if !defined(_WIN32)
+    if(m_socket >= 0) {
+        close(m_socket);
+    }
+
+    std::error_code ec;
+    std::filesystem::remove(m_path, ec);
+#endif
+}
+
+/**
+ * @brief
+ * Creates the socket and starts listening on it. A socket left behind by a server
+ * which didn't exit cleanly is replaced, but not the socket of a running server.
+ *
+ * @param socket_path Path of the socket
+ * @return Result<std::shared_ptr<ProtectionServer>, const char*> The server or an error message
+ */
+Result<std::shared_ptr<ProtectionServer>, const char*>
+ProtectionServer::Listen(const std::filesystem::path& socket_path)
+{
+#if defined(_WIN32)
+    static_cast<void>(socket_path);
+    return Err("The server is only available on unix systems");
+#else
+    const auto address_res = SocketAddress(socket_path);
+    if(address_res.isErr()) {
+        return Err(address_res.unwrapErr());
+    }
+
+    const auto address = address_res.unwrap();
+
+    std::error_code ec;
+    if(std::filesystem::is_socket(socket_path, ec))
+    {
+        const int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        const bool in_use = probe >= 0 && connect(probe, std::bit_cast<const sockaddr*>(&address), sizeof(address)) == 0;
+        if(probe >= 0) {
+            close(probe);
+        }
+
+        if(in_use) {
+            return Err("A server is already listening on the socket");
+        }
+
+        std::filesystem::remove(socket_path, ec);
+    }
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0) {
+        return Err("Could not create the socket");
+    }
+
+    // Only the user running the server can connect. The mask is set before any job runs
+    const auto previous_mask = umask(0077);
+    const auto bind_res = bind(fd, std::bit_cast<const sockaddr*>(&address), sizeof(address));
+    umask(previous_mask);
+
+    if(bind_res != 0) {
+        close(fd);
+        return Err("Could not bind the socket to its path");
+    }
+
+    if(listen(fd, SOMAXCONN) != 0) {
+        close(fd);
+        std::filesystem::remove(socket_path, ec);
+        return Err("Could not listen on the socket");
+    }
+
+    return Ok(std::shared_ptr<ProtectionServer>(new ProtectionServer(fd, socket_path)));
+#endif
+}
+
+/**
+ * @brief
+ * Accepts the connections and runs their job until accepting fails.
+ * Every connection is handled on its own thread, the finished ones are joined as new ones come in.
+ *
+ * @param handler Protects the file of a job. It's called concurrently
+ * @return Result<bool, const char*> Only returns on an error, once every connection is finished
+ */
+Result<bool, const char*> ProtectionServer::Serve(const Handler& handler)
+{
+#if defined(_WIN32)
+    static_cast<void>(handler);
+    return Err("The server is only available on unix systems");
+#else
+    struct Connection
+    {
+        std::atomic<bool> finished{ false };
+        std::jthread thread;
+    };
+
+    // The nodes of a list don't move, a thread can keep a reference to its connection
+    std::list<Connection> connections;
+
+    while(true)
+    {
+        const int client = accept(m_socket, nullptr, nullptr);
+        if(client < 0)
+        {
+            if(errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+
+            return Err("Accepting a connection failed");
+        }
+
+        // Removing a connection joins its thread, which is done once the flag is set
+        connections.remove_if([](const Connection& connection) {
+            return connection.finished.load(std::memory_order_acquire);
+        });
+
+        auto& connection = connections.emplace_back();
+        connection.thread = std::jthread([&handler, &connection, client]() {
+            HandleConnection(client, handler);
+            close(client);
+            connection.finished.store(true, std::memory_order_release);
+        });
+    }
+#endif
+}
+
+/**
+ * @brief
+ * Submits a job to a running server and waits for it to be done
+ *
+ * @param socket_path Path of the socket of the server
+ * @param entry The job. Its paths must be absolute
+ * @return Result<std::string, const char*> The answer of the server, "ok" or "error [message]",
+ * or an error message if the server could not be reached
+ */
+Result<std::string, const char*>
+ProtectionServer::Submit(const std::filesystem::path& socket_path, const JobManifest::Entry& entry)
+{
+#if defined(_WIN32)
+    static_cast<void>(socket_path);
+    static_cast<void>(entry);
+    return Err("The server is only available on unix systems");
+#else
+    const auto address_res = SocketAddress(socket_path);
+    if(address_res.isErr()) {
+        return Err(address_res.unwrapErr());
+    }
+
+    const auto address = address_res.unwrap();
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0) {
+        return Err("Could not create the socket");
+    }
+
+    if(connect(fd, std::bit_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        close(fd);
+        return Err("Could not connect to the server");
+    }
+
+    if(!WriteAll(fd, JobManifest::FormatLine(entry) + "\n")) {
+        close(fd);
+        return Err("Could not send the job to the server");
+    }
+
+    const auto response = ReadLine(fd);
+    close(fd);
+
+    if(!response || response->empty()) {
+        return Err("The server did not answer");
+    }
+
+    return Ok(*response);
+#endif
+}
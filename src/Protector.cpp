@@ -0,0 +1,731 @@
+#include <Protector.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <thread>
+
+#include <BoundedQueue.hpp>
+#include <BuildLayout.hpp>
+#include <Cryptography.hpp>
+#include <DecodedRegion.hpp>
+#include <NativeEmitter/x64NativeEmitter.hpp>
+#include <Translation.hpp>
+#include <TranslationArena.hpp>
+#include <TranslationContext.hpp>
+#include <utl/Utl.hpp>
+
+#include <spdlog/spdlog.h>
+
+namespace
+{
+    /**
+     * @brief
+     * Places a translated region in the virtual code section and patches the native region to enter
+     * the virtual machine. Both are staged right away, they are copied in the image builder or written
+ * to its work image when the file is streamed.
+     * A kept region stays at its previous offset, another one takes the first free range fitting it
+     * or goes after the end of the section. Called in the order of the regions, so the offsets don't
+     * depend on the order the regions were translated in.
+     *
+     * @param proc_context The context of the translation
+     * @param native_emitter Emitter used to relocate the block and to patch the native region
+     * @param region_pair The rva and size of the region
+     * @param instruction_block The native region, patched in place
+     * @param translated_block The block returned by the translation, nothing for a kept region
+     * @param reused_region Where the region was in the previous build when it's kept from it
+     * @param free_ranges The free ranges of the previous section, the range used is shrunk
+     * @param vcode_end The end of the section, moved when the region is appended
+     * @param source_hash Hash of the native code before it's patched
+     * @return Result<mainspace::TranslatedRegion, const char*> The placed region or an error message
+     */
+    Result<mainspace::TranslatedRegion, const char*>
+    PlaceTranslatedRegion(
+        const mainspace::BeginProcessContext& proc_context,
+        const std::shared_ptr<x64NativeEmitter>& native_emitter,
+        const std::pair<std::size_t, std::size_t>& region_pair,
+        MappedMemory& instruction_block,
+        std::optional<Translation::TranslatedBlock>& translated_block,
+        const std::optional<BuildLayout::Region>& reused_region,
+        std::vector<std::pair<std::uint32_t, std::uint32_t>>& free_ranges,
+        std::uint32_t& vcode_end,
+        const std::uint64_t source_hash
+    )
+    {
+        const auto start_address = region_pair.first;
+
+        std::uint32_t vcode_offset{ 0 };
+        if(reused_region) {
+            vcode_offset = reused_region->vcode_offset;
+        }
+        else
+        {
+            if(!translated_block) {
+                return Err("The translation failed");
+            }
+
+            const auto translated_size = translated_block->bytecode.Size();
+
+            const auto free_range = std::find_if(free_ranges.begin(), free_ranges.end(), [&](const auto& range) {
+                return range.second >= translated_size;
+            });
+
+            if(free_range != free_ranges.end())
+            {
+                vcode_offset = free_range->first;
+                free_range->first += static_cast<std::uint32_t>(translated_size);
+                free_range->second -= static_cast<std::uint32_t>(translated_size);
+            }
+            else
+            {
+                if(std::numeric_limits<std::uint32_t>::max() - vcode_end < translated_size) {
+                    return Err("The translated code does not fit in a section");
+                }
+
+                vcode_offset = vcode_end;
+                vcode_end += static_cast<std::uint32_t>(translated_size);
+            }
+        }
+
+        const Translation::Context context(
+            start_address,
+            region_pair.second,
+            proc_context.vm_section.VirtualAddress,
+            proc_context.vm_section.Misc.VirtualSize,
+            proc_context.vcode_section.VirtualAddress + vcode_offset, // Where the block is placed in the virtual code section
+            std::numeric_limits<std::uint32_t>::max() - vcode_offset
+        );
+
+        // The first key encodes the entry of the region, the next ones are used by the re-entry stubs
+        cryptography::KeyStream keys(proc_context.key_seed, static_cast<std::uint32_t>(start_address));
+        const auto enc_key = keys.Next16BitKey();
+
+        // The code of a kept region is already relocated for this offset, it's copied as is.
+        // The keys of the region are the same as well, the layout gives the seed of the previous build
+        std::span<const std::uint8_t> vcode;
+        if(reused_region)
+        {
+            vcode = proc_context.previous->vcode.subspan(reused_region->vcode_offset, reused_region->vcode_size);
+        }
+        else
+        {
+            if(!Translation::RelocateBlock(*translated_block, native_emitter, context, keys)) {
+                return Err("The relocation of the translated code failed");
+            }
+
+            vcode = translated_block->bytecode.Span();
+        }
+
+        // The translated code is staged in the '.Ign2' section right away, the translation buffer can then be released.
+        // The section is only planned at this point, it's added once every region is placed
+        const auto vcode_write_res = proc_context.pe_file->WriteToSection(proc_context.vcode_section, vcode_offset, vcode);
+        if(vcode_write_res.isErr()) {
+            return Err(vcode_write_res.unwrapErr());
+        }
+
+        // Write the patched instructions to the buffer to patch the region
+        const std::uint32_t section_offset_raw = context.vcode_block_rva - proc_context.vm_section.VirtualAddress;
+        if(section_offset_raw > std::numeric_limits<std::uint16_t>::max()) {
+            return Err("The section offset is too big");
+        }
+
+        // Encode the VIP(virtual instruction pointer) with the key of the region
+        const std::uint32_t encoded_section_offset = cryptography::EncodeVIPEntry(section_offset_raw, enc_key);
+
+        /// Patching section.
+        /// This part is in charge of removing the original instructions with
+        /// NOPs.
+
+        // Emit a push instruction with the encoded value containing the
+        // offset of where the vip should start
+        // In x86, this would look like this [push 0xdeadbeef]
+        if(!native_emitter->EmitPush32Bit(encoded_section_offset, instruction_block)) {
+            return Err("The buffer is too small to call the virtual machine");
+        }
+
+        // Calculate the distance from the rva to the virtual machine inside the file
+        // This offset will be used to generate a call inside the virtual machine
+        const auto call_offset = proc_context.vm_section.VirtualAddress - (start_address + instruction_block.CursorPos());
+
+        // Emit the call instruction using the relative offset that we just calculated
+        if(!native_emitter->EmitNearCall(call_offset, instruction_block)) {
+            return Err("The buffer is too small to call the virtual machine");
+        }
+
+        // Overwrite everything after the new instructions and replace them
+        // With 0x90(NOP) to remove any original instructions
+        const auto size_remaining = instruction_block.Size() - instruction_block.CursorPos();
+        std::memset(instruction_block.InnerPtrRaw() + instruction_block.CursorPos(), '\x90', size_remaining);
+
+        // Once this is all done, the patched function should look like this
+        // Push 0xdeadbeef // Encoded vip location
+        // Call vm // Relative offset to the virtual machione
+        // Write the patched buffer back to the original location
+        const auto native_overwrite_res = proc_context.pe_file->WriteToRegion(static_cast<std::uint32_t>(start_address), instruction_block);
+        if(native_overwrite_res.isErr()) {
+            return Err("Could not patch the original native code");
+        }
+
+        return Ok(mainspace::TranslatedRegion{
+            static_cast<std::uint32_t>(start_address),
+            static_cast<std::uint32_t>(region_pair.second),
+            vcode_offset,
+            static_cast<std::uint32_t>(vcode.size()),
+            source_hash
+        });
+    }
+}
+
+/**
+ * @brief
+ * This function goes over all of the provided virtual addresses and loads the regions
+ * in memory. Once loaded, these regions are then translated to the custom p-code.
+ * The translated code and the patched regions are staged in the file as soon as they're placed,
+ * the returned regions only tell where everything went so the virtual code section can be sized.
+ *
+ * The regions flow through a pipeline of three stages. A reader thread loads them, the
+ * threads of the pool translate them concurrently, since the translated code doesn't depend
+ * on where it's placed, and a writer thread takes them back in order to assign their offsets
+ * in the virtual code section and fill every field depending on these offsets.
+ * At most a few regions per thread are between the reader and the writer, which bounds the memory
+ * used by the translation buffers whatever the amount of regions. The keys are derived from the
+ * seed and the rva of each region, which gives the same result whatever the amount of threads.
+ *
+ * With a memory budget, the file is streamed to its work image so nothing staged stays in memory.
+ * The reader holds a region back while its footprint and the one of the regions in flight would go
+ * over the budget, and a region that can't fit in the budget on its own is rejected before anything starts.
+ *
+ * @param proc_context
+ * The sections in the context are the planned ones. The translated code is staged at the raw address of the planned '.Ign2'
+ * @return Result<std::vector<mainspace::TranslatedRegion>, const char*>
+ * Every translated region in the order they were given, or an error message
+ */
+Result<std::vector<mainspace::TranslatedRegion>, const char*>
+Protector::BeginTranslationProcess(const mainspace::BeginProcessContext& proc_context)
+{
+    using Clock = std::chrono::steady_clock;
+    const auto elapsed_ns = [](const Clock::time_point since) {
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - since).count());
+    };
+
+    const auto& region_pairs = proc_context.region_pairs;
+    const auto region_count = region_pairs.size();
+    const auto* previous = proc_context.previous;
+    auto native_emitter = std::make_shared<x64NativeEmitter>();
+
+    // The regions kept from the previous build stay where they were. The other ones go in the first
+    // free range of the previous virtual code section that fits them, or after its end.
+    // The kept regions must be known before placing the first changed one, they are found before the pipeline starts
+    std::vector<std::optional<BuildLayout::Region>> reused_regions(region_count);
+
+    // (offset, size) of the ranges of the previous section not used by a kept region, by ascending offset
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> free_ranges;
+    // The section can't grow more than 4.2gb because of the windows header definition
+    std::uint32_t vcode_end{ 0 };
+
+    if(previous != nullptr)
+    {
+        std::vector<BuildLayout::Region> kept_regions;
+        for(std::size_t i = 0; i < region_count; ++i)
+        {
+            const auto [start_address, block_size] = region_pairs[i];
+            const auto previous_region = previous->layout.Find(static_cast<std::uint32_t>(start_address));
+            if(!previous_region || previous_region->size != block_size) {
+                continue;
+            }
+
+            auto instruction_block_res = proc_context.pe_file->LoadRegion(start_address, block_size);
+            if(instruction_block_res.isErr()) {
+                return Err("The provided address could not be loaded in memory");
+            }
+
+            const auto instruction_block = instruction_block_res.unwrap();
+            if(previous_region->source_hash == Utl::Fnv1a64({ instruction_block.InnerPtrRaw(), instruction_block.Size() })) {
+                reused_regions[i] = previous_region;
+                kept_regions.push_back(*previous_region);
+            }
+        }
+
+        spdlog::info("{} of {} regions unchanged since the previous build", kept_regions.size(), region_count);
+
+        std::sort(kept_regions.begin(), kept_regions.end(), [](const BuildLayout::Region& a, const BuildLayout::Region& b) {
+            return a.vcode_offset < b.vcode_offset;
+        });
+
+        for(const auto& kept_region : kept_regions)
+        {
+            if(kept_region.vcode_offset > vcode_end) {
+                free_ranges.emplace_back(vcode_end, kept_region.vcode_offset - vcode_end);
+            }
+
+            vcode_end = std::max(vcode_end, kept_region.vcode_offset + kept_region.vcode_size);
+        }
+
+        if(previous->layout.vcode_size > vcode_end) {
+            free_ranges.emplace_back(vcode_end, previous->layout.vcode_size - vcode_end);
+        }
+
+        vcode_end = std::max(vcode_end, previous->layout.vcode_size);
+    }
+
+    // A region handed from the translation stage to the writer. The slot of region i is i % slot count.
+    // The bytecode of the region lives in the arena of its slot, which the writer resets for the next region
+    // of the slot once the region is placed. The arena keeps about the memory its last region used
+    struct TranslatedSlot
+    {
+        std::atomic<std::size_t> ready{ 0 }; // Index of the region in the slot plus one, once it's translated
+        std::optional<Translation::TranslatedBlock> block;
+        std::uint64_t source_hash{ 0 };
+        TranslationArena arena;
+        std::uint64_t retained{ 0 }; // Capacity of the arena while the slot is idle, charged against the budget
+        std::uint64_t charge{ 0 }; // What the region in the slot is charged against the budget
+    };
+
+    const auto worker_count = proc_context.pool.Concurrency();
+    const auto window = std::max<std::size_t>(2 * worker_count, 8);
+
+    std::vector<std::optional<MappedMemory>> instruction_blocks(region_count);
+    BoundedQueue<std::size_t> loaded_regions(window);
+    std::vector<TranslatedSlot> slots(window);
+
+    std::atomic<std::size_t> written_count{ 0 };
+    std::atomic<bool> aborted{ false };
+    std::atomic<std::size_t> cache_hits{ 0 };
+    const char* reader_error{ nullptr };
+    const char* writer_error{ nullptr };
+
+    // The stages sleep while they wait on each other. The regions still go through the atomics,
+    // the mutex only makes sure a stage can't miss a notification between its check and its wait
+    std::mutex stage_mutex;
+    std::condition_variable region_written; // The writer placed a region, the reader may load more
+    std::condition_variable region_translated; // A slot is ready, the writer may place it
+    const auto notify = [&](std::condition_variable& condition) {
+        {
+            std::lock_guard lock(stage_mutex);
+        }
+
+        condition.notify_all();
+    };
+
+    // Wakes every stage, the ones waiting on the aborted stage would never be notified otherwise
+    const auto abort = [&]() {
+        aborted = true;
+        notify(region_written);
+        notify(region_translated);
+    };
+
+    mainspace::StageStats reader_stats;
+    mainspace::StageStats translate_stats;
+    mainspace::StageStats writer_stats;
+
+    std::vector<mainspace::TranslatedRegion> translated_regions;
+    translated_regions.reserve(region_count);
+
+    // Memory budget.
+    // A region is charged its patched native pages and the arena of its slot, at least the most the arena
+    // holds while translating it, from the time it's loaded to the time it's placed. The writer then streams
+    // both to the work image and gives the pages back to the mapping. What the arena of an idle slot keeps
+    // for its next region stays charged as retained bytes
+    const auto memory_budget = proc_context.memory_budget;
+    std::atomic<std::uint64_t> in_flight_bytes{ 0 };
+    std::atomic<std::uint64_t> retained_bytes{ 0 };
+
+    // A kept region isn't translated, it has no translation buffer
+    const auto arena_footprint = [&](const std::size_t i) -> std::uint64_t {
+        return reused_regions[i] ? 0 : Translation::ArenaFootprint(region_pairs[i].second);
+    };
+
+    const auto region_charge = [&](const std::size_t i, const TranslatedSlot& slot) -> std::uint64_t {
+        return std::max(arena_footprint(i), slot.retained) + region_pairs[i].second;
+    };
+
+    if(memory_budget != 0)
+    {
+        if(!proc_context.pe_file->Streaming()) {
+            return Err("A memory budget needs the file to be streamed to its work image");
+        }
+
+        for(std::size_t i = 0; i < region_count; ++i)
+        {
+            const auto footprint = arena_footprint(i) + region_pairs[i].second;
+            if(footprint > memory_budget) {
+                spdlog::error("The region at 0x{:X} needs {} bytes to be translated", region_pairs[i].first, footprint);
+                return Err("A region needs more memory than the memory budget");
+            }
+        }
+    }
+
+    // Reader stage.
+    // Waits for the writer when the window is full, that's what bounds the regions in flight
+    std::jthread reader([&]() {
+        for(std::size_t i = 0; i < region_count; ++i)
+        {
+            auto wait_start = Clock::now();
+            {
+                std::unique_lock lock(stage_mutex);
+                region_written.wait(lock, [&]() {
+                    return i < written_count.load(std::memory_order_acquire) + slots.size() || aborted;
+                });
+            }
+
+            // A region which doesn't fit in what's left of the budget waits for the regions in flight.
+            // The arena of its slot becomes part of its charge instead of being retained.
+            // Every region fits in the budget on its own, once nothing is in flight the idle arenas are released
+            if(memory_budget != 0)
+            {
+                auto& slot = slots[i % slots.size()];
+                const auto fits = [&]() {
+                    return in_flight_bytes.load(std::memory_order_acquire) + retained_bytes.load(std::memory_order_acquire) -
+                           slot.retained + region_charge(i, slot) <= memory_budget;
+                };
+
+                {
+                    std::unique_lock lock(stage_mutex);
+                    region_written.wait(lock, [&]() {
+                        return fits() || in_flight_bytes.load(std::memory_order_acquire) == 0 || aborted;
+                    });
+                }
+
+                if(!fits() && !aborted)
+                {
+                    for(auto& idle_slot : slots)
+                    {
+                        idle_slot.arena.Release();
+                        retained_bytes -= idle_slot.retained;
+                        idle_slot.retained = 0;
+                    }
+                }
+
+                retained_bytes -= slot.retained;
+                slot.charge = region_charge(i, slot);
+                slot.retained = 0;
+                in_flight_bytes += slot.charge;
+            }
+
+            reader_stats.wait_ns += elapsed_ns(wait_start);
+            if(aborted) {
+                break;
+            }
+
+            const auto busy_start = Clock::now();
+            const auto [start_address, block_size] = region_pairs[i];
+            spdlog::debug("Start RVA: 0x{:X}", start_address);
+            spdlog::debug("Block size: 0x{:X}", block_size);
+            auto instruction_block_res = proc_context.pe_file->LoadRegion(start_address, block_size);
+            if(instruction_block_res.isErr()) {
+                reader_error = "The provided address could not be loaded in memory";
+                abort();
+                break;
+            }
+
+            instruction_blocks[i] = instruction_block_res.unwrap();
+            reader_stats.busy_ns += elapsed_ns(busy_start);
+
+            wait_start = Clock::now();
+            loaded_regions.Push(i);
+            reader_stats.wait_ns += elapsed_ns(wait_start);
+        }
+
+        loaded_regions.Close();
+    });
+
+    // Writer stage.
+    // Takes the regions back in order, places them and fills every field depending on their offset
+    std::jthread writer([&]() {
+        for(std::size_t i = 0; i < region_count; ++i)
+        {
+            auto& slot = slots[i % slots.size()];
+
+            const auto wait_start = Clock::now();
+            {
+                std::unique_lock lock(stage_mutex);
+                region_translated.wait(lock, [&]() { return slot.ready.load(std::memory_order_acquire) == i + 1 || aborted; });
+            }
+
+            writer_stats.wait_ns += elapsed_ns(wait_start);
+            if(slot.ready.load(std::memory_order_acquire) != i + 1) {
+                break;
+            }
+
+            const auto busy_start = Clock::now();
+            auto region_res = PlaceTranslatedRegion(
+                proc_context,
+                native_emitter,
+                region_pairs[i],
+                *instruction_blocks[i],
+                slot.block,
+                reused_regions[i],
+                free_ranges,
+                vcode_end,
+                slot.source_hash
+            );
+
+            if(region_res.isErr()) {
+                writer_error = region_res.unwrapErr();
+                abort();
+                break;
+            }
+
+            translated_regions.push_back(region_res.unwrap());
+
+            // The translation buffer is released before the slot is handed back to the translation stage,
+            // the arena is trimmed to what the region used
+            slot.block.reset();
+            instruction_blocks[i].reset();
+            if(!reused_regions[i]) {
+                slot.arena.Reset();
+            }
+
+            // Everything of the region is in the work image, its patched pages are given back to the mapping.
+            // The arena is retained before the charge is dropped, the budget is never under-estimated
+            if(memory_budget != 0) {
+                proc_context.pe_file->DiscardRegion(static_cast<std::uint32_t>(region_pairs[i].first), region_pairs[i].second);
+                slot.retained = slot.arena.Capacity();
+                retained_bytes += slot.retained;
+                in_flight_bytes -= slot.charge;
+            }
+
+            written_count.store(i + 1, std::memory_order_release);
+            notify(region_written);
+
+            writer_stats.busy_ns += elapsed_ns(busy_start);
+        }
+    });
+
+    // Translation stage, on the threads of the pool.
+    // The translated code doesn't depend on where it's placed, the fields depending on it are relocated by the writer
+    proc_context.pool.ParallelFor(worker_count, [&](const std::size_t) {
+        // Decoded instructions of the region being translated, the arrays are reused by the following regions
+        DecodedRegion decoded;
+        std::size_t i{ 0 };
+        while(true)
+        {
+            // The reader closes the queue after its last push, the workers stop once it's drained
+            const auto wait_start = Clock::now();
+            const bool popped = loaded_regions.Pop(i);
+            translate_stats.wait_ns += elapsed_ns(wait_start);
+            if(!popped) {
+                return;
+            }
+
+            const auto busy_start = Clock::now();
+            auto& slot = slots[i % slots.size()];
+            const auto& instruction_block = *instruction_blocks[i];
+            const std::span<const std::uint8_t> native_code{ instruction_block.InnerPtrRaw(), instruction_block.Size() };
+
+            slot.source_hash = Utl::Fnv1a64(native_code);
+
+            // A region unchanged since the previous build keeps its translated code, nothing to translate
+            if(!reused_regions[i])
+            {
+                const Translation::Context context(
+                    region_pairs[i].first, // Rva of the original instructions to maybe do some fixups for relative addressing
+                    region_pairs[i].second, // The size of the block
+                    proc_context.vm_section.VirtualAddress, // Pass the start of the vm RVA and the size of it
+                    proc_context.vm_section.Misc.VirtualSize,
+                    proc_context.vcode_section.VirtualAddress, // Placeholder, the block is relocated once its offset is known
+                    std::numeric_limits<std::uint32_t>::max()
+                );
+
+                // A block taken from the cache is relocated like a freshly translated one
+                if(proc_context.cache != nullptr) {
+                    slot.block = proc_context.cache->Load(native_code, slot.arena);
+                }
+
+                if(slot.block) {
+                    ++cache_hits;
+                }
+                else
+                {
+                    decoded.Decode(native_code);
+                    slot.block = Translation::TranslateInstructionBlock(instruction_block, decoded, slot.arena, native_emitter, context);
+
+                    if(proc_context.cache != nullptr && slot.block && !proc_context.cache->Store(native_code, *slot.block)) {
+                        spdlog::warn("The translation of the region at 0x{:X} could not be cached", region_pairs[i].first);
+                    }
+                }
+            }
+
+            slot.ready.store(i + 1, std::memory_order_release);
+            notify(region_translated);
+            translate_stats.busy_ns += elapsed_ns(busy_start);
+        }
+    });
+
+    reader.join();
+    writer.join();
+
+    if(proc_context.cache != nullptr) {
+        spdlog::info("{} of {} regions taken from the cache", cache_hits.load(), region_count);
+    }
+
+    // The stage with the highest occupancy is the one limiting the throughput
+    const auto log_stage = [](const char* name, const mainspace::StageStats& stats) {
+        const auto busy_ms = static_cast<double>(stats.busy_ns) / 1e6;
+        const auto wait_ms = static_cast<double>(stats.wait_ns) / 1e6;
+        const auto occupancy = busy_ms + wait_ms > 0 ? 100.0 * busy_ms / (busy_ms + wait_ms) : 0.0;
+        spdlog::info("{} stage: busy {:.1f} ms, waiting {:.1f} ms, {:.0f}% occupied", name, busy_ms, wait_ms, occupancy);
+    };
+
+    log_stage("Reader", reader_stats);
+    log_stage("Translation", translate_stats);
+    log_stage("Writer", writer_stats);
+
+    if(reader_error != nullptr) {
+        return Err(reader_error);
+    }
+
+    if(writer_error != nullptr) {
+        return Err(writer_error);
+    }
+
+    return Ok(translated_regions);
+}
+
+Result<RegionIndex, const char*>
+Protector::IndexRegions(const std::vector<RegionManifest::Entry>& entries, const PeFile& pe_file)
+{
+    auto region_index_res = RegionIndex::Build(entries, pe_file.GetSections());
+    if(region_index_res.isErr()) {
+        return Err(region_index_res.unwrapErr());
+    }
+
+    auto region_index = region_index_res.unwrap();
+    for(const auto& region : region_index.Regions())
+    {
+        if(region.Size() < mainspace::MIN_REGION_SIZE) {
+            spdlog::error("The region{}{} at 0x{:X} is 0x{:X} bytes long", region.name.empty() ? "" : " ", region.name, region.begin, region.Size());
+            return Err("A region is too small to hold the instructions entering the virtual machine");
+        }
+    }
+
+    return Ok(region_index);
+}
+
+Result<Protector::ProtectedImage, const char*> Protector::ProtectRegions(
+    const std::shared_ptr<PeFile>& pe_file,
+    const std::vector<std::pair<std::size_t, std::size_t>>& region_pairs,
+    const MappedMemory& virtual_machine,
+    ThreadPool& pool,
+    const std::uint64_t key_seed,
+    const TranslationCache* cache,
+    const mainspace::PreviousBuild* previous,
+    const std::uint64_t memory_budget
+)
+{
+    if(region_pairs.empty()) {
+        return Err("No region to translate");
+    }
+
+    // The translator decodes x64 code only, a region of a 32 bit image would be translated wrong
+    if(pe_file->Architecture() != Win32::Architecture::AMD64) {
+        return Err("Only x64 images can be protected");
+    }
+
+    // Layout phase.
+    // The first region holds the virtual machine and is sized from it.
+    // The second region holds all of the translated code. Its address only depends on the
+    // size of the first one, so it's planned now and sized once everything is translated
+    const auto vm_region_size = static_cast<std::uint32_t>(virtual_machine.Size());
+    const auto planned_regions_res = pe_file->PlanSections({
+        PeFile::SectionSpec{ ".Ign1", vm_region_size },
+        PeFile::SectionSpec{ ".Ign2", 1 }
+    });
+
+    if(planned_regions_res.isErr()) {
+        return Err(planned_regions_res.unwrapErr());
+    }
+
+    const auto planned_regions = planned_regions_res.unwrap();
+
+    const auto vm_hash = Utl::Fnv1a64({ virtual_machine.InnerPtrRaw(), virtual_machine.Size() });
+
+    // The regions of a previous build can only be kept when the sections end up at the same place
+    // and the bytecode was produced by the same translator for the same virtual machine
+    if(previous != nullptr)
+    {
+        const auto& layout = previous->layout;
+        if(layout.vm_hash != vm_hash || layout.translator_version != Translation::TRANSLATOR_VERSION)
+        {
+            spdlog::warn("The virtual machine or the translator changed since the previous build, every region is translated");
+            previous = nullptr;
+        }
+        else if(layout.vm_rva != planned_regions[0].VirtualAddress || layout.vm_size != vm_region_size ||
+                layout.vcode_rva != planned_regions[1].VirtualAddress)
+        {
+            spdlog::warn("The sections moved since the previous build, every region is translated");
+            previous = nullptr;
+        }
+    }
+
+    // The keys of the kept regions only stay valid with the seed of the previous build
+    const auto region_key_seed = previous != nullptr ? previous->layout.key_seed : key_seed;
+
+    mainspace::BeginProcessContext proc_context(
+        pe_file,
+        planned_regions[0],
+        planned_regions[1],
+        region_pairs,
+        pool,
+        region_key_seed,
+        cache,
+        previous,
+        memory_budget
+    );
+
+    const auto translated_regions_res = BeginTranslationProcess(proc_context);
+    if(translated_regions_res.isErr()) {
+        return Err(translated_regions_res.unwrapErr());
+    }
+
+    auto translated_regions = translated_regions_res.unwrap();
+
+    // The size of the translated code is now known.
+    // The section never shrinks in incremental mode, which keeps the headers the same as the previous build
+    std::uint32_t vcode_region_size = previous != nullptr ? std::max(previous->layout.vcode_size, 1u) : 1;
+    for(const auto& region : translated_regions) {
+        vcode_region_size = std::max(vcode_region_size, region.vcode_offset + region.vcode_size);
+    }
+
+    // Create the two regions in one go
+    const auto ign_regions_res = pe_file->AddSections({
+        PeFile::SectionSpec{ ".Ign1", vm_region_size },
+        PeFile::SectionSpec{ ".Ign2", vcode_region_size }
+    });
+
+    if(ign_regions_res.isErr()) {
+        return Err(ign_regions_res.unwrapErr());
+    }
+
+    const auto ign_regions = ign_regions_res.unwrap();
+    const auto ign1_region = ign_regions[0];
+    const auto ign2_region = ign_regions[1];
+
+    if(ign1_region.VirtualAddress != planned_regions[0].VirtualAddress ||
+       ign2_region.VirtualAddress != planned_regions[1].VirtualAddress)
+    {
+        return Err("The sections were not placed where they were planned");
+    }
+
+    // Write the vm binary to the '.Ign1' region
+    const auto vm_write_res = pe_file->WriteToRegion(ign1_region.VirtualAddress, virtual_machine);
+    if(vm_write_res.isErr()) {
+        return Err("The writing of the virtual machine failed");
+    }
+
+    return Ok(ProtectedImage{
+        ign1_region,
+        ign2_region,
+        vm_region_size,
+        vcode_region_size,
+        vm_hash,
+        region_key_seed,
+        std::move(translated_regions)
+    });
+}
@@ -0,0 +1,150 @@
+#include <RegionIndex.hpp>
+
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <utility>
+
+#include <spdlog/spdlog.h>
+
+namespace
+{
+    // The errors are static messages, the region they are about is logged with them
+    const char* RegionError(const RegionManifest::Entry& entry, const char* message)
+    {
+        if(entry.name.empty()) {
+            spdlog::error("{}: region at 0x{:X} of size 0x{:X}", message, entry.rva, entry.size);
+        }
+        else {
+            spdlog::error("{}: region '{}' at 0x{:X} of size 0x{:X}", message, entry.name, entry.rva, entry.size);
+        }
+
+        return message;
+    }
+}
+
+/**
+ * @brief
+ * Checks if any region intersects [begin, end)
+ *
+ * @param begin First rva of the range
+ * @param end Rva right after the range
+ * @return true A region covers at least one rva of the range
+ */
+bool RegionIndex::Overlaps(const std::uint32_t begin, const std::uint32_t end) const
+{
+    // First region starting at or after the end, only the one before it can intersect
+    const auto it = std::lower_bound(m_regions.begin(), m_regions.end(), end, [](const Region& region, const std::uint32_t value) {
+        return region.begin < value;
+    });
+
+    return it != m_regions.begin() && std::prev(it)->end > begin;
+}
+
+/**
+ * @brief
+ * The regions as (rva, size) pairs, by ascending rva
+ */
+std::vector<std::pair<std::size_t, std::size_t>> RegionIndex::Pairs() const
+{
+    std::vector<std::pair<std::size_t, std::size_t>> pairs;
+    pairs.reserve(m_regions.size());
+    for(const auto& region : m_regions) {
+        pairs.emplace_back(region.begin, region.Size());
+    }
+
+    return pairs;
+}
+
+/**
+ * @brief
+ * Sorts the regions, resolves the section of each of them and merges the adjacent ones that allow it.
+ * The sections are resolved while walking both lists in order, so the whole build
+ * costs a sort of the regions and one pass.
+ *
+ * @param entries The regions, in any order
+ * @param sections The section table of the image
+ * @return Result<RegionIndex, const char*> The index or an error message when a region
+ * is empty, overlaps another one or isn't fully inside of a section. The region is logged with it
+ */
+Result<RegionIndex, const char*> RegionIndex::Build(
+    std::vector<RegionManifest::Entry> entries,
+    std::span<const Win32::IMAGE_SECTION_HEADER> sections
+)
+{
+    for(const auto& entry : entries)
+    {
+        if(entry.size == 0) {
+            return Err(RegionError(entry, "A region is empty"));
+        }
+
+        if(entry.rva > std::numeric_limits<std::uint32_t>::max() - entry.size) {
+            return Err(RegionError(entry, "A region goes past the end of the address space"));
+        }
+    }
+
+    // Stable so the name of the first region given is kept when two of them start at the same rva
+    std::stable_sort(entries.begin(), entries.end(), [](const RegionManifest::Entry& a, const RegionManifest::Entry& b) {
+        return a.rva < b.rva;
+    });
+
+    // The section table of a valid image is already sorted, but nothing enforces it
+    std::vector<std::size_t> section_order(sections.size());
+    for(std::size_t i = 0; i < section_order.size(); ++i) {
+        section_order[i] = i;
+    }
+
+    std::sort(section_order.begin(), section_order.end(), [&](const std::size_t a, const std::size_t b) {
+        return sections[a].VirtualAddress < sections[b].VirtualAddress;
+    });
+
+    // Some linkers leave the virtual size empty, the raw size is used instead
+    const auto section_end = [&](const std::size_t index) -> std::uint64_t {
+        const auto& section = sections[index];
+        const auto virtual_size = section.Misc.VirtualSize != 0 ? section.Misc.VirtualSize : section.SizeOfRawData;
+        return std::uint64_t{ section.VirtualAddress } + virtual_size;
+    };
+
+    RegionIndex index;
+    index.m_regions.reserve(entries.size());
+
+    std::size_t section_i{ 0 };
+    std::size_t previous_section{ 0 }; // Section of the last region of the index
+    for(auto& entry : entries)
+    {
+        const std::uint32_t end = entry.rva + entry.size;
+
+        while(section_i < section_order.size() && section_end(section_order[section_i]) <= entry.rva) {
+            ++section_i;
+        }
+
+        if(section_i == section_order.size() ||
+           sections[section_order[section_i]].VirtualAddress > entry.rva ||
+           section_end(section_order[section_i]) < end)
+        {
+            return Err(RegionError(entry, "A region is not fully inside of a section"));
+        }
+
+        const auto section = section_order[section_i];
+
+        if(!index.m_regions.empty())
+        {
+            auto& previous = index.m_regions.back();
+            if(entry.rva < previous.end) {
+                spdlog::error("The region at 0x{:X} ends at 0x{:X}", previous.begin, previous.end);
+                return Err(RegionError(entry, "Two regions are overlapping"));
+            }
+
+            // Adjacent regions of the same section that opted in share one entry in the virtual machine
+            if(entry.rva == previous.end && previous.merge && entry.merge && previous_section == section) {
+                previous.end = end;
+                continue;
+            }
+        }
+
+        previous_section = section;
+        index.m_regions.push_back(Region{ entry.rva, end, std::move(entry.name), entry.merge });
+    }
+
+    return Ok(index);
+}
@@ -0,0 +1,92 @@
+#include <RegionManifest.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <optional>
+#include <string_view>
+
+#include <utl/Utl.hpp>
+
+namespace
+{
+    // Returns the next token separated by blanks and moves the view past it
+    std::string_view NextToken(std::string_view& line)
+    {
+        const auto begin = line.find_first_not_of(" \t\r");
+        if(begin == std::string_view::npos) {
+            line = {};
+            return {};
+        }
+
+        line.remove_prefix(begin);
+        const auto end = std::min(line.find_first_of(" \t\r"), line.size());
+
+        const auto token = line.substr(0, end);
+        line.remove_prefix(end);
+        return token;
+    }
+
+    std::optional<std::uint32_t> ParseHex32(const std::string_view token)
+    {
+        const auto value = Utl::ParseHex(token);
+        if(!value || *value > std::numeric_limits<std::uint32_t>::max()) {
+            return {};
+        }
+
+        return static_cast<std::uint32_t>(*value);
+    }
+}
+
+Result<std::vector<RegionManifest::Entry>, const char*>
+RegionManifest::Load(const std::filesystem::path& manifest_path)
+{
+    std::ifstream ifs(manifest_path, std::ios::binary | std::ios::ate);
+    if(!ifs.is_open()) {
+        return Err("The region manifest could not be opened");
+    }
+
+    std::string content(static_cast<std::size_t>(ifs.tellg()), '\0');
+    ifs.seekg(0);
+    if(!ifs.read(content.data(), static_cast<std::streamsize>(content.size()))) {
+        return Err("Reading the region manifest failed");
+    }
+
+    std::vector<Entry> entries;
+    std::string_view remaining{ content };
+    while(!remaining.empty())
+    {
+        const auto line_end = std::min(remaining.find('\n'), remaining.size());
+        auto line = remaining.substr(0, line_end);
+        remaining.remove_prefix(std::min(line_end + 1, remaining.size()));
+
+        const auto rva_token = NextToken(line);
+        if(rva_token.empty() || rva_token.starts_with('#')) {
+            continue;
+        }
+
+        const auto rva = ParseHex32(rva_token);
+        const auto size = ParseHex32(NextToken(line));
+        if(!rva || !size) {
+            return Err("A region of the manifest is not a pair of 32 bit hexadecimal values");
+        }
+
+        Entry entry{ *rva, *size, {}, false };
+        for(auto option = NextToken(line); !option.empty(); option = NextToken(line))
+        {
+            if(option.starts_with("name=")) {
+                entry.name = option.substr(5);
+            }
+            else if(option == "merge=yes") {
+                entry.merge = true;
+            }
+            else if(option != "merge=no") {
+                return Err("A region of the manifest has an unknown option");
+            }
+        }
+
+        entries.push_back(std::move(entry));
+    }
+
+    return Ok(entries);
+}
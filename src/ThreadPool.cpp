@@ -0,0 +1,201 @@
+#include <ThreadPool.hpp>
+
+#include <utility>
+
+namespace
+{
+    // Queue of the current thread, only meaningful when the pool matches
+    struct WorkerSlot { const ThreadPool* pool{ nullptr }; std::size_t queue_index{ 0 }; };
+    thread_local WorkerSlot current_slot;
+}
+
+/**
+ * @brief
+ * Starts the workers. The thread waiting on the tasks takes part in the work,
+ * so one less thread than the requested amount is started.
+ *
+ * @param thread_count Amount of threads running the tasks. 0 is treated as 1
+ */
+ThreadPool::ThreadPool(const unsigned thread_count)
+{
+    const auto worker_count = thread_count > 1 ? thread_count - 1 : 0;
+
+    m_queues.reserve(worker_count + 1);
+    for(std::size_t i = 0; i < worker_count + 1; ++i) {
+        m_queues.emplace_back(std::make_unique<Queue>());
+    }
+
+    m_workers.reserve(worker_count);
+    for(std::size_t i = 1; i < worker_count + 1; ++i) {
+        m_workers.emplace_back([this, i]() { WorkerLoop(i); });
+    }
+}
+
+/**
+ * @brief
+ * Stops the workers once they are done with their current task.
+ * Every submitted task is expected to be done, the queued ones are dropped.
+ */
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard lock(m_wake_mutex);
+        m_stopping = true;
+    }
+
+    m_wake.notify_all();
+    m_workers.clear(); // Joins the workers
+}
+
+/**
+ * @brief
+ * The queue owned by the calling thread. The threads outside of the pool share the first one
+ */
+std::size_t ThreadPool::QueueIndex() const
+{
+    return current_slot.pool == this ? current_slot.queue_index : 0;
+}
+
+/**
+ * @brief
+ * Runs a task from the queue of the calling thread, or steals one from another queue.
+ *
+ * @return true A task was run
+ * @return false Every queue was empty
+ */
+bool ThreadPool::TryRunOne()
+{
+    const auto own_index = QueueIndex();
+
+    Task task;
+    for(std::size_t i = 0; i < m_queues.size() && !task; ++i)
+    {
+        const auto queue_index = (own_index + i) % m_queues.size();
+        auto& queue = *m_queues[queue_index];
+
+        std::lock_guard lock(queue.mutex);
+        if(queue.tasks.empty()) {
+            continue;
+        }
+
+        // The most recent task of our own queue is the most likely to be hot in the cache
+        if(queue_index == own_index) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+        else {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+    }
+
+    if(!task) {
+        return false;
+    }
+
+    --m_queued;
+    task();
+
+    {
+        // Taken so a thread in RunUntil can't miss the end of the task between its check and its wait
+        std::lock_guard lock(m_wake_mutex);
+    }
+
+    m_progress.notify_all();
+    return true;
+}
+
+void ThreadPool::WorkerLoop(const std::size_t queue_index)
+{
+    current_slot = WorkerSlot{ this, queue_index };
+
+    while(true)
+    {
+        if(TryRunOne()) {
+            continue;
+        }
+
+        std::unique_lock lock(m_wake_mutex);
+        m_wake.wait(lock, [this]() { return m_stopping || m_queued > 0; });
+
+        if(m_stopping) {
+            return;
+        }
+    }
+}
+
+/**
+ * @brief
+ * Queues a task on the queue of the calling thread and wakes up an idle worker to take it
+ *
+ * @param task Must not throw
+ */
+void ThreadPool::Submit(Task task)
+{
+    auto& queue = *m_queues[QueueIndex()];
+    {
+        std::lock_guard lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+
+    {
+        // Taken so a worker can't miss the wake up between its check and its wait
+        std::lock_guard lock(m_wake_mutex);
+        ++m_queued;
+    }
+
+    m_wake.notify_one();
+    m_progress.notify_all();
+}
+
+/**
+ * @brief
+ * Runs the queued tasks until the condition holds. Used to wait on submitted tasks
+ * without leaving the calling thread idle. With nothing left to run, the thread sleeps
+ * until a task is queued or one of the running tasks is done.
+ *
+ * @param done Checked between every task. Must only change when a task of the pool is done
+ */
+void ThreadPool::RunUntil(const std::function<bool()>& done)
+{
+    while(!done())
+    {
+        if(TryRunOne()) {
+            continue;
+        }
+
+        std::unique_lock lock(m_wake_mutex);
+        m_progress.wait(lock, [&]() { return m_queued > 0 || done(); });
+    }
+}
+
+/**
+ * @brief
+ * Calls the task once for every index in [0, count), spread over the pool.
+ * Returns once every task is done.
+ *
+ * @param count Amount of tasks
+ * @param task Called with the index of the task. Must be safe to call concurrently
+ */
+void ThreadPool::ParallelFor(const std::size_t count, const std::function<void(std::size_t)>& task)
+{
+    if(count == 1 || Concurrency() == 1)
+    {
+        for(std::size_t i = 0; i < count; ++i) {
+            task(i);
+        }
+
+        return;
+    }
+
+    std::atomic<std::size_t> remaining{ count };
+    for(std::size_t i = 0; i < count; ++i)
+    {
+        Submit([&task, &remaining, i]() {
+            task(i);
+            --remaining;
+        });
+    }
+
+    RunUntil([&remaining]() { return remaining == 0; });
+}
@@ -5,102 +5,105 @@
 #include <Cryptography.hpp>
 
 HOT_PATH FORCE_INLINE Translation::RetResult Translation::TranslateInstruction(
-    const ZydisDecodedInstruction &instruction,
-    const ZydisDecodedOperand operands[ZYDIS_MAX_OPERAND_COUNT_VISIBLE],
-    MappedMemory& mapped_memory,
+    const ZydisMnemonic mnemonic,
+    const OperandSummary operands[DecodedRegion::OPERANDS_PER_INSTRUCTION],
+    const std::uint8_t operand_count,
+    BytecodeBuffer& bytecode,
     const Translation::Context& context,
     bool is_probing
 )
 {
-    bool success = true;
+    // Probing only needs the table, the emission is a single indirect call
+    const auto& handler = INSTRUCTION_HANDLERS[mnemonic];
+    if(handler.emit == nullptr || !handler.supported(operands, operand_count)) {
+        return RetResult::INSTRUCTION_NOT_SUPPORTED;
+    }
 
-    switch(instruction.mnemonic)
-    {
-        case ZydisMnemonic::ZYDIS_MNEMONIC_SUB:
-            if(is_probing)
-                return RetResult::OK;
-            success = SubInstLogic(operands, mapped_memory);
-            break;
-        case ZydisMnemonic::ZYDIS_MNEMONIC_ADD:
-            if(is_probing)
-                return RetResult::OK;
-            success = AddInstLogic(operands, mapped_memory);
-            break;
-        case ZydisMnemonic::ZYDIS_MNEMONIC_MOV:
-            if(is_probing)
-                return RetResult::OK;
-            success = MovInstLogic(operands, mapped_memory);
-            break;
-        case ZydisMnemonic::ZYDIS_MNEMONIC_CALL:
-            if(is_probing)
-                return RetResult::OK;
-            success = CallInstLogic(operands, mapped_memory, context);
-            break;
-        default: // Instruction was not found
-            return RetResult::INSTRUCTION_NOT_SUPPORTED;
-            break;
+    if(is_probing) {
+        return RetResult::OK;
     }
-    
-    if(!success) {
+
+    // The only check of the emission, the handlers write without checking the space left
+    BytecodeWriter writer(bytecode);
+    if(!writer.Begin(handler.max_size)) {
         return RetResult::OUT_OF_MEMORY;
     }
 
+    handler.emit(operands, writer, context);
+    writer.End();
+
     return RetResult::OK;
 }
 
-HOT_PATH std::optional<MappedMemory> 
+HOT_PATH std::optional<Translation::TranslatedBlock> 
 Translation::TranslateInstructionBlock(
     const MappedMemory& instruction_block,
+    const DecodedRegion& decoded,
+    TranslationArena& arena,
     const std::shared_ptr<NativeEmitter> native_emitter,
     const Translation::Context& context
 )
 {
     const auto inner_buffer_size = instruction_block.Size();
-    const auto buffer = instruction_block.InnerPtr().get();
-    // Initialize formatter. Only required when you actually plan to do instruction
-    // formatting ("disassembling"), like we do here
+    const auto buffer = instruction_block.InnerPtrRaw();
+    // Initialize formatter and decoder. Only required when you actually plan to do instruction
+    // formatting ("disassembling"), which is only done when the instructions are logged.
+    // The translation itself only reads the decoded region
+    const bool log_instructions = TranslationLog::Enabled(TranslationLog::Level::DEBUG);
     ZydisFormatter formatter;
-    ZydisFormatterInit(&formatter, ZYDIS_FORMATTER_STYLE_INTEL);
-
-    // Initialize decoder context
     ZydisDecoder decoder;
-    ZydisDecoderInit(&decoder, ZYDIS_MACHINE_MODE_LONG_64, ZYDIS_STACK_WIDTH_64);
+    if(log_instructions) {
+        ZydisFormatterInit(&formatter, ZYDIS_FORMATTER_STYLE_INTEL);
+        ZydisDecoderInit(&decoder, ZYDIS_MACHINE_MODE_LONG_64, ZYDIS_STACK_WIDTH_64);
+    }
 
-    std::size_t offset = 0;
-    ZydisDecodedInstruction instruction;
-    ZydisDecodedOperand operands[ZYDIS_MAX_OPERAND_COUNT_VISIBLE];
+    const auto mnemonics = decoded.Mnemonics();
+    const auto lengths = decoded.Lengths();
+    const auto offsets = decoded.Offsets();
+    const auto operand_counts = decoded.OperandCounts();
 
-    const auto virtual_memory_result = MappedMemory::Allocate(inner_buffer_size * 334);
-    if(!virtual_memory_result) {
+    // Sized from an estimate, the buffer grows in the arena when the translation needs more
+    BytecodeBuffer virtual_memory(arena, inner_buffer_size * INITIAL_BUFFER_FACTOR);
+    if(!virtual_memory.Data()) {
         return {};
     }
 
-    auto virtual_memory = virtual_memory_result.value();
-
     // Indicates to the TranslationInstruction function to simply return if the instruction is supported
     // without emitting any code
     bool is_probing{false};
 
-    std::vector<ZydisDecodedInstruction> unsupported_instructions;
-    unsupported_instructions.reserve(10);
-
     bool vm_switched{false};
 
-    while (ZYAN_SUCCESS(ZydisDecoderDecodeFull(&decoder, buffer + offset, inner_buffer_size - offset,
-        &instruction, operands, ZYDIS_MAX_OPERAND_COUNT_VISIBLE, 
-        ZYDIS_DFLAG_VISIBLE_OPERANDS_ONLY)))
+    std::vector<std::uintmax_t> reentry_stubs;
+
+    for(std::size_t i = 0; i < decoded.Count(); ++i)
     {
-        // Format & print the binary instruction structure to human-readable format
-        char text_buffer[256] = { 0 };
-        ZydisFormatterFormatInstruction(&formatter, &instruction, operands,
-            instruction.operand_count_visible, text_buffer, sizeof(text_buffer), 0);
+        const auto mnemonic = static_cast<ZydisMnemonic>(mnemonics[i]);
+        const auto* operands = decoded.Operands(i);
+        const std::size_t offset = offsets[i];
+        const std::uint8_t length = lengths[i];
+
+        // Format & print the binary instruction structure to human-readable format.
+        // The store doesn't keep what the formatter needs, the instruction is decoded again for the log
+        if(log_instructions)
+        {
+            ZydisDecodedInstruction instruction;
+            ZydisDecodedOperand full_operands[ZYDIS_MAX_OPERAND_COUNT_VISIBLE];
+            char text_buffer[256] = { 0 };
+            if(ZYAN_SUCCESS(ZydisDecoderDecodeFull(&decoder, buffer + offset, length, &instruction, full_operands,
+                ZYDIS_MAX_OPERAND_COUNT_VISIBLE, ZYDIS_DFLAG_VISIBLE_OPERANDS_ONLY)))
+            {
+                ZydisFormatterFormatInstruction(&formatter, &instruction, full_operands,
+                    instruction.operand_count_visible, text_buffer, sizeof(text_buffer), 0);
+            }
 
-        spdlog::info("---------------");
-        spdlog::info("{}", text_buffer);
+            IGNOTUM_TRANSLATION_DEBUG("0x{:X}: {}", context.original_block_rva + offset, text_buffer);
+        }
 
         const auto translation_result = Translation::TranslateInstruction(
-            instruction,
+            mnemonic,
             operands,
+            operand_counts[i],
             virtual_memory,
             context,
             is_probing
@@ -111,30 +114,33 @@ Translation::TranslateInstructionBlock(
         // Lets just store them in a vector until we hit a support instruction
         if(translation_result == RetResult::INSTRUCTION_NOT_SUPPORTED)
         {
+            // The switch and the native instruction are reserved together
+            BytecodeWriter writer(virtual_memory);
+            if(!writer.Begin(sizeof(Virtual::InstructionLength) + ZYDIS_MAX_INSTRUCTION_LENGTH)) {
+                std::puts("Out of memory");
+                return {};
+            }
+
             // If it's true, we already generated the switch
             if(!is_probing) 
             {
                 // Generate the switch instruction to move into native mode
-                spdlog::info("Emitting -> kVmSwitch");
+                IGNOTUM_TRANSLATION_TRACE("Emitting -> kVmSwitch");
                 const auto kswitch_inst = Virtual::Instruction(
                     Parameter(Parameter::kNone),
                     Virtual::Command::kVmSwitch
                 );
 
-                if(!virtual_memory.Write<Virtual::InstructionLength>(kswitch_inst.AssembleInstruction())) {
-                    std::puts("Out of memory");
-                    return {};
-                }
-                
+                writer.Emit<Virtual::InstructionLength>(kswitch_inst.AssembleInstruction());
+
                 vm_switched = true;
                 is_probing = true;
             }
 
             // Write the native instruction
-            spdlog::info("Emitting native instruction");
-            if(!virtual_memory.Write(std::bit_cast<std::uint8_t*>(buffer + offset), instruction.length)) {
-                return {};
-            }
+            IGNOTUM_TRANSLATION_TRACE("Emitting native instruction");
+            writer.Emit(buffer + offset, length);
+            writer.End();
         }
 
         if(translation_result == RetResult::OUT_OF_MEMORY) {
@@ -149,26 +155,30 @@ Translation::TranslateInstructionBlock(
             is_probing = false;
 
             // Emit native code which will bring the execution back to the machine
-            const auto relative_offset = context.vcode_block_rva - context.vm_block_rva;
-
-            const std::uint32_t vip = relative_offset + virtual_memory.CursorPos() + 15;
+            // The vip and the jump depend on where the block is placed, they are filled by RelocateBlock
+            reentry_stubs.push_back(virtual_memory.Size());
 
-            const auto vip_enc_key = cryptography::Generate16BitKey();
-            const auto enc_vip = cryptography::EncodeVIPEntry(vip, vip_enc_key);
-            native_emitter->EmitPush32Bit(enc_vip, virtual_memory); // Push where the VIP should be
+            auto* stub_buffer = virtual_memory.Append(REENTRY_STUB_SIZE);
+            if(!stub_buffer) {
+                return {};
+            }
 
+            auto stub = MappedMemory::View(stub_buffer, REENTRY_STUB_SIZE);
             const auto ret_relative = context.vm_block_rva - (context.original_block_rva + 10);
-            native_emitter->EmitPush32Bit(ret_relative, virtual_memory); // Push where it should return after kVmExit
-
-            const std::int32_t jump_offset = context.vm_block_rva - (context.vcode_block_rva + virtual_memory.CursorPos());
-            native_emitter->EmitNearJmp(jump_offset, virtual_memory); // Jump to entry of vm
+            if(!native_emitter->EmitPush32Bit(0, stub) || // Push where the VIP should be
+               !native_emitter->EmitPush32Bit(ret_relative, stub) || // Push where it should return after kVmExit
+               !native_emitter->EmitNearJmp(0, stub)) // Jump to entry of vm
+            {
+                return {};
+            }
 
-            spdlog::info("Emitting native instruction to resume VM execution");
+            IGNOTUM_TRANSLATION_TRACE("Emitting native instruction to resume VM execution");
 
             // We need to translate the instruction
             const auto res = Translation::TranslateInstruction(
-                instruction,
+                mnemonic,
                 operands,
+                operand_counts[i],
                 virtual_memory,
                 context,
                 is_probing
@@ -180,9 +190,6 @@ Translation::TranslateInstructionBlock(
                 return {};
             }
         }
-
-        offset += instruction.length;
-        spdlog::info("---------------");
     }
 
     // Generate instruction to notify the virtual machine that the execution is over.
@@ -211,5 +218,42 @@ Translation::TranslateInstructionBlock(
         return {};
     }
 
-    return virtual_memory;
+    return TranslatedBlock{ std::move(virtual_memory), std::move(reentry_stubs) };
+}
+
+bool Translation::RelocateBlock(
+    Translation::TranslatedBlock& block,
+    const std::shared_ptr<NativeEmitter> native_emitter,
+    const Translation::Context& context,
+    cryptography::KeyStream& keys
+)
+{
+    const auto relative_offset = context.vcode_block_rva - context.vm_block_rva;
+    const auto ret_relative = context.vm_block_rva - (context.original_block_rva + 10);
+
+    for(const auto stub_offset : block.reentry_stubs)
+    {
+        if(stub_offset > block.bytecode.Size() || block.bytecode.Size() - stub_offset < REENTRY_STUB_SIZE) {
+            return false;
+        }
+
+        // View over the stub only, it's emitted again with the final values
+        auto stub = MappedMemory::View(block.bytecode.Data() + stub_offset, REENTRY_STUB_SIZE);
+
+        const std::uint32_t vip = relative_offset + stub_offset + REENTRY_STUB_SIZE;
+
+        const auto vip_enc_key = keys.Next16BitKey();
+        const auto enc_vip = cryptography::EncodeVIPEntry(vip, vip_enc_key);
+
+        const std::int32_t jump_offset = context.vm_block_rva - (context.vcode_block_rva + stub_offset + 10);
+
+        if(!native_emitter->EmitPush32Bit(enc_vip, stub) ||
+           !native_emitter->EmitPush32Bit(ret_relative, stub) ||
+           !native_emitter->EmitNearJmp(jump_offset, stub))
+        {
+            return false;
+        }
+    }
+
+    return true;
 }
\ No newline at end of file
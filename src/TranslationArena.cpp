@@ -0,0 +1,204 @@
+#include <TranslationArena.hpp>
+
+#include <algorithm>
+#include <new>
+#include <utility>
+
+std::size_t TranslationArena::Capacity() const
+{
+    std::size_t capacity{ 0 };
+    for(const auto& chunk : m_chunks) {
+        capacity += chunk.size;
+    }
+
+    return capacity;
+}
+
+void TranslationArena::AddLive(const std::size_t size)
+{
+    m_live += size;
+    m_peak_live = std::max(m_peak_live, m_live);
+}
+
+/**
+ * @brief
+ * Hands out a block from the current chunk, or from the next chunk big enough for it.
+ * A new chunk is only allocated when none of the chunks left can hold the block, and an
+ * empty arena gives its chunks back for it rather than keeping them unused.
+ * The memory is left uninitialized.
+ *
+ * @param size Size of the block
+ * @return std::uint8_t* The block, nullptr if no memory could be allocated
+ */
+std::uint8_t* TranslationArena::Allocate(const std::size_t size)
+{
+    // The blocks stay aligned for the 8 bytes writes of the bytecode
+    constexpr std::size_t kAlignment = 8;
+
+    if(m_chunk_index == 0 && m_offset == 0 && !m_chunks.empty() && m_chunks.front().size < size)
+    {
+        m_chunks.clear();
+        m_chunk_index = 0;
+        m_offset = 0;
+    }
+
+    while(m_chunk_index < m_chunks.size())
+    {
+        auto& chunk = m_chunks[m_chunk_index];
+        const auto aligned_offset = (m_offset + kAlignment - 1) & ~(kAlignment - 1);
+        if(aligned_offset <= chunk.size && chunk.size - aligned_offset >= size)
+        {
+            AddLive(aligned_offset - m_offset + size);
+            m_last = chunk.data.get() + aligned_offset;
+            m_offset = aligned_offset + size;
+            return m_last;
+        }
+
+        ++m_chunk_index;
+        m_offset = 0;
+    }
+
+    const auto chunk_size = std::max(m_chunks.empty() ? m_next_chunk_size : m_chunk_size, size);
+    auto* data = new(std::nothrow) std::uint8_t[chunk_size];
+    if(!data) {
+        return nullptr;
+    }
+
+    m_chunks.push_back(Chunk{ std::unique_ptr<std::uint8_t[]>(data), chunk_size });
+    m_chunk_index = m_chunks.size() - 1;
+    m_offset = size;
+    m_last = data;
+    AddLive(size);
+    return data;
+}
+
+/**
+ * @brief
+ * Gives a block more room. The last block handed out grows in place when its chunk has the room.
+ * When it's alone in its chunk, the chunk is replaced by a bigger one and freed.
+ * Any other block is moved to a new block, the old one is only reclaimed by Reset.
+ *
+ * @param block The block to grow, must come from this arena
+ * @param size The bytes of the block to keep
+ * @param capacity The size the block was handed out with
+ * @param new_size The size needed
+ * @return std::uint8_t* The block, moved or not, nullptr if no memory could be allocated
+ */
+std::uint8_t* TranslationArena::Grow(std::uint8_t* block, const std::size_t size, const std::size_t capacity, const std::size_t new_size)
+{
+    if(block != nullptr && block == m_last && m_chunk_index < m_chunks.size())
+    {
+        auto& chunk = m_chunks[m_chunk_index];
+        const auto block_offset = static_cast<std::size_t>(block - chunk.data.get());
+        if(chunk.size - block_offset >= new_size)
+        {
+            AddLive(new_size - capacity);
+            m_offset = block_offset + new_size;
+            return block;
+        }
+
+        // Nothing else lives in the chunk, the old one doesn't have to be kept until Reset
+        if(block_offset == 0)
+        {
+            const auto chunk_size = std::max(m_chunk_size, new_size);
+            auto* data = new(std::nothrow) std::uint8_t[chunk_size];
+            if(!data) {
+                return nullptr;
+            }
+
+            std::memcpy(data, block, size);
+            chunk = Chunk{ std::unique_ptr<std::uint8_t[]>(data), chunk_size };
+            AddLive(new_size - capacity);
+            m_offset = new_size;
+            m_last = data;
+            return data;
+        }
+    }
+
+    auto* grown = Allocate(new_size);
+    if(grown != nullptr)
+    {
+        if(size != 0) {
+            std::memcpy(grown, block, size);
+        }
+
+        m_live -= capacity;
+    }
+
+    return grown;
+}
+
+/**
+ * @brief
+ * Makes the memory available again, handed out from the first chunk.
+ * The chunks are released when the round needed several of them or used less than half of
+ * the only one. The next round then allocates a single chunk of the most the round had live at once,
+ * the blocks left behind by a move don't count.
+ */
+void TranslationArena::Reset()
+{
+    const auto kept_size = std::max(m_peak_live, m_chunk_size);
+    if(m_chunks.size() > 1 || (m_chunks.size() == 1 && m_chunks.front().size > 2 * kept_size))
+    {
+        m_chunks.clear();
+        m_next_chunk_size = kept_size;
+    }
+
+    m_chunk_index = 0;
+    m_offset = 0;
+    m_last = nullptr;
+    m_live = 0;
+    m_peak_live = 0;
+}
+
+// Gives every chunk back, the arena starts over like a new one
+void TranslationArena::Release()
+{
+    m_chunks.clear();
+    m_chunks.shrink_to_fit();
+    m_next_chunk_size = m_chunk_size;
+    m_chunk_index = 0;
+    m_offset = 0;
+    m_last = nullptr;
+    m_live = 0;
+    m_peak_live = 0;
+}
+
+BytecodeBuffer::BytecodeBuffer(TranslationArena& arena, const std::size_t initial_capacity) : m_arena(&arena)
+{
+    m_data = arena.Allocate(initial_capacity);
+    m_capacity = m_data != nullptr ? initial_capacity : 0;
+}
+
+BytecodeBuffer::BytecodeBuffer(BytecodeBuffer&& other) noexcept :
+    m_arena(other.m_arena),
+    m_data(std::exchange(other.m_data, nullptr)),
+    m_size(std::exchange(other.m_size, 0)),
+    m_capacity(std::exchange(other.m_capacity, 0))
+{}
+
+BytecodeBuffer& BytecodeBuffer::operator=(BytecodeBuffer&& other) noexcept
+{
+    m_arena = other.m_arena;
+    m_data = std::exchange(other.m_data, nullptr);
+    m_size = std::exchange(other.m_size, 0);
+    m_capacity = std::exchange(other.m_capacity, 0);
+    return *this;
+}
+
+bool BytecodeBuffer::GrowFor(const std::size_t additional)
+{
+    auto new_capacity = std::max<std::size_t>(m_capacity * 2, 64);
+    while(new_capacity - m_size < additional) {
+        new_capacity *= 2;
+    }
+
+    auto* grown = m_arena->Grow(m_data, m_size, m_capacity, new_capacity);
+    if(!grown) {
+        return false;
+    }
+
+    m_data = grown;
+    m_capacity = new_capacity;
+    return true;
+}
@@ -0,0 +1,210 @@
+#include <TranslationCache.hpp>
+#include <FileMapping.hpp>
+#include <utl/Utl.hpp>
+
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string_view>
+#include <vector>
+
+#include <spdlog/fmt/fmt.h>
+
+namespace
+{
+    constexpr std::string_view kCacheMagic{ "IGNCACHE", 8 };
+    constexpr std::uint32_t kCacheVersion = 2;
+    constexpr std::size_t kCacheHeaderSize = 8 + 4 + 4 + 8 * 3;
+
+    template<class T>
+    void AppendValue(std::vector<std::uint8_t>& buffer, const T value)
+    {
+        const auto* bytes = std::bit_cast<const std::uint8_t*>(&value);
+        buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+    }
+
+    template<class T>
+    T ReadValue(const std::uint8_t* source)
+    {
+        T value;
+        std::memcpy(&value, source, sizeof(T));
+        return value;
+    }
+
+    // Header of an entry, also used as the key along with the native bytes.
+    // No field of the context is part of it: the bytecode only depends on the rvas through the
+    // reentry stubs, and RelocateBlock emits those again once the block is placed
+    std::vector<std::uint8_t> EntryHeader(
+        const std::span<const std::uint8_t> native_code,
+        const std::uint64_t bytecode_size,
+        const std::uint64_t stub_count
+    )
+    {
+        std::vector<std::uint8_t> header;
+        header.reserve(kCacheHeaderSize);
+        header.insert(header.end(), kCacheMagic.begin(), kCacheMagic.end());
+        AppendValue<std::uint32_t>(header, kCacheVersion);
+        AppendValue<std::uint32_t>(header, Translation::TRANSLATOR_VERSION);
+        AppendValue<std::uint64_t>(header, native_code.size());
+        AppendValue<std::uint64_t>(header, bytecode_size);
+        AppendValue<std::uint64_t>(header, stub_count);
+        return header;
+    }
+}
+
+/**
+ * @brief
+ * Creates the directory of the cache if it doesn't exist yet
+ *
+ * @param directory Where the entries are stored
+ * @return Result<TranslationCache, const char*> The cache or an error message
+ */
+Result<TranslationCache, const char*> TranslationCache::Open(const std::filesystem::path& directory)
+{
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+    if(ec || !std::filesystem::is_directory(directory, ec)) {
+        return Err("The cache directory could not be created");
+    }
+
+    return Ok(TranslationCache(directory));
+}
+
+/**
+ * @brief
+ * Path of the entry holding the translation of the native code.
+ * Only the key fields of the header are hashed, the sizes of the translation are left to 0
+ */
+std::filesystem::path TranslationCache::EntryPath(std::span<const std::uint8_t> native_code) const
+{
+    const auto key = EntryHeader(native_code, 0, 0);
+    const auto hash = Utl::Fnv1a64(native_code, Utl::Fnv1a64(key));
+
+    return m_directory / fmt::format("{:016x}.ign", hash);
+}
+
+/**
+ * @brief
+ * Looks for the translation of the native code.
+ *
+ * A function that moved since the entry was stored still hits, the block is relocated at its new place.
+ *
+ * @param native_code The native instructions of the region, before they are patched
+ * @param arena Arena the bytecode of the block is copied to
+ * @return std::optional<Translation::TranslatedBlock> The block to be relocated, or nothing
+ * when there's no entry or the entry doesn't match
+ */
+std::optional<Translation::TranslatedBlock> TranslationCache::Load(
+    std::span<const std::uint8_t> native_code,
+    TranslationArena& arena
+) const
+{
+    auto mapping_res = FileMapping::Open(EntryPath(native_code));
+    if(mapping_res.isErr()) {
+        return {};
+    }
+
+    const auto mapping = mapping_res.unwrap();
+    const auto entry = mapping->Span();
+
+    if(entry.size() < kCacheHeaderSize) {
+        return {};
+    }
+
+    const auto bytecode_size = ReadValue<std::uint64_t>(entry.data() + kCacheHeaderSize - 16);
+    const auto stub_count = ReadValue<std::uint64_t>(entry.data() + kCacheHeaderSize - 8);
+
+    // The header holds every key field, comparing it and the native bytes rules out a collision
+    const auto expected_header = EntryHeader(native_code, bytecode_size, stub_count);
+    if(std::memcmp(entry.data(), expected_header.data(), kCacheHeaderSize) != 0) {
+        return {};
+    }
+
+    // The memory budget counts on the bytecode of a block staying within the translation bound
+    if(bytecode_size > native_code.size() * Translation::BUFFER_SIZE_FACTOR) {
+        return {};
+    }
+
+    const auto payload = entry.subspan(kCacheHeaderSize);
+    if(payload.size() < native_code.size() ||
+       (payload.size() - native_code.size()) / sizeof(std::uint64_t) < stub_count ||
+       payload.size() - native_code.size() - stub_count * sizeof(std::uint64_t) != bytecode_size)
+    {
+        return {};
+    }
+
+    if(std::memcmp(payload.data(), native_code.data(), native_code.size()) != 0) {
+        return {};
+    }
+
+    BytecodeBuffer bytecode(arena, bytecode_size);
+    if(!bytecode.Write(payload.data() + native_code.size(), bytecode_size)) {
+        return {};
+    }
+
+    std::vector<std::uintmax_t> reentry_stubs(stub_count);
+    const auto* stubs = payload.data() + native_code.size() + bytecode_size;
+    for(std::size_t i = 0; i < stub_count; ++i) {
+        reentry_stubs[i] = ReadValue<std::uint64_t>(stubs + i * sizeof(std::uint64_t));
+    }
+
+    return Translation::TranslatedBlock{ std::move(bytecode), std::move(reentry_stubs) };
+}
+
+/**
+ * @brief
+ * Stores the translation of the native code. The block must not be relocated yet.
+ * An existing entry is replaced atomically, readers either see the old or the new one.
+ *
+ * @param native_code The native instructions of the region, before they are patched
+ * @param block The block returned by TranslateInstructionBlock
+ * @return true The entry was written
+ * @return false The entry could not be written, the cache is left as it was
+ */
+bool TranslationCache::Store(
+    std::span<const std::uint8_t> native_code,
+    const Translation::TranslatedBlock& block
+) const
+{
+    const auto bytecode_size = block.bytecode.Size();
+    const auto header = EntryHeader(native_code, bytecode_size, block.reentry_stubs.size());
+
+    std::vector<std::uint8_t> stubs;
+    stubs.reserve(block.reentry_stubs.size() * sizeof(std::uint64_t));
+    for(const auto stub_offset : block.reentry_stubs) {
+        AppendValue<std::uint64_t>(stubs, stub_offset);
+    }
+
+    // Unique per writer, two processes storing the same entry never write to the same file
+    thread_local std::mt19937_64 name_engine{ std::random_device{}() };
+
+    const auto entry_path = EntryPath(native_code);
+    auto temporary_path = entry_path;
+    temporary_path += fmt::format(".{:016x}.ign-tmp", name_engine());
+
+    std::ofstream entry_file(temporary_path, std::ios::binary | std::ios::trunc);
+    if(!entry_file.is_open()) {
+        return false;
+    }
+
+    entry_file.write(std::bit_cast<const char*>(header.data()), header.size());
+    entry_file.write(std::bit_cast<const char*>(native_code.data()), native_code.size());
+    entry_file.write(std::bit_cast<const char*>(block.bytecode.Data()), bytecode_size);
+    entry_file.write(std::bit_cast<const char*>(stubs.data()), stubs.size());
+    entry_file.close();
+
+    std::error_code ec;
+    if(!entry_file) {
+        std::filesystem::remove(temporary_path, ec);
+        return false;
+    }
+
+    std::filesystem::rename(temporary_path, entry_path, ec);
+    if(ec) {
+        std::filesystem::remove(temporary_path, ec);
+        return false;
+    }
+
+    return true;
+}
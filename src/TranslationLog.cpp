@@ -0,0 +1,178 @@
+#include <TranslationLog.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <BoundedQueue.hpp>
+
+#include <spdlog/spdlog.h>
+
+namespace
+{
+    // Messages a thread can have waiting before the next ones are dropped
+    constexpr std::size_t kQueueCapacity = 0x1000;
+
+    struct ThreadQueue
+    {
+        explicit ThreadQueue(const std::size_t _id) : id(_id) {}
+
+        std::size_t id; // Order the threads logged in, shown with their messages
+        BoundedQueue<std::string> messages{ kQueueCapacity };
+        std::atomic<std::uint64_t> dropped{ 0 };
+        std::atomic<bool> closed{ false }; // The thread exited, the queue goes away once drained
+    };
+
+    class Sink
+    {
+    private:
+        std::mutex m_mutex; // Guards the list of queues and the drain thread, never taken by a message
+        std::vector<std::shared_ptr<ThreadQueue>> m_queues;
+        std::size_t m_next_id{ 0 };
+        std::jthread m_drain;
+    private:
+        // Writes what's waiting in the queues, returns whether anything was written
+        bool DrainOnce()
+        {
+            std::vector<std::shared_ptr<ThreadQueue>> queues;
+            {
+                std::lock_guard lock(m_mutex);
+                queues = m_queues;
+            }
+
+            bool drained_any{ false };
+            std::string message;
+            std::vector<const ThreadQueue*> finished_queues;
+            for(const auto& queue : queues)
+            {
+                // Read before draining, a thread which exited pushed everything it will ever push
+                const bool closed = queue->closed.load(std::memory_order_acquire);
+
+                while(queue->messages.TryPop(message)) {
+                    spdlog::info("[translation {}] {}", queue->id, message);
+                    drained_any = true;
+                }
+
+                if(const auto dropped = queue->dropped.exchange(0, std::memory_order_relaxed); dropped != 0) {
+                    spdlog::warn("[translation {}] {} messages dropped, the log could not keep up", queue->id, dropped);
+                }
+
+                if(closed) {
+                    finished_queues.push_back(queue.get());
+                }
+            }
+
+            if(!finished_queues.empty())
+            {
+                std::lock_guard lock(m_mutex);
+                std::erase_if(m_queues, [&](const std::shared_ptr<ThreadQueue>& queue) {
+                    return std::find(finished_queues.begin(), finished_queues.end(), queue.get()) != finished_queues.end();
+                });
+            }
+
+            return drained_any;
+        }
+    public:
+        // The default logger is created first so it's still there when the sink drains its last messages at exit
+        Sink() { static_cast<void>(spdlog::default_logger()); }
+        ~Sink() { Stop(); }
+    public:
+        std::shared_ptr<ThreadQueue> Register()
+        {
+            std::lock_guard lock(m_mutex);
+            return m_queues.emplace_back(std::make_shared<ThreadQueue>(m_next_id++));
+        }
+
+        void Start()
+        {
+            std::lock_guard lock(m_mutex);
+            if(m_drain.joinable()) {
+                return;
+            }
+
+            m_drain = std::jthread([this](std::stop_token stop) {
+                while(!stop.stop_requested())
+                {
+                    if(!DrainOnce()) {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    }
+                }
+
+                // Whatever was pushed before the stop is still written
+                while(DrainOnce()) {}
+            });
+        }
+
+        void Stop()
+        {
+            std::jthread drain;
+            {
+                std::lock_guard lock(m_mutex);
+                drain = std::move(m_drain);
+            }
+
+            if(drain.joinable()) {
+                drain.request_stop();
+                drain.join();
+            }
+        }
+    };
+
+    Sink& GetSink()
+    {
+        static Sink sink;
+        return sink;
+    }
+
+    // Marks the queue of a thread as closed when the thread exits
+    struct ThreadQueueHandle
+    {
+        std::shared_ptr<ThreadQueue> queue;
+
+        ~ThreadQueueHandle()
+        {
+            if(queue) {
+                queue->closed.store(true, std::memory_order_release);
+            }
+        }
+    };
+}
+
+/**
+ * @brief
+ * Queues a formatted message on the queue of the calling thread. Never waits,
+ * the message is dropped when the queue is full.
+ * The queue of a thread is registered the first time it logs.
+ *
+ * @param message The formatted message
+ */
+void TranslationLog::Push(std::string message)
+{
+    thread_local ThreadQueueHandle handle;
+    if(!handle.queue) {
+        handle.queue = GetSink().Register();
+    }
+
+    if(!handle.queue->messages.TryPush(std::move(message))) {
+        handle.queue->dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void TranslationLog::SetLevel(const Level level)
+{
+    if(level != Level::OFF) {
+        GetSink().Start();
+    }
+
+    runtime_level.store(level, std::memory_order_relaxed);
+}
+
+void TranslationLog::Shutdown()
+{
+    runtime_level.store(Level::OFF, std::memory_order_relaxed);
+    GetSink().Stop();
+}
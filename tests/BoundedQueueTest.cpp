@@ -0,0 +1,106 @@
+#include "TestSupport.hpp"
+
+#include <BoundedQueue.hpp>
+
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    constexpr std::size_t PRODUCER_COUNT = 4;
+    constexpr std::size_t CONSUMER_COUNT = 4;
+    constexpr std::size_t ITEM_COUNT = 20000; // Per producer
+
+    void KeepsTheOrderOfASingleThread()
+    {
+        BoundedQueue<int> queue(3);
+        CHECK(queue.Capacity() == 4);
+
+        for(int i = 0; i < 4; ++i) {
+            CHECK(queue.TryPush(i));
+        }
+        CHECK(!queue.TryPush(4));
+
+        int value{ -1 };
+        for(int i = 0; i < 4; ++i) {
+            CHECK(queue.TryPop(value) && value == i);
+        }
+        CHECK(!queue.TryPop(value));
+    }
+
+    // Every item is popped once and the items of a producer come out in the order they were pushed
+    void DeliversEveryItemInOrder()
+    {
+        BoundedQueue<std::size_t> queue(8);
+        std::vector<std::vector<std::size_t>> popped(CONSUMER_COUNT);
+
+        std::vector<std::jthread> consumers;
+        for(std::size_t c = 0; c < CONSUMER_COUNT; ++c)
+        {
+            consumers.emplace_back([&, c]() {
+                std::size_t item{ 0 };
+                while(queue.Pop(item)) {
+                    popped[c].push_back(item);
+                }
+            });
+        }
+
+        {
+            std::vector<std::jthread> producers;
+            for(std::size_t p = 0; p < PRODUCER_COUNT; ++p)
+            {
+                producers.emplace_back([&, p]() {
+                    for(std::size_t i = 0; i < ITEM_COUNT; ++i) {
+                        queue.Push(p * ITEM_COUNT + i);
+                    }
+                });
+            }
+        }
+
+        queue.Close();
+        consumers.clear();
+
+        std::vector<std::size_t> seen(PRODUCER_COUNT * ITEM_COUNT, 0);
+        for(const auto& items : popped)
+        {
+            std::vector<std::size_t> last(PRODUCER_COUNT, 0);
+            std::vector<bool> any(PRODUCER_COUNT, false);
+            for(const auto item : items)
+            {
+                const auto producer = item / ITEM_COUNT;
+                CHECK(!any[producer] || item > last[producer]);
+                any[producer] = true;
+                last[producer] = item;
+                ++seen[item];
+            }
+        }
+
+        CHECK(std::all_of(seen.begin(), seen.end(), [](const std::size_t count) { return count == 1; }));
+    }
+
+    void CloseWakesTheConsumers()
+    {
+        BoundedQueue<int> queue(4);
+        CHECK(queue.TryPush(1));
+
+        int value{ 0 };
+        std::jthread consumer([&]() {
+            CHECK(queue.Pop(value) && value == 1);
+            CHECK(!queue.Pop(value));
+        });
+
+        queue.Close();
+        consumer.join();
+        CHECK(queue.Closed());
+    }
+}
+
+int main()
+{
+    KeepsTheOrderOfASingleThread();
+    DeliversEveryItemInOrder();
+    CloseWakesTheConsumers();
+    return TestSupport::Finish();
+}
@@ -0,0 +1,115 @@
+#include "TestSupport.hpp"
+
+#include <ImageBuilder.hpp>
+
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+namespace
+{
+    std::vector<std::uint8_t> ReadFile(const std::filesystem::path& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        return { std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+    }
+
+    void WriteFile(const std::filesystem::path& path, std::span<const std::uint8_t> bytes)
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    }
+
+    std::vector<std::uint8_t> MakeBase()
+    {
+        std::vector<std::uint8_t> base(0x3000);
+        for(std::size_t i = 0; i < base.size(); ++i) {
+            base[i] = static_cast<std::uint8_t>(i * 7);
+        }
+
+        return base;
+    }
+
+    // Modifications spread over the base and the part the image grows by
+    ImageBuilder MakeBuilder(std::span<const std::uint8_t> base)
+    {
+        const std::vector<std::uint8_t> patch(0x20, 0xAA);
+        const std::vector<std::uint8_t> added(0x40, 0xBB);
+
+        ImageBuilder builder(base.size());
+        builder.Grow(0x4000);
+        CHECK(builder.Stage(0x3100, added.data(), added.size()).isOk());
+        CHECK(builder.Stage(0x100, patch.data(), patch.size()).isOk());
+        CHECK(builder.Stage(0x50, patch.data(), patch.size()).isOk());
+        return builder;
+    }
+
+    void DeltaRoundTrip(const std::filesystem::path& directory)
+    {
+        const auto base = MakeBase();
+        WriteFile(directory / "base", base);
+
+        auto expected_builder = MakeBuilder(base);
+        std::vector<std::uint8_t> expected;
+        CHECK(expected_builder.WriteTo(base, [&](std::span<const std::uint8_t> chunk) {
+            expected.insert(expected.end(), chunk.begin(), chunk.end());
+            return true;
+        }).isOk());
+        CHECK(expected.size() == 0x4000);
+
+        auto builder = MakeBuilder(base);
+        CHECK(builder.ExportDelta(directory / "delta", base).isOk());
+        CHECK(ImageBuilder::ApplyDelta(directory / "delta", directory / "base", directory / "output").isOk());
+        CHECK(ReadFile(directory / "output") == expected);
+    }
+
+    void RejectsAnotherBase(const std::filesystem::path& directory)
+    {
+        auto base = MakeBase();
+        auto builder = MakeBuilder(base);
+        CHECK(builder.ExportDelta(directory / "delta", base).isOk());
+
+        base[0x110] ^= 0xFF;
+        WriteFile(directory / "other", base);
+        CHECK(ImageBuilder::ApplyDelta(directory / "delta", directory / "other", directory / "other-output").isErr());
+    }
+
+    void RejectsTruncatedDelta(const std::filesystem::path& directory)
+    {
+        const auto base = MakeBase();
+        auto builder = MakeBuilder(base);
+        CHECK(builder.ExportDelta(directory / "delta", base).isOk());
+
+        const auto delta = ReadFile(directory / "delta");
+        CHECK(ImageBuilder::LoadDelta(directory / "delta").isOk());
+
+        // Cut inside of the header and inside of the last extent
+        for(const auto size : { std::size_t{ 4 }, std::size_t{ 16 }, delta.size() / 2, delta.size() - 1 })
+        {
+            WriteFile(directory / "truncated", std::span(delta).first(size));
+            CHECK(ImageBuilder::LoadDelta(directory / "truncated").isErr());
+        }
+    }
+
+    void RejectsOverlappingExtents()
+    {
+        const auto base = MakeBase();
+        const std::uint8_t patch[4]{};
+
+        auto builder = MakeBuilder(base);
+        CHECK(builder.Stage(0x105, patch, sizeof(patch)).isOk());
+        CHECK(builder.Validate().isErr());
+    }
+}
+
+int main()
+{
+    const auto directory = TestSupport::ScratchDirectory("image-builder");
+    DeltaRoundTrip(directory);
+    RejectsAnotherBase(directory);
+    RejectsTruncatedDelta(directory);
+    RejectsOverlappingExtents();
+
+    std::filesystem::remove_all(directory);
+    return TestSupport::Finish();
+}
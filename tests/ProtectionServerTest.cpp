@@ -0,0 +1,112 @@
+#include "TestSupport.hpp"
+
+#include <ProtectionServer.hpp>
+
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+    // Sends a raw request, without going through Submit, and reads the answer up to its line break
+    std::string SendRaw(const std::filesystem::path& socket_path, const std::string& request)
+    {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        std::memcpy(address.sun_path, socket_path.c_str(), socket_path.native().size() + 1);
+
+        const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if(fd < 0 || connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+            if(fd >= 0) {
+                close(fd);
+            }
+            return {};
+        }
+
+        // The server stops reading once the request is too long, whatever is left is dropped
+        std::size_t sent{ 0 };
+        while(sent < request.size())
+        {
+            const auto result = send(fd, request.data() + sent, request.size() - sent, MSG_NOSIGNAL);
+            if(result <= 0) {
+                break;
+            }
+
+            sent += static_cast<std::size_t>(result);
+        }
+
+        std::string response;
+        char buffer[0x100];
+        while(response.find('\n') == std::string::npos)
+        {
+            const auto received = recv(fd, buffer, sizeof(buffer), 0);
+            if(received <= 0) {
+                break;
+            }
+
+            response.append(buffer, static_cast<std::size_t>(received));
+        }
+
+        close(fd);
+        return response;
+    }
+}
+
+int main()
+{
+    const auto directory = TestSupport::ScratchDirectory("protection-server");
+    const auto socket_path = directory / "server.sock";
+
+    const auto server_res = ProtectionServer::Listen(socket_path);
+    CHECK(server_res.isOk());
+    if(server_res.isErr()) {
+        return TestSupport::Finish();
+    }
+
+    const auto server = server_res.unwrap();
+    CHECK(ProtectionServer::Listen(socket_path).isErr()); // Already listening
+
+    std::mutex jobs_mutex;
+    std::vector<JobManifest::Entry> jobs;
+
+    // Serve only returns when accepting fails, the thread is left to the end of the process
+    std::thread([server, &jobs_mutex, &jobs]() {
+        static_cast<void>(server->Serve([&](const JobManifest::Entry& entry) -> Result<bool, const char*> {
+            std::lock_guard lock(jobs_mutex);
+            jobs.push_back(entry);
+            return Ok(true);
+        }));
+    }).detach();
+
+    const JobManifest::Entry entry{ directory / "in file.exe", directory / "out.exe", { { 0x1000, 0x20 }, { 0x2000, 0x40 } } };
+    const auto submit_res = ProtectionServer::Submit(socket_path, entry);
+    CHECK(submit_res.isOk() && submit_res.unwrap() == "ok");
+
+    {
+        std::lock_guard lock(jobs_mutex);
+        CHECK(jobs.size() == 1);
+        CHECK(jobs.size() == 1 && jobs.front().input == entry.input && jobs.front().output == entry.output);
+        CHECK(jobs.size() == 1 && jobs.front().region_pairs == entry.region_pairs);
+    }
+
+    // Over the 0x10000 bytes a request line can hold
+    const auto too_long = SendRaw(socket_path, std::string(0x10010, 'a'));
+    CHECK(too_long == "error The request could not be read\n");
+
+    const auto relative = SendRaw(socket_path, "in.exe out.exe\n");
+    CHECK(relative == "error The paths of a job must be absolute\n");
+
+    {
+        std::lock_guard lock(jobs_mutex);
+        CHECK(jobs.size() == 1);
+    }
+
+    std::filesystem::remove_all(directory);
+    return TestSupport::Finish();
+}
@@ -0,0 +1,91 @@
+#include "TestSupport.hpp"
+
+#include <RegionIndex.hpp>
+
+#include <array>
+#include <cstring>
+
+namespace
+{
+    Win32::IMAGE_SECTION_HEADER MakeSection(const std::uint32_t rva, const std::uint32_t size)
+    {
+        Win32::IMAGE_SECTION_HEADER section;
+        std::memset(&section, 0, sizeof(section));
+        section.VirtualAddress = rva;
+        section.Misc.VirtualSize = size;
+        section.SizeOfRawData = size;
+        return section;
+    }
+
+    // Listed out of order, nothing enforces the order of the section table
+    const std::array<Win32::IMAGE_SECTION_HEADER, 2> SECTIONS{ MakeSection(0x3000, 0x1000), MakeSection(0x1000, 0x2000) };
+
+    void MergesAdjacentRegionsThatOptIn()
+    {
+        const auto index_res = RegionIndex::Build({
+            { 0x1100, 0x20, "second", true },
+            { 0x1000, 0x100, "first", true },
+            { 0x1120, 0x10, "kept", false }
+        }, SECTIONS);
+
+        CHECK(index_res.isOk());
+        const auto index = index_res.unwrap();
+        CHECK(index.Size() == 2);
+        CHECK(index.Regions()[0].begin == 0x1000 && index.Regions()[0].end == 0x1120);
+        CHECK(index.Regions()[0].name == "first");
+        CHECK(index.Regions()[1].begin == 0x1120 && index.Regions()[1].Size() == 0x10);
+    }
+
+    void KeepsRegionsApartWithoutMerge()
+    {
+        const auto index_res = RegionIndex::Build({ { 0x1000, 0x100, {}, false }, { 0x1100, 0x100, {}, true } }, SECTIONS);
+
+        CHECK(index_res.isOk());
+        CHECK(index_res.unwrap().Size() == 2);
+    }
+
+    void DoesNotMergeAcrossSections()
+    {
+        const auto index_res = RegionIndex::Build({ { 0x2F00, 0x100, {}, true }, { 0x3000, 0x100, {}, true } }, SECTIONS);
+
+        CHECK(index_res.isOk());
+        const auto index = index_res.unwrap();
+        CHECK(index.Size() == 2);
+        CHECK(index.Regions()[0].end == 0x3000 && index.Regions()[1].begin == 0x3000);
+    }
+
+    void RejectsOverlappingRegions()
+    {
+        CHECK(RegionIndex::Build({ { 0x1000, 0x100, {}, true }, { 0x10FF, 0x10, {}, true } }, SECTIONS).isErr());
+        CHECK(RegionIndex::Build({ { 0x1000, 0x100, {}, false }, { 0x1000, 0x100, {}, false } }, SECTIONS).isErr());
+    }
+
+    void RejectsRegionsOutsideOfASection()
+    {
+        CHECK(RegionIndex::Build({ { 0x500, 0x10, {}, false } }, SECTIONS).isErr());
+        CHECK(RegionIndex::Build({ { 0x2FF0, 0x20, {}, false } }, SECTIONS).isErr()); // Across two contiguous sections
+        CHECK(RegionIndex::Build({ { 0x3FF0, 0x20, {}, false } }, SECTIONS).isErr());
+        CHECK(RegionIndex::Build({ { 0x1000, 0, {}, false } }, SECTIONS).isErr());
+    }
+
+    void FindsOverlaps()
+    {
+        const auto index = RegionIndex::Build({ { 0x1000, 0x100, {}, false }, { 0x1200, 0x100, {}, false } }, SECTIONS).unwrap();
+
+        CHECK(index.Overlaps(0x10F0, 0x1110));
+        CHECK(index.Overlaps(0x1250, 0x1251));
+        CHECK(!index.Overlaps(0x1100, 0x1200));
+        CHECK(!index.Overlaps(0x0, 0x1000));
+    }
+}
+
+int main()
+{
+    MergesAdjacentRegionsThatOptIn();
+    KeepsRegionsApartWithoutMerge();
+    DoesNotMergeAcrossSections();
+    RejectsOverlappingRegions();
+    RejectsRegionsOutsideOfASection();
+    FindsOverlaps();
+    return TestSupport::Finish();
+}
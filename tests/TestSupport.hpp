@@ -0,0 +1,44 @@
+#ifndef TESTS_TESTSUPPORT_HPP_
+#define TESTS_TESTSUPPORT_HPP_
+
+#include <cstdio>
+#include <filesystem>
+#include <string>
+
+/**
+ * @brief
+ * The tests are plain executables. A failed CHECK is reported and counted,
+ * the test keeps going and main returns the result of Finish.
+ */
+namespace TestSupport
+{
+    inline int failures{ 0 };
+
+    inline int Finish()
+    {
+        if(failures != 0) {
+            std::fprintf(stderr, "%d check(s) failed\n", failures);
+        }
+
+        return failures == 0 ? 0 : 1;
+    }
+
+    // Directory of the files written by a test, emptied when the test starts
+    inline std::filesystem::path ScratchDirectory(const std::string& name)
+    {
+        const auto path = std::filesystem::temp_directory_path() / ("ignotum-test-" + name);
+        std::filesystem::remove_all(path);
+        std::filesystem::create_directories(path);
+        return path;
+    }
+}
+
+#define CHECK(condition)                                                                    \
+    do {                                                                                    \
+        if(!(condition)) {                                                                  \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            ++TestSupport::failures;                                                        \
+        }                                                                                   \
+    } while(false)
+
+#endif // TESTS_TESTSUPPORT_HPP_
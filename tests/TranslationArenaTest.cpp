@@ -0,0 +1,124 @@
+#include "TestSupport.hpp"
+
+#include <TranslationArena.hpp>
+
+#include <cstring>
+
+namespace
+{
+    void GrowsTheLastAllocationInPlace()
+    {
+        TranslationArena arena(0x100);
+        auto* block = arena.Allocate(0x10);
+        std::memset(block, 0x11, 0x10);
+
+        auto* grown = arena.Grow(block, 0x10, 0x10, 0x80);
+        CHECK(grown == block);
+        CHECK(grown[0xF] == 0x11);
+    }
+
+    void MovesABlockThatIsNotTheLast()
+    {
+        TranslationArena arena(0x100);
+        auto* block = arena.Allocate(0x10);
+        std::memset(block, 0x22, 0x10);
+        auto* next = arena.Allocate(0x10);
+
+        auto* grown = arena.Grow(block, 0x10, 0x10, 0x20);
+        CHECK(grown != block && grown != next);
+        CHECK(grown[0] == 0x22 && grown[0xF] == 0x22);
+    }
+
+    void MovesABlockThatDoesNotFitItsChunk()
+    {
+        TranslationArena arena(0x100);
+        auto* block = arena.Allocate(0x80);
+        std::memset(block, 0x33, 0x80);
+
+        auto* grown = arena.Grow(block, 0x80, 0x80, 0x200);
+        CHECK(grown != block);
+        CHECK(grown[0] == 0x33 && grown[0x7F] == 0x33);
+    }
+
+    // The buffer written to is the same one, it only keeps its bytes while growing
+    void BufferKeepsItsBytes()
+    {
+        TranslationArena arena(0x40);
+        BytecodeBuffer buffer(arena, 8);
+        for(std::uint32_t i = 0; i < 0x100; ++i) {
+            CHECK(buffer.Write(i));
+        }
+
+        CHECK(buffer.Size() == 0x400);
+        std::uint32_t value{ 0 };
+        std::memcpy(&value, buffer.Data() + 0x3FC, sizeof(value));
+        CHECK(value == 0xFF);
+    }
+
+    // A round spread over several chunks is coalesced into one, a much smaller round gives the memory back
+    void ResetTrimsTheChunks()
+    {
+        TranslationArena arena(0x100);
+        for(int i = 0; i < 8; ++i) {
+            CHECK(arena.Allocate(0xC0) != nullptr);
+        }
+        const auto peak = arena.Capacity();
+        CHECK(peak >= 8 * 0xC0);
+
+        arena.Reset();
+        CHECK(arena.Capacity() == 0);
+
+        CHECK(arena.Allocate(0x10) != nullptr);
+        const auto coalesced = arena.Capacity();
+        CHECK(coalesced >= 8 * 0xC0 && coalesced <= peak);
+
+        arena.Reset();
+        CHECK(arena.Capacity() == 0);
+
+        CHECK(arena.Allocate(0x80) != nullptr);
+        arena.Reset();
+        CHECK(arena.Capacity() == 0x100);
+
+        arena.Release();
+        CHECK(arena.Capacity() == 0);
+    }
+
+    // Two buffers growing in turn are never the last block, every growth moves one and leaves its old block behind.
+    // Only what was live at once is kept for the next round
+    void ResetKeepsTheLiveSize()
+    {
+        constexpr std::size_t BUFFER_SIZE = 0x800;
+
+        TranslationArena arena(0x100);
+        {
+            BytecodeBuffer first(arena, 8);
+            BytecodeBuffer second(arena, 8);
+            for(std::size_t i = 0; i < BUFFER_SIZE / sizeof(std::uint64_t); ++i)
+            {
+                CHECK(first.Write<std::uint64_t>(i));
+                CHECK(second.Write<std::uint64_t>(i));
+            }
+
+            CHECK(first.Capacity() == BUFFER_SIZE && second.Capacity() == BUFFER_SIZE);
+            CHECK(arena.Capacity() > 3 * BUFFER_SIZE);
+        }
+
+        arena.Reset();
+        CHECK(arena.Allocate(0x10) != nullptr);
+
+        // Both buffers, and the old block of the one growing last while it was copied
+        CHECK(arena.Capacity() >= 2 * BUFFER_SIZE);
+        CHECK(arena.Capacity() <= 2 * BUFFER_SIZE + BUFFER_SIZE / 2 + 0x100);
+    }
+}
+
+int main()
+{
+    GrowsTheLastAllocationInPlace();
+    MovesABlockThatIsNotTheLast();
+    MovesABlockThatDoesNotFitItsChunk();
+    BufferKeepsItsBytes();
+    ResetTrimsTheChunks();
+    ResetKeepsTheLiveSize();
+    return TestSupport::Finish();
+}